@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Compiles data/lut_sonames.csv into a sorted string table which autobuild
+maps into memory and searches in-place (see native/ablutindex.hpp).
+
+Layout (all integers are little-endian):
+  header:  magic "ABLUTIDX", u32 version, u32 key count, u32 value count,
+           u32 string pool size, u64 size of the source CSV
+  records: (u32 key offset, u32 key length, u32 first value, u32 value count)
+           for each key, sorted by key
+  values:  (u32 offset, u32 length) for each value
+  pool:    the strings referenced above
+"""
+
+import os
+import sys
+import struct
+import logging
+
+from typing import Dict, List, Set, Tuple
+from pathlib import Path
+
+MAGIC: bytes = b'ABLUTIDX'
+VERSION: int = 1
+HEADER: struct.Struct = struct.Struct('<8sIIIIQ')
+RECORD: struct.Struct = struct.Struct('<IIII')
+VALUE: struct.Struct = struct.Struct('<II')
+
+logging.basicConfig(level=logging.INFO)
+logger = logging.getLogger(__name__)
+
+
+def read_csv(path: Path) -> Dict[bytes, Set[bytes]]:
+    lut: Dict[bytes, Set[bytes]] = dict()
+    with open(path, 'rb') as f:
+        for line in f:
+            fields = line.rstrip(b'\n').split(b',')
+            if len(fields) < 2:
+                raise ValueError('Malformed line in {}: {!r}'.format(path, line))
+            lut.setdefault(fields[0], set()).update(fields[1:])
+    return lut
+
+
+class StringPool:
+    def __init__(self):
+        self.data = bytearray()
+        self.offsets: Dict[bytes, int] = dict()
+
+    def add(self, s: bytes) -> Tuple[int, int]:
+        offset = self.offsets.get(s)
+        if offset is None:
+            offset = len(self.data)
+            self.offsets[s] = offset
+            self.data += s
+        return offset, len(s)
+
+
+def build_index(lut: Dict[bytes, Set[bytes]], source_size: int) -> bytes:
+    pool = StringPool()
+    records: List[bytes] = []
+    values: List[bytes] = []
+    for key in sorted(lut.keys()):
+        key_offset, key_len = pool.add(key)
+        provides = sorted(lut[key])
+        records.append(RECORD.pack(key_offset, key_len, len(values), len(provides)))
+        for value in provides:
+            values.append(VALUE.pack(*pool.add(value)))
+    header = HEADER.pack(MAGIC, VERSION, len(records), len(values), len(pool.data), source_size)
+    return b''.join([header, *records, *values, bytes(pool.data)])
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print('Usage: {} <lut_sonames.csv> <output>'.format(sys.argv[0]), file=sys.stderr)
+        exit(1)
+    source_path = Path(sys.argv[1])
+    target_path = Path(sys.argv[2])
+    lut = read_csv(source_path)
+    index = build_index(lut, source_path.stat().st_size)
+    logger.info('{} entries found, saving to {}'.format(len(lut), target_path))
+    temp_path = target_path.with_name(target_path.name + '.tmp')
+    with open(temp_path, 'wb') as target_file:
+        target_file.write(index)
+    os.replace(temp_path, target_path)
@@ -11,6 +11,12 @@ filter_elf() {
 	    abinfo 'Not splitting ELF binaries as requested.'
 		_opts+=('-x')
 	fi
+	if ! bool "$ABNATIVESTRIP"; then
+		_opts+=('-t')
+	fi
+	if [ -n "$ABDBGCOMPRESS" ]; then
+		_opts+=('-z' "$ABDBGCOMPRESS")
+	fi
 
 	local _elf_path=()
 	for i in "$PKGDIR"/{opt/*/*/,opt/*/,usr/,}{lib{,64,exec},{s,}bin}/; do
@@ -19,7 +25,11 @@ filter_elf() {
         fi
 	done
 
-	abelf_copy_dbg_parallel "${_opts[@]}" "${_elf_path[@]}" "${SYMDIR}"
+	abelf_copy_dbg_parallel -c "$SRCDIR"/abelf.cache \
+		"${_opts[@]}" "${_elf_path[@]}" "${SYMDIR}"
 }
 
-ab_register_filter elf
+# __AB_SO_DEPS and __AB_SONAMES are used when packaging
+ab_register_filter -w lib -w lib64 -w libexec -w bin -w sbin \
+	-w usr/lib -w usr/lib64 -w usr/libexec -w usr/bin -w usr/sbin -w opt \
+	-w "$SYMDIR" -o __AB_SO_DEPS -o __AB_SONAMES elf
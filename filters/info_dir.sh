@@ -8,4 +8,4 @@ filter_infodir(){
 	fi
 }
 
-ab_register_filter infodir
+ab_register_filter -w usr/share/info infodir
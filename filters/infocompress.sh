@@ -1,31 +1,51 @@
 #!/bin/bash
 ##filter/infocompress.sh: Compresses Texinfo pages
 ##@copyright GPL-2.0+
+
+# Fallback for autobuild built without liblzma
+infocompress_xz() {
+	local __infocomp_todo=()
+	for i in "$@"; do
+		if [[ -L $i ]]; then
+			local __infocomp_lnk
+			__infocomp_lnk="$(readlink -f "$i")"
+			rm "$i"
+			ln -sf "$__infocomp_lnk".xz "$i"
+		elif [[ -f $i ]]; then
+			__infocomp_todo+=("$i")
+		else
+			abwarn "abinfocomp WTF for ${i#"$PKGDIR"}"
+		fi
+	done
+
+	if ((${#__infocomp_todo[@]})); then
+		xz --lzma2=preset=6e,pb=0 -- "${__infocomp_todo[@]}"
+	fi
+}
+
 filter_infocompress() {
 	((ABINFOCOMPRESS)) || return
 	local __infocomp_todo=()
 
 	if [ -d "$PKGDIR"/usr/share/info ]; then
-		for i in "$PKGDIR"/usr/share/info/*.info; do
-			if [[ -L $i ]]; then
-				local __infocomp_lnk
-				__infocomp_lnk="$(readlink -f "$i")"
-				rm "$i"
-				ln -sf "$__infocomp_lnk".xz "$i"
-			elif [[ -f $i ]]; then
-				__infocomp_todo+=("$i")
-			else
-				abwarn "abinfocomp WTF for ${i#"$PKGDIR"}"
-			fi
-		done
+		__infocomp_todo=("$PKGDIR"/usr/share/info/*.info)
 
-		if ((${#__infocomp_todo})); then
-			abinfo "Compressing Texinfo page ${__infocomp_todo[*]} ..."
-			xz --lzma2=preset=6e,pb=0 -- "${__infocomp_todo[@]}"
+		if ((${#__infocomp_todo[@]})); then
+			abinfo "Compressing ${#__infocomp_todo[@]} Texinfo page(s) ..."
+			local _ret=0
+			abfilter_compress_pages -f "$ABPAGECOMPRESSOR" "$PKGDIR" "${__infocomp_todo[@]}" || _ret=$?
+			case $_ret in
+				0) ;;
+				127)
+					abdbg "Native page compressor is unavailable, using xz"
+					infocompress_xz "${__infocomp_todo[@]}"
+					;;
+				*) abdie "Failed to compress Texinfo pages: $_ret." ;;
+			esac
 		fi
 	fi
 
-	unset __infocomp_todo __infocomp_lnk
+	unset __infocomp_todo
 }
 
-ab_register_filter infocompress
+ab_register_filter -w usr/share/info -a infodir infocompress
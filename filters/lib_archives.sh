@@ -13,4 +13,5 @@ filter_lib_archives() {
 	fi
 }
 
-ab_register_filter lib_archives
+# Purges the whole tree, before the archives would be stripped
+ab_register_filter -b elf lib_archives
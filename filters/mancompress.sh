@@ -1,6 +1,32 @@
 #!/bin/bash
 ##filter/mancompress.sh: Compresses manpages and break symlinks and boom
 ##@copyright GPL-2.0+
+
+# Fallback for autobuild built without liblzma
+mancompress_xz() {
+	local __mancomp_todo=()
+	for i in "$@"; do
+		if [[ -L $i ]]; then
+			local __mancomp_lnk
+			local __mancomp_lnk_rel
+			local __mancomp_lnk_dir
+			__mancomp_lnk="$(readlink -f "$i")"
+			__mancomp_lnk_dir="$(dirname "$i")"
+			__mancomp_lnk_rel="$(realpath --relative-to=$__mancomp_lnk_dir $__mancomp_lnk)"
+			rm "$i"
+			ln -svf "$__mancomp_lnk_rel".xz "$i"
+		elif [[ -f $i ]]; then
+			__mancomp_todo+=("$i")
+		else
+			abwarn "abmancomp WTF for ${i#"$PKGDIR"}"
+		fi
+	done
+
+	if ((${#__mancomp_todo[@]})); then
+		xz --lzma2=preset=6e,pb=0 --force -- "${__mancomp_todo[@]}"
+	fi
+}
+
 filter_mancompress() {
 	if bool "$ABMANCOMPRESS"; then
 		local __mancomp_todo=()
@@ -10,31 +36,26 @@ filter_mancompress() {
 				if [[ $i == *.gz || $i == *.bz2 || $i = *.zst || $i == *.xz ]]; then
 					continue
 				fi
-
-				if [[ -L $i ]]; then
-					local __mancomp_lnk
-					local __mancomp_lnk_rel
-					local __mancomp_lnk_dir
-					__mancomp_lnk="$(readlink -f "$i")"
-					__mancomp_lnk_dir="$(dirname "$i")"
-					__mancomp_lnk_rel="$(realpath --relative-to=$__mancomp_lnk_dir $__mancomp_lnk)"
-					rm "$i"
-					ln -svf "$__mancomp_lnk_rel".xz "$i"
-				elif [[ -f $i ]]; then
-					__mancomp_todo+=("$i")
-				else
-					abwarn "abmancomp WTF for ${i#"$PKGDIR"}"
-				fi
+				__mancomp_todo+=("$i")
 			done
 
-			if ((${#__mancomp_todo})); then
-				abinfo "Compressing man page ${__mancomp_todo[*]} ..."
-				xz --lzma2=preset=6e,pb=0 --force -- "${__mancomp_todo[@]}"
+			if ((${#__mancomp_todo[@]})); then
+				abinfo "Compressing ${#__mancomp_todo[@]} man page(s) ..."
+				local _ret=0
+				abfilter_compress_pages -f "$ABPAGECOMPRESSOR" "$PKGDIR" "${__mancomp_todo[@]}" || _ret=$?
+				case $_ret in
+					0) ;;
+					127)
+						abdbg "Native page compressor is unavailable, using xz"
+						mancompress_xz "${__mancomp_todo[@]}"
+						;;
+					*) abdie "Failed to compress man pages: $_ret." ;;
+				esac
 			fi
 		fi
 
-		unset __mancomp_todo __mancomp_lnk
+		unset __mancomp_todo
 	fi
 }
 
-ab_register_filter mancompress
+ab_register_filter -w usr/share/man mancompress
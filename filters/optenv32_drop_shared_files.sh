@@ -33,4 +33,5 @@ filter_optenv_drop_shared_files() {
 	fi
 }
 
-ab_register_filter optenv_drop_shared_files
+# The paths are relative to $PKGDIR, e.g. -w ./usr/share
+ab_register_filter "${OPTENV_SHARED_PATHS[@]/#/-w.}" optenv_drop_shared_files
@@ -9,4 +9,5 @@ filter_perl(){
 	find "$PKGDIR" -name .packlist -delete
 }
 
-ab_register_filter perl
+# Purges the whole tree, before the ELF filter runs
+ab_register_filter -b elf perl
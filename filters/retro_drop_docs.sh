@@ -20,4 +20,4 @@ filter_retro_drop_docs() {
 	fi
 }
 
-ab_register_filter retro_drop_docs
+ab_register_filter -w usr/share/doc -w usr/share/gtk-doc retro_drop_docs
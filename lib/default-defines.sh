@@ -4,6 +4,7 @@
 
 # Misc building flags
 ABARCHIVE=abpm_aosc_archive	# Archive program
+ABARCHIVELINK=no		# Hard-link packages into /debs instead of copying them, when possible?
 ABSHADOW=yes			# Shall shadow builds be performed by default?
 NOLTO=no			# Enable LTO by default.
 USECLANG=no			# Are we using clang?
@@ -22,13 +23,27 @@ ABSPIRAL=yes			# Enable spiral provides generation
 # Strict Autotools option checking?
 AUTOTOOLS_STRICT=yes
 
-# Parallelism, the default value is an equation depending on the number of processors.
+# Parallelism, the default value is an equation depending on the number of processors
+# available to the build (CPU affinity and cgroup CPU quota), capped so that each job
+# gets $ABMEMPERJOB MiB of the memory available to the build.
 # $ABTHREADS will take any integer larger than 0.
-ABTHREADS=$(( $(nproc) + 1))
+ABMEMPERJOB=1024
+abconcurrency_probe -m "$ABMEMPERJOB" __AB_JOBS
+ABTHREADS=$(( __AB_JOBS + 1))
+ABJOBSERVER=1	# Share $ABTHREADS with a GNU make jobserver (requires make >= 4.4)?
+ABOUTPUTORDER=submission	# Order of the output of parallel tasks: submission, completion or direct (not captured)
+ABPARALLELFILTERS=1	# Run the post-build filters which do not touch the same paths concurrently?
+ABTRACEFILE="$SRCDIR/abtrace.json"	# Build profile (Chrome trace-event format, for chrome://tracing or Perfetto), empty to disable
+ABUSAGEFILE="$SRCDIR/abusage.json"	# CPU time, peak memory and block I/O of the build stages (JSON), empty to disable
 ABMANCOMPRESS=1
 ABINFOCOMPRESS=1
+ABPAGECOMPRESSOR=xz	# Compressor for man and info pages: xz or zstd (zstd needs the native compressor)
 ABELFDEP=0	# Guess dependencies from ldd?
 ABSTRIP=1	# Should ELF be stripped off debug and unneeded symbols?
+ABNATIVESTRIP=1	# Strip ELF in-process instead of using strip/eu-strip/objcopy?
+ABDBGCOMPRESS=	# Compress the debug sections of the debug symbol package: zstd or zlib, empty to disable
+ABNATIVEDEB=1	# Build .deb packages in-process instead of using dpkg-deb?
+ABCACHEDIR=/var/cache/autobuild4	# Where to keep the indices reused between builds
 
 # Use -O3 instead?
 AB_FLAGS_O3=0
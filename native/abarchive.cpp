@@ -0,0 +1,333 @@
+#include "abarchive.hpp"
+#include "abprobe.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t ar_magic_size = 8;
+constexpr char ar_magic[] = "!<arch>\n";
+constexpr char ar_thin_magic[] = "!<thin>\n";
+constexpr size_t ar_header_size = 60;
+
+// field offsets and widths of a member header
+constexpr size_t ar_name_width = 16;
+constexpr size_t ar_date_offset = 16;
+constexpr size_t ar_date_width = 12;
+constexpr size_t ar_uid_offset = 28;
+constexpr size_t ar_uid_width = 6;
+constexpr size_t ar_gid_offset = 34;
+constexpr size_t ar_gid_width = 6;
+constexpr size_t ar_mode_offset = 40;
+constexpr size_t ar_mode_width = 8;
+constexpr size_t ar_size_offset = 48;
+constexpr size_t ar_size_width = 10;
+constexpr size_t ar_fmag_offset = 58;
+
+// Parses a space padded decimal field
+bool parse_decimal(const char *field, const size_t width, uint64_t &value) {
+  value = 0;
+  size_t i = 0;
+  for (; i < width && field[i] >= '0' && field[i] <= '9'; i++)
+    value = value * 10 + (field[i] - '0');
+  if (i == 0)
+    return false;
+  for (; i < width; i++) {
+    if (field[i] != ' ')
+      return false;
+  }
+  return true;
+}
+
+// Writes a space padded field, as ar(1) does
+void put_field(char *header, const size_t offset, const size_t width,
+               const char *value) {
+  memset(header + offset, ' ', width);
+  memcpy(header + offset, value, std::min(width, strlen(value)));
+}
+
+inline uint64_t padded(const uint64_t offset) { return offset + (offset & 1); }
+
+bool is_bsd_symbol_table(const std::string &name) {
+  return name.compare(0, 9, "__.SYMDEF") == 0;
+}
+
+// Rewrites the member offsets of a GNU symbol table
+template <typename Offset>
+bool rewrite_symbol_table(
+    std::vector<char> &contents,
+    const std::unordered_map<uint64_t, uint64_t> &new_offsets) {
+  const auto decode = [](Offset value) {
+    return sizeof(Offset) == 8 ? be64toh(value) : be32toh(value);
+  };
+  const auto encode = [](Offset value) -> Offset {
+    return sizeof(Offset) == 8 ? htobe64(value) : htobe32(value);
+  };
+  if (contents.size() < sizeof(Offset))
+    return false;
+  Offset count = 0;
+  memcpy(&count, contents.data(), sizeof(count));
+  count = decode(count);
+  if (count > (contents.size() - sizeof(Offset)) / sizeof(Offset))
+    return false;
+  for (Offset i = 0; i < count; i++) {
+    char *entry = contents.data() + (i + 1) * sizeof(Offset);
+    Offset offset = 0;
+    memcpy(&offset, entry, sizeof(offset));
+    const auto search = new_offsets.find(decode(offset));
+    if (search == new_offsets.end())
+      return false;
+    offset = encode(static_cast<Offset>(search->second));
+    memcpy(entry, &offset, sizeof(offset));
+  }
+  return true;
+}
+
+bool write_all(const int fd, const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+} // namespace
+
+bool ArArchive::parse(const char *data, const size_t size) {
+  m_data = data;
+  m_size = size;
+  m_long_names = nullptr;
+  m_long_names_size = 0;
+  m_members.clear();
+  if (size < ar_magic_size)
+    return false;
+  if (memcmp(data, ar_magic, ar_magic_size) == 0)
+    m_thin = false;
+  else if (memcmp(data, ar_thin_magic, ar_magic_size) == 0)
+    m_thin = true;
+  else
+    return false;
+
+  uint64_t pos = ar_magic_size;
+  while (pos < size) {
+    if (size - pos < ar_header_size)
+      return false;
+    const char *header = data + pos;
+    if (header[ar_fmag_offset] != '`' || header[ar_fmag_offset + 1] != '\n')
+      return false;
+    uint64_t field_size = 0;
+    if (!parse_decimal(header + ar_size_offset, ar_size_width, field_size))
+      return false;
+    ArMember member{ArMemberKind::Regular, {}, pos, pos + ar_header_size,
+                    field_size, 0};
+    if (!resolve_name(header, member))
+      return false;
+    // the members of a thin archive are stored elsewhere, but its symbol
+    // and long name tables are not
+    const bool has_data = !m_thin || member.kind != ArMemberKind::Regular;
+    if (has_data && field_size > size - member.data_offset)
+      return false;
+    if (member.name_size > 0) {
+      // BSD: the name is stored in front of the contents
+      if (!has_data || member.name_size > field_size)
+        return false;
+      const char *name = data + member.data_offset;
+      member.name.assign(name, strnlen(name, member.name_size));
+      member.data_offset += member.name_size;
+      member.size -= member.name_size;
+      if (is_bsd_symbol_table(member.name))
+        member.kind = ArMemberKind::BsdSymbolTable;
+    }
+    if (member.kind == ArMemberKind::LongNames) {
+      m_long_names = data + member.data_offset;
+      m_long_names_size = member.size;
+    }
+    m_members.push_back(std::move(member));
+    pos = padded(pos + ar_header_size + (has_data ? field_size : 0));
+  }
+  return true;
+}
+
+bool ArArchive::resolve_name(const char *field, ArMember &member) const {
+  size_t length = ar_name_width;
+  while (length > 0 && field[length - 1] == ' ')
+    length--;
+  const std::string raw{field, length};
+  if (raw == "/") {
+    member.kind = ArMemberKind::SymbolTable;
+    return true;
+  }
+  if (raw == "/SYM64/") {
+    member.kind = ArMemberKind::SymbolTable64;
+    return true;
+  }
+  if (raw == "//") {
+    member.kind = ArMemberKind::LongNames;
+    return true;
+  }
+  if (raw.size() > 1 && raw[0] == '/') {
+    // GNU: an offset into the long name table, where the names end with
+    // "/\n" (or "\n" in some thin archives)
+    uint64_t offset = 0;
+    if (!parse_decimal(field + 1, ar_name_width - 1, offset) ||
+        offset >= m_long_names_size)
+      return false;
+    const char *start = m_long_names + offset;
+    const char *end = static_cast<const char *>(
+        memchr(start, '\n', m_long_names_size - offset));
+    if (end == nullptr)
+      return false;
+    if (end > start && end[-1] == '/')
+      end--;
+    member.name.assign(start, end);
+    return true;
+  }
+  if (raw.compare(0, 3, "#1/") == 0) {
+    // BSD: the length of the name stored in front of the contents
+    return parse_decimal(field + 3, ar_name_width - 3, member.name_size) &&
+           member.name_size > 0;
+  }
+  if (is_bsd_symbol_table(raw)) {
+    member.kind = ArMemberKind::BsdSymbolTable;
+    member.name = raw;
+    return true;
+  }
+  // GNU names end with a slash, BSD names do not
+  member.name = (!raw.empty() && raw.back() == '/')
+                    ? raw.substr(0, raw.size() - 1)
+                    : raw;
+  return true;
+}
+
+const char *ArArchive::member_data(const ArMember &member) const {
+  if (m_thin && member.kind == ArMemberKind::Regular)
+    return nullptr;
+  return m_data + member.data_offset;
+}
+
+const char *ArArchive::aligned_member_data(
+    const ArMember &member, std::vector<uint64_t> &buffer) const {
+  const char *contents = member_data(member);
+  if (contents == nullptr ||
+      reinterpret_cast<uintptr_t>(contents) % alignof(uint64_t) == 0)
+    return contents;
+  buffer.resize((member.size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  memcpy(buffer.data(), contents, member.size);
+  return reinterpret_cast<const char *>(buffer.data());
+}
+
+std::string ArArchive::member_path(const ArMember &member,
+                                   const char *archive_path) const {
+  if (!member.name.empty() && member.name[0] == '/')
+    return member.name;
+  const char *slash = strrchr(archive_path, '/');
+  if (slash == nullptr)
+    return member.name;
+  return std::string{archive_path, static_cast<size_t>(slash - archive_path)} +
+         "/" + member.name;
+}
+
+int ar_strip_debug_native(const char *data, const size_t size,
+                          const char *path, const ElfStripOptions &options) {
+  ArArchive archive{};
+  if (!archive.parse(data, size) || archive.is_thin())
+    return AB_ELF_STRIP_UNSUPPORTED;
+  const auto &members = archive.members();
+
+  // the stripped contents of each member, empty if it is unchanged
+  std::vector<std::vector<char>> stripped(members.size());
+  bool changed = false;
+  std::vector<uint64_t> buffer{};
+  for (size_t i = 0; i < members.size(); i++) {
+    const auto &member = members[i];
+    // its offsets are in the byte order of the machine which wrote it
+    if (member.kind == ArMemberKind::BsdSymbolTable)
+      return AB_ELF_STRIP_UNSUPPORTED;
+    if (member.kind != ArMemberKind::Regular)
+      continue;
+    const char *contents = archive.aligned_member_data(member, buffer);
+    if (classify_magic(contents, member.size) != FileMagic::Elf)
+      continue;
+    if (elf_strip_object_native(contents, member.size, options,
+                                stripped[i]) != 0)
+      return AB_ELF_STRIP_UNSUPPORTED;
+    changed = changed || !stripped[i].empty();
+  }
+  if (!changed)
+    return 0;
+
+  // the symbol table refers to the members by the offset of their header
+  std::unordered_map<uint64_t, uint64_t> new_offsets{};
+  uint64_t pos = ar_magic_size;
+  for (size_t i = 0; i < members.size(); i++) {
+    const auto &member = members[i];
+    new_offsets.emplace(member.header_offset, pos);
+    const uint64_t contents_size =
+        stripped[i].empty() ? member.size : stripped[i].size();
+    pos = padded(pos + ar_header_size + member.name_size + contents_size);
+  }
+
+  // the library is rewritten in-place, so everything is read from the
+  // mapping first
+  std::vector<char> out(data, data + ar_magic_size);
+  out.reserve(pos);
+  for (size_t i = 0; i < members.size(); i++) {
+    const auto &member = members[i];
+    std::vector<char> contents = std::move(stripped[i]);
+    if (contents.empty()) {
+      const char *start = archive.member_data(member);
+      contents.assign(start, start + member.size);
+    }
+    if ((member.kind == ArMemberKind::SymbolTable &&
+         !rewrite_symbol_table<uint32_t>(contents, new_offsets)) ||
+        (member.kind == ArMemberKind::SymbolTable64 &&
+         !rewrite_symbol_table<uint64_t>(contents, new_offsets)))
+      return AB_ELF_STRIP_UNSUPPORTED;
+
+    // like strip --enable-deterministic-archives
+    char header[ar_header_size];
+    memcpy(header, data + member.header_offset, sizeof(header));
+    char size_field[24];
+    snprintf(size_field, sizeof(size_field), "%llu",
+             static_cast<unsigned long long>(member.name_size +
+                                             contents.size()));
+    put_field(header, ar_date_offset, ar_date_width, "0");
+    put_field(header, ar_uid_offset, ar_uid_width, "0");
+    put_field(header, ar_gid_offset, ar_gid_width, "0");
+    put_field(header, ar_mode_offset, ar_mode_width, "644");
+    put_field(header, ar_size_offset, ar_size_width, size_field);
+    out.insert(out.end(), header, header + sizeof(header));
+    const char *name = data + member.header_offset + ar_header_size;
+    out.insert(out.end(), name, name + member.name_size);
+    out.insert(out.end(), contents.begin(), contents.end());
+    if (out.size() & 1)
+      out.push_back('\n');
+  }
+
+  // the file is updated in-place to preserve its inode, as elf_strip_native
+  // does
+  const int fd = open(path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+  if (fd < 0) {
+    perror("open");
+    return -1;
+  }
+  if (!write_all(fd, out.data(), out.size())) {
+    perror("write");
+    close(fd);
+    return -1;
+  }
+  return close(fd) == 0 ? 0 : -1;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "abelfstrip.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ArMemberKind : uint8_t {
+  // an object or any other file
+  Regular,
+  // the GNU symbol table ("/"), with 32-bit offsets
+  SymbolTable,
+  // the GNU symbol table with 64-bit offsets ("/SYM64/")
+  SymbolTable64,
+  // the BSD symbol table ("__.SYMDEF", "__.SYMDEF SORTED", ...)
+  BsdSymbolTable,
+  // the GNU long name table ("//")
+  LongNames,
+};
+
+struct ArMember {
+  ArMemberKind kind;
+  // the name, resolved from the long name table or the BSD name field
+  std::string name;
+  // offset of the member header in the archive
+  uint64_t header_offset;
+  // offset of the contents in the archive (after a BSD long name)
+  uint64_t data_offset;
+  // size of the contents, for the members of a thin archive this is the
+  // size of the external file
+  uint64_t size;
+  // length of the BSD long name stored in front of the contents
+  uint64_t name_size;
+};
+
+/**
+ * An index of the members of a mapped ar archive (a static library).
+ * GNU and BSD archives are handled, including their long names, as well as
+ * GNU thin archives, whose members are stored in other files.
+ */
+class ArArchive {
+public:
+  ArArchive() = default;
+
+  /**
+   * Indexes the archive at data.
+   * @return false if this is not an archive, or it is malformed
+   */
+  bool parse(const char *data, size_t size);
+
+  inline bool is_thin() const { return m_thin; }
+  // every member, including the symbol and long name tables
+  inline const std::vector<ArMember> &members() const { return m_members; }
+  // the contents of the member, nullptr for the members of a thin archive
+  const char *member_data(const ArMember &member) const;
+  // the contents of the member at an 8-byte aligned address (the members are
+  // only 2-byte aligned), copied into buffer if needed
+  const char *aligned_member_data(const ArMember &member,
+                                  std::vector<uint64_t> &buffer) const;
+  // the path of a member of a thin archive, archive_path is the archive
+  std::string member_path(const ArMember &member,
+                          const char *archive_path) const;
+
+private:
+  bool resolve_name(const char *field, ArMember &member) const;
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  bool m_thin = false;
+  // the GNU long name table
+  const char *m_long_names = nullptr;
+  uint64_t m_long_names_size = 0;
+  std::vector<ArMember> m_members;
+};
+
+/**
+ * Strips the debugging information from each object in a static library,
+ * like strip --strip-debug, and writes the library in-place. The offsets in
+ * the GNU symbol table are updated, the symbols themselves are unchanged.
+ * @param data mapped contents of the library at path
+ * @param options the mode must be ElfStripMode::StripDebug
+ * @return 0 on success, AB_ELF_STRIP_UNSUPPORTED if the native engine does
+ *         not handle this library (e.g. a thin archive, or an object the
+ *         engine does not handle), -1 if an I/O error occurred
+ */
+int ar_strip_debug_native(const char *data, size_t size, const char *path,
+                          const ElfStripOptions &options);
@@ -0,0 +1,301 @@
+#include "abcompress.hpp"
+#include "abnativefunctions.h"
+#include "abtrace.hpp"
+#include "stdwrapper.hpp"
+#include "threadpool.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAS_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// symlinks are followed up to this depth, like the kernel does
+constexpr int max_link_depth = 40;
+constexpr const char *compressed_suffixes[] = {".gz", ".bz2", ".xz", ".zst"};
+
+const char *compressor_suffix(const PageCompressor compressor) {
+  switch (compressor) {
+  case PageCompressor::Xz:
+    return ".xz";
+  case PageCompressor::Zstd:
+    return ".zst";
+  }
+  return "";
+}
+
+bool compressor_available(const PageCompressor compressor) {
+  switch (compressor) {
+  case PageCompressor::Xz:
+#ifdef HAS_LZMA
+    return true;
+#else
+    return false;
+#endif
+  case PageCompressor::Zstd:
+#ifdef HAS_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+bool has_compressed_suffix(const std::string &name) {
+  for (const auto *suffix : compressed_suffixes) {
+    const size_t length = strlen(suffix);
+    if (name.size() > length &&
+        name.compare(name.size() - length, length, suffix) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool read_file(const int fd, const size_t size_hint, std::string &content) {
+  content.resize(size_hint + 1);
+  size_t done = 0;
+  while (true) {
+    if (done == content.size())
+      content.resize(content.size() * 2);
+    const ssize_t bytes = read(fd, &content[done], content.size() - done);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes < 0)
+      return false;
+    if (bytes == 0)
+      break;
+    done += bytes;
+  }
+  content.resize(done);
+  return true;
+}
+
+bool write_file(const int fd, const std::string &content) {
+  size_t done = 0;
+  while (done < content.size()) {
+    const ssize_t bytes =
+        write(fd, content.data() + done, content.size() - done);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes < 0)
+      return false;
+    done += bytes;
+  }
+  return true;
+}
+
+#ifdef HAS_LZMA
+// same as xz --lzma2=preset=6e,pb=0: xz (since 5.6) defaults to its
+// multi-threaded format, which records the sizes in the block headers
+bool compress_xz(const std::string &input, std::string &output) {
+  lzma_options_lzma options{};
+  if (lzma_lzma_preset(&options, 6 | LZMA_PRESET_EXTREME))
+    return false;
+  options.pb = 0;
+  const lzma_filter filters[] = {
+      {LZMA_FILTER_LZMA2, &options},
+      {LZMA_VLI_UNKNOWN, nullptr},
+  };
+  lzma_mt mt_options{};
+  // the pages are compressed in parallel already
+  mt_options.threads = 1;
+  mt_options.filters = filters;
+  mt_options.check = LZMA_CHECK_CRC64;
+  lzma_stream stream = LZMA_STREAM_INIT;
+  if (lzma_stream_encoder_mt(&stream, &mt_options) != LZMA_OK)
+    return false;
+  output.resize(lzma_stream_buffer_bound(input.size()));
+  stream.next_in = reinterpret_cast<const uint8_t *>(input.data());
+  stream.avail_in = input.size();
+  stream.next_out = reinterpret_cast<uint8_t *>(&output[0]);
+  stream.avail_out = output.size();
+  lzma_ret ret = LZMA_OK;
+  while (ret == LZMA_OK) {
+    ret = lzma_code(&stream, LZMA_FINISH);
+    if (ret == LZMA_OK && stream.avail_out == 0) {
+      const size_t done = output.size();
+      output.resize(done * 2);
+      stream.next_out = reinterpret_cast<uint8_t *>(&output[done]);
+      stream.avail_out = output.size() - done;
+    }
+  }
+  output.resize(stream.total_out);
+  lzma_end(&stream);
+  return ret == LZMA_STREAM_END;
+}
+#endif
+
+#ifdef HAS_ZSTD
+// same as zstd -19
+bool compress_zstd(const std::string &input, std::string &output) {
+  ZSTD_CCtx *context = ZSTD_createCCtx();
+  if (!context)
+    return false;
+  ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, 19);
+  ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+  output.resize(ZSTD_compressBound(input.size()));
+  const size_t size = ZSTD_compress2(context, &output[0], output.size(),
+                                     input.data(), input.size());
+  ZSTD_freeCCtx(context);
+  if (ZSTD_isError(size))
+    return false;
+  output.resize(size);
+  return true;
+}
+#endif
+
+bool compress_buffer(const PageCompressor compressor, const std::string &input,
+                     std::string &output) {
+  switch (compressor) {
+  case PageCompressor::Xz:
+#ifdef HAS_LZMA
+    return compress_xz(input, output);
+#else
+    break;
+#endif
+  case PageCompressor::Zstd:
+#ifdef HAS_ZSTD
+    return compress_zstd(input, output);
+#else
+    break;
+#endif
+  }
+  return false;
+}
+
+// Replaces the page with its compressed copy, like xz and zstd --rm do
+bool compress_page(const std::string &path, const PageCompressor compressor) {
+  const int in_fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (in_fd < 0)
+    return false;
+  struct stat st {};
+  std::string input{};
+  if (fstat(in_fd, &st) != 0 || !read_file(in_fd, st.st_size, input)) {
+    close(in_fd);
+    return false;
+  }
+  close(in_fd);
+  std::string output{};
+  if (!compress_buffer(compressor, input, output))
+    return false;
+  const auto compressed_path = path + compressor_suffix(compressor);
+  const int out_fd =
+      open(compressed_path.c_str(),
+           O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (out_fd < 0)
+    return false;
+  const struct timespec times[2] = {st.st_atim, st.st_mtim};
+  // the owner may not be changed if we are not root, which is fine
+  (void)!fchown(out_fd, st.st_uid, st.st_gid);
+  const bool written = write_file(out_fd, output) &&
+                       fchmod(out_fd, st.st_mode & 07777) == 0 &&
+                       futimens(out_fd, times) == 0;
+  if (close(out_fd) != 0 || !written) {
+    unlink(compressed_path.c_str());
+    return false;
+  }
+  return unlink(path.c_str()) == 0;
+}
+
+// Resolves a path inside root like readlink -f does (only the last
+// component is followed), absolute targets are taken as relative to root
+fs::path resolve_in_root(const fs::path &root, fs::path relative) {
+  char buffer[PATH_MAX];
+  for (int depth = 0; depth < max_link_depth; depth++) {
+    const auto full_path = root / relative;
+    const ssize_t length =
+        readlink(full_path.c_str(), buffer, sizeof(buffer) - 1);
+    if (length < 0)
+      break;
+    const fs::path target{std::string(buffer, length)};
+    relative = target.is_absolute() ? target.relative_path()
+                                    : relative.parent_path() / target;
+    relative = relative.lexically_normal();
+  }
+  return relative;
+}
+
+// Points the symlink to the compressed page, with a relative target
+bool relink_page(const fs::path &root, const std::string &path,
+                 const PageCompressor compressor) {
+  const auto relative =
+      fs::absolute(path).lexically_normal().lexically_relative(root);
+  const auto target = resolve_in_root(root, relative);
+  auto new_target =
+      target.lexically_relative(relative.parent_path()).string();
+  if (!has_compressed_suffix(new_target))
+    new_target += compressor_suffix(compressor);
+  // replace the symlink atomically
+  const auto temp_path = path + ".ab-relink";
+  unlink(temp_path.c_str());
+  if (symlink(new_target.c_str(), temp_path.c_str()) != 0)
+    return false;
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool page_compressor_from_string(const char *value,
+                                 PageCompressor &compressor) {
+  if (!value || strcmp(value, "xz") == 0) {
+    compressor = PageCompressor::Xz;
+    return true;
+  }
+  if (strcmp(value, "zstd") == 0) {
+    compressor = PageCompressor::Zstd;
+    return true;
+  }
+  return false;
+}
+
+int compress_pages(const std::string &root,
+                   const std::vector<std::string> &pages,
+                   const PageCompressor compressor) {
+  if (!compressor_available(compressor))
+    return AB_COMPRESS_UNSUPPORTED;
+  const fs::path root_path = fs::absolute(root).lexically_normal();
+  ThreadPool<std::string, int> pool{[&](const std::string &path) {
+    const TraceScope span{"compress", path};
+    struct stat st {};
+    if (lstat(path.c_str(), &st) != 0) {
+      get_logger()->error(
+          fmt::format("Unable to stat {0}: {1}", path, strerror(errno)));
+      return -1;
+    }
+    if (S_ISLNK(st.st_mode)) {
+      if (!relink_page(root_path, path, compressor)) {
+        get_logger()->error(fmt::format("Unable to relink {0}: {1}", path,
+                                        strerror(errno)));
+        return -1;
+      }
+    } else if (S_ISREG(st.st_mode)) {
+      if (!compress_page(path, compressor)) {
+        get_logger()->error(fmt::format("Unable to compress {0}: {1}", path,
+                                        strerror(errno)));
+        return -1;
+      }
+    } else {
+      get_logger()->warning(
+          fmt::format("{0} is neither a file nor a symlink", path));
+    }
+    return 0;
+  }};
+  pool.enqueue_batch(std::vector<std::string>{pages});
+  pool.wait_for_completion();
+  return pool.has_error() ? -1 : 0;
+}
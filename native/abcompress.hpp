@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class PageCompressor : uint8_t {
+  // xz --lzma2=preset=6e,pb=0
+  Xz,
+  // zstd -19
+  Zstd,
+};
+
+// The compressor is not available (autobuild is built without its library),
+// the caller should compress the pages by itself.
+constexpr int AB_COMPRESS_UNSUPPORTED = 127;
+
+/**
+ * Parses a compressor name ("xz" or "zstd").
+ * @return false if the name is unknown
+ */
+bool page_compressor_from_string(const char *value, PageCompressor &compressor);
+
+/**
+ * Compresses man and info pages in place, in parallel.
+ * Each regular file is replaced by a compressed copy with the compressor's
+ * suffix (.xz or .zst), keeping its mode, owner and modification time.
+ * Each symlink is pointed to the compressed page instead, with a target
+ * relative to the symlink; absolute targets are resolved inside root (the
+ * package directory). The symlinks themselves keep their names.
+ * @return 0 on success, AB_COMPRESS_UNSUPPORTED, or -1 if a page could not
+ *         be compressed
+ */
+int compress_pages(const std::string &root,
+                   const std::vector<std::string> &pages,
+                   PageCompressor compressor);
@@ -0,0 +1,110 @@
+#include "abconcurrency.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <fstream>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+constexpr const char *cgroup_root = "/sys/fs/cgroup";
+
+static unsigned int get_affinity_cpus() {
+  // the mask has to be large enough for all the CPUs of the host
+  for (size_t cpus = 1024; cpus <= (1 << 20); cpus *= 2) {
+    cpu_set_t *mask = CPU_ALLOC(cpus);
+    if (!mask)
+      break;
+    const size_t size = CPU_ALLOC_SIZE(cpus);
+    CPU_ZERO_S(size, mask);
+    if (sched_getaffinity(0, size, mask) == 0) {
+      const int count = CPU_COUNT_S(size, mask);
+      CPU_FREE(mask);
+      return std::max(count, 1);
+    }
+    CPU_FREE(mask);
+    if (errno != EINVAL)
+      break;
+  }
+  return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+// Returns the cgroup v2 path of this process, relative to the cgroup root
+static std::string get_cgroup_path() {
+  std::ifstream cgroup_file{"/proc/self/cgroup"};
+  std::string line{};
+  while (std::getline(cgroup_file, line)) {
+    // the unified hierarchy is listed as "0::<path>"
+    if (line.compare(0, 3, "0::") == 0)
+      return line.substr(3);
+  }
+  return {};
+}
+
+static bool read_first_line(const std::string &path, std::string &line) {
+  std::ifstream file{path};
+  return static_cast<bool>(std::getline(file, line));
+}
+
+// Walks up from the cgroup of this process, and takes the tightest limits
+static void read_cgroup_limits(double &cpu_quota, uint64_t &memory_limit) {
+  std::string cgroup = get_cgroup_path();
+  if (cgroup.empty())
+    return;
+  std::string line{};
+  while (true) {
+    const std::string dir = cgroup_root + cgroup;
+    // "<quota> <period>" or "max <period>"
+    if (read_first_line(dir + "/cpu.max", line) &&
+        line.compare(0, 3, "max") != 0) {
+      try {
+        size_t end = 0;
+        const double quota = std::stod(line, &end);
+        const double period = std::stod(line.substr(end));
+        if (quota > 0 && period > 0 &&
+            (cpu_quota == 0 || quota / period < cpu_quota))
+          cpu_quota = quota / period;
+      } catch (const std::exception &) {
+      }
+    }
+    if (read_first_line(dir + "/memory.max", line) && line != "max") {
+      try {
+        const uint64_t limit = std::stoull(line);
+        if (limit > 0 && limit < memory_limit)
+          memory_limit = limit;
+      } catch (const std::exception &) {
+      }
+    }
+    if (cgroup.empty() || cgroup == "/")
+      break;
+    const size_t slash = cgroup.rfind('/');
+    cgroup.resize(slash == 0 ? 1 : slash);
+  }
+}
+
+ConcurrencyLimits concurrency_probe(const uint64_t memory_per_job) {
+  ConcurrencyLimits limits{};
+  limits.affinity_cpus = get_affinity_cpus();
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long page_size = sysconf(_SC_PAGESIZE);
+  limits.memory_limit = (pages > 0 && page_size > 0)
+                            ? static_cast<uint64_t>(pages) * page_size
+                            : UINT64_MAX;
+  read_cgroup_limits(limits.cpu_quota, limits.memory_limit);
+
+  unsigned int jobs = limits.affinity_cpus;
+  if (limits.cpu_quota > 0)
+    jobs = std::min(jobs, static_cast<unsigned int>(
+                              std::ceil(limits.cpu_quota)));
+  if (memory_per_job > 0 && limits.memory_limit != UINT64_MAX)
+    jobs = std::min<uint64_t>(jobs, limits.memory_limit / memory_per_job);
+  limits.jobs = std::max(jobs, 1U);
+  return limits;
+}
+
+unsigned int available_concurrency() {
+  static const unsigned int jobs = concurrency_probe(0).jobs;
+  return jobs;
+}
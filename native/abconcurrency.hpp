@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+struct ConcurrencyLimits {
+  // CPUs this process may run on (sched_getaffinity)
+  unsigned int affinity_cpus;
+  // CPU bandwidth allowed by cgroup v2 cpu.max, in CPUs (0 if unlimited)
+  double cpu_quota;
+  // memory available to the cgroup, or the physical memory (in bytes)
+  uint64_t memory_limit;
+  // the resulting number of parallel jobs, at least 1
+  unsigned int jobs;
+};
+
+/**
+ * Detects how many jobs may run in parallel: the number of CPUs in the
+ * affinity mask, lowered by the cgroup v2 cpu.max quotas of this process
+ * and its parent cgroups, and by memory.max (or the physical memory) if
+ * each job needs memory_per_job bytes.
+ * @param memory_per_job memory needed by each job, 0 to ignore memory
+ */
+ConcurrencyLimits concurrency_probe(uint64_t memory_per_job);
+
+/**
+ * Returns the number of CPUs this process may use (the jobs reported by
+ * concurrency_probe() without a memory limit). The result is cached, this
+ * is the default size of the native thread pools.
+ */
+unsigned int available_concurrency();
@@ -0,0 +1,187 @@
+#include "abcopy.hpp"
+#include "abnativefunctions.h"
+#include "abtrace.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// the kernel copies at most this much per call
+constexpr size_t copy_chunk_size = 1 << 30;
+
+std::string temp_path_for(const std::string &dst) {
+  static std::atomic<unsigned int> counter{0};
+  return fmt::format("{0}.ab-tmp.{1}.{2}", dst, getpid(), counter++);
+}
+
+bool copy_with_read_write(const int in_fd, const int out_fd) {
+  char buffer[65536];
+  while (true) {
+    const ssize_t bytes = read(in_fd, buffer, sizeof(buffer));
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes < 0)
+      return false;
+    if (bytes == 0)
+      return true;
+    ssize_t done = 0;
+    while (done < bytes) {
+      const ssize_t written = write(out_fd, buffer + done, bytes - done);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+        return false;
+      done += written;
+    }
+  }
+}
+
+// these mean that the method is not supported for this pair of files
+bool is_unsupported(const int error) {
+  return error == ENOSYS || error == EXDEV || error == EINVAL ||
+         error == EOPNOTSUPP || error == ENOTSUP || error == EBADF;
+}
+
+bool copy_data(const int in_fd, const int out_fd) {
+#ifdef FICLONE
+  if (ioctl(out_fd, FICLONE, in_fd) == 0)
+    return true;
+#endif
+  // copy_file_range may fall back to a regular copy in the kernel, or fail
+  // before anything is copied if the file systems do not support it
+  bool copied_any = false;
+  while (true) {
+    const ssize_t bytes = copy_file_range(in_fd, nullptr, out_fd, nullptr,
+                                          copy_chunk_size, 0);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes == 0)
+      return true;
+    if (bytes > 0) {
+      copied_any = true;
+      continue;
+    }
+    if (copied_any || !is_unsupported(errno))
+      return false;
+    break;
+  }
+  while (true) {
+    const ssize_t bytes = sendfile(out_fd, in_fd, nullptr, copy_chunk_size);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes == 0)
+      return true;
+    if (bytes > 0) {
+      copied_any = true;
+      continue;
+    }
+    if (copied_any || !is_unsupported(errno))
+      return false;
+    break;
+  }
+  return copy_with_read_write(in_fd, out_fd);
+}
+
+bool copy_to(const std::string &src, const std::string &temp_path) {
+  const int in_fd = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in_fd < 0)
+    return false;
+  struct stat st {};
+  if (fstat(in_fd, &st) != 0) {
+    close(in_fd);
+    return false;
+  }
+  const int out_fd = open(temp_path.c_str(),
+                          O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (out_fd < 0) {
+    close(in_fd);
+    return false;
+  }
+  bool copied =
+      copy_data(in_fd, out_fd) && fchmod(out_fd, st.st_mode & 07777) == 0;
+  int saved_errno = errno;
+  close(in_fd);
+  if (close(out_fd) != 0 && copied) {
+    copied = false;
+    saved_errno = errno;
+  }
+  if (!copied) {
+    unlink(temp_path.c_str());
+    errno = saved_errno;
+  }
+  return copied;
+}
+
+} // namespace
+
+int copy_file_fast(const std::string &src, const std::string &dst,
+                   const bool hard_link) {
+  struct stat src_st {};
+  struct stat dst_st {};
+  // e.g. the destination is already a hard link to the source
+  if (stat(src.c_str(), &src_st) == 0 && stat(dst.c_str(), &dst_st) == 0 &&
+      src_st.st_dev == dst_st.st_dev && src_st.st_ino == dst_st.st_ino)
+    return 0;
+  const auto temp_path = temp_path_for(dst);
+  if (hard_link && link(src.c_str(), temp_path.c_str()) == 0) {
+    if (rename(temp_path.c_str(), dst.c_str()) == 0) {
+      // rename() does nothing if both are links to the same file, which
+      // happens if the destination was linked in the meantime
+      unlink(temp_path.c_str());
+      return 0;
+    }
+    const int saved_errno = errno;
+    unlink(temp_path.c_str());
+    errno = saved_errno;
+    return -1;
+  }
+  if (!copy_to(src, temp_path))
+    return -1;
+  if (rename(temp_path.c_str(), dst.c_str()) != 0) {
+    const int saved_errno = errno;
+    unlink(temp_path.c_str());
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+}
+
+size_t copy_files_parallel(
+    const std::vector<std::pair<std::string, std::string>> &files,
+    const bool hard_link, std::vector<int> *statuses) {
+  std::atomic<size_t> failed{0};
+  if (statuses)
+    statuses->assign(files.size(), 0);
+  std::vector<size_t> indices(files.size());
+  for (size_t i = 0; i < indices.size(); i++)
+    indices[i] = i;
+  ThreadPool<size_t, int> pool{
+      [&](const size_t index) {
+        const auto &file = files[index];
+        const TraceScope span{"copy", file.first};
+        if (copy_file_fast(file.first, file.second, hard_link) != 0) {
+          get_logger()->error(fmt::format("Unable to copy {0} to {1}: {2}",
+                                          file.first, file.second,
+                                          strerror(errno)));
+          failed++;
+          if (statuses)
+            (*statuses)[index] = -1;
+          return -1;
+        }
+        return 0;
+      },
+      static_cast<unsigned int>(std::min<size_t>(
+          std::max<size_t>(files.size(), 1), available_concurrency()))};
+  pool.enqueue_batch(std::move(indices));
+  pool.wait_for_completion();
+  return failed.load();
+}
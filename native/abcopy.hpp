@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Copies a file, keeping the data out of user space where possible: the
+ * destination shares the extents of the source (FICLONE reflink) if the
+ * file system supports it, otherwise the kernel copies the data with
+ * copy_file_range or sendfile. With hard_link, the destination is made a
+ * hard link to the source instead, if both are on the same file system.
+ * The permissions of the source are kept, and the destination is replaced
+ * atomically if it exists. Nothing is done if the destination already is
+ * the source (or a hard link to it).
+ * @return 0 on success, -1 on error (with errno set)
+ */
+int copy_file_fast(const std::string &src, const std::string &dst,
+                   bool hard_link = false);
+
+/**
+ * Copies each (source, destination) pair with copy_file_fast, in parallel.
+ * Errors are logged. If statuses is given, the result of each copy is saved
+ * to it, in the order of files (0 on success, -1 on error).
+ * @return the number of files which could not be copied
+ */
+size_t copy_files_parallel(
+    const std::vector<std::pair<std::string, std::string>> &files,
+    bool hard_link = false, std::vector<int> *statuses = nullptr);
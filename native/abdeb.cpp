@@ -0,0 +1,747 @@
+#include "abdeb.hpp"
+#include "abmanifest.hpp"
+#include "abnativefunctions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <grp.h>
+#include <pwd.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#ifdef HAS_ZSTD
+#include <zstd.h>
+
+namespace {
+
+constexpr size_t tar_block_size = 512;
+// GNU tar pads the archive to a multiple of its default record size
+constexpr size_t tar_record_size = 10240;
+constexpr size_t io_buffer_size = 1 << 20;
+constexpr char ar_magic[] = "!<arch>\n";
+constexpr char deb_version[] = "2.0\n";
+constexpr char control_dir[] = "/DEBIAN";
+constexpr size_t control_dir_len = sizeof(control_dir) - 1;
+
+struct TarHeader {
+  char name[100];
+  char mode[8];
+  char uid[8];
+  char gid[8];
+  char size[12];
+  char mtime[12];
+  char chksum[8];
+  char typeflag;
+  char linkname[100];
+  char magic[6];
+  char version[2];
+  char uname[32];
+  char gname[32];
+  char devmajor[8];
+  char devminor[8];
+  char prefix[155];
+  char padding[12];
+};
+
+static_assert(sizeof(TarHeader) == tar_block_size, "Invalid tar header size");
+
+bool write_all(const int fd, const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+// Stores a number in a tar header field, using the GNU base-256 extension
+// if it does not fit in octal digits
+template <size_t N> void put_number(char (&field)[N], const uint64_t value) {
+  if (value < (1ULL << (3 * (N - 1)))) {
+    snprintf(field, N, "%0*llo", static_cast<int>(N - 1),
+             static_cast<unsigned long long>(value));
+    return;
+  }
+  memset(field, 0, N);
+  field[0] = static_cast<char>(0x80);
+  uint64_t remaining = value;
+  for (size_t i = N - 1; i > 0 && remaining; i--) {
+    field[i] = static_cast<char>(remaining & 0xff);
+    remaining >>= 8;
+  }
+}
+
+template <size_t N> void put_string(char (&field)[N], const std::string &value) {
+  memcpy(field, value.data(), std::min(value.size(), N));
+}
+
+// Compresses everything written into it and appends it to a file
+class ZstdWriter {
+public:
+  ZstdWriter(const int fd, const DebBuildOptions &options)
+      : m_fd(fd), m_cctx(ZSTD_createCCtx()), m_out(ZSTD_CStreamOutSize()) {
+    m_valid = m_cctx != nullptr &&
+              !ZSTD_isError(ZSTD_CCtx_setParameter(
+                  m_cctx, ZSTD_c_compressionLevel, options.level)) &&
+              !ZSTD_isError(
+                  ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_checksumFlag, 1));
+    if (!m_valid)
+      return;
+    // fails if libzstd is built without multi-threading support, in which
+    // case the data is compressed on the calling thread
+    if (options.threads > 0)
+      ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_nbWorkers, options.threads);
+  }
+  ~ZstdWriter() { ZSTD_freeCCtx(m_cctx); }
+  ZstdWriter(const ZstdWriter &) = delete;
+  ZstdWriter &operator=(const ZstdWriter &) = delete;
+
+  // whether the compression context could be set up
+  inline bool valid() const { return m_valid; }
+  inline bool write(const char *data, const size_t size) {
+    return compress(data, size, ZSTD_e_continue);
+  }
+  inline bool finish() { return compress(nullptr, 0, ZSTD_e_end); }
+
+private:
+  bool compress(const char *data, const size_t size,
+                const ZSTD_EndDirective mode) {
+    ZSTD_inBuffer in{data, size, 0};
+    while (true) {
+      ZSTD_outBuffer out{m_out.data(), m_out.size(), 0};
+      const size_t remaining = ZSTD_compressStream2(m_cctx, &out, &in, mode);
+      if (ZSTD_isError(remaining))
+        return false;
+      if (!write_all(m_fd, m_out.data(), out.pos))
+        return false;
+      if (mode == ZSTD_e_end ? remaining == 0 : in.pos == in.size)
+        return true;
+    }
+  }
+
+  const int m_fd;
+  ZSTD_CCtx *m_cctx;
+  std::vector<char> m_out;
+  bool m_valid;
+};
+
+// Writes a GNU tar stream, file contents are streamed through a fixed buffer
+class TarWriter {
+public:
+  explicit TarWriter(ZstdWriter &sink) : m_sink(sink), m_written(0) {
+    m_buffer.reserve(io_buffer_size + tar_block_size);
+  }
+
+  /**
+   * Appends an entry to the archive.
+   * @param name name of the entry in the archive
+   * @param entry metadata of the entry
+   * @param link target of a symlink, or the name of the previous hard link
+   * @param source path of the file to read the contents of regular files from
+   */
+  bool add(const std::string &name, const ManifestEntry &entry,
+           const int64_t mtime, const std::string &link, const bool hardlink,
+           const std::string &source) {
+    TarHeader header{};
+    char type = '0';
+    uint64_t size = 0;
+    if (hardlink) {
+      type = '1';
+    } else if (S_ISREG(entry.mode)) {
+      size = entry.size;
+    } else if (S_ISLNK(entry.mode)) {
+      type = '2';
+    } else if (S_ISDIR(entry.mode)) {
+      type = '5';
+    } else if (S_ISCHR(entry.mode)) {
+      type = '3';
+    } else if (S_ISBLK(entry.mode)) {
+      type = '4';
+    } else if (S_ISFIFO(entry.mode)) {
+      type = '6';
+    } else {
+      // sockets can not be archived
+      return true;
+    }
+    if (name.size() > sizeof(header.name) && !add_long_name('L', name))
+      return false;
+    if (link.size() > sizeof(header.linkname) && !add_long_name('K', link))
+      return false;
+
+    put_string(header.name, name);
+    put_number(header.mode, entry.mode & 07777);
+    put_number(header.uid, entry.uid);
+    put_number(header.gid, entry.gid);
+    put_number(header.size, size);
+    put_number(header.mtime, mtime);
+    header.typeflag = type;
+    put_string(header.linkname, link);
+    put_string(header.uname, user_name(entry.uid));
+    put_string(header.gname, group_name(entry.gid));
+    if (type == '3' || type == '4') {
+      put_number(header.devmajor, major(entry.rdev));
+      put_number(header.devminor, minor(entry.rdev));
+    }
+    if (!append_header(header))
+      return false;
+    if (type == '0' && size > 0)
+      return append_file(source, size);
+    return true;
+  }
+
+  bool finish() {
+    // two zero blocks mark the end of the archive
+    const uint64_t end = m_written + m_buffer.size() + 2 * tar_block_size;
+    const uint64_t padded =
+        (end + tar_record_size - 1) / tar_record_size * tar_record_size;
+    m_buffer.resize(m_buffer.size() + (padded - m_written - m_buffer.size()));
+    return flush();
+  }
+
+private:
+  bool flush() {
+    if (!m_sink.write(m_buffer.data(), m_buffer.size()))
+      return false;
+    m_written += m_buffer.size();
+    m_buffer.clear();
+    return true;
+  }
+
+  bool append(const char *data, const size_t size) {
+    m_buffer.insert(m_buffer.end(), data, data + size);
+    return m_buffer.size() < io_buffer_size || flush();
+  }
+
+  bool append_header(TarHeader &header) {
+    memcpy(header.magic, "ustar ", sizeof(header.magic));
+    memcpy(header.version, " ", sizeof(header.version));
+    memset(header.chksum, ' ', sizeof(header.chksum));
+    const auto *raw = reinterpret_cast<const unsigned char *>(&header);
+    unsigned int checksum = 0;
+    for (size_t i = 0; i < sizeof(header); i++)
+      checksum += raw[i];
+    snprintf(header.chksum, sizeof(header.chksum), "%06o", checksum);
+    header.chksum[7] = ' ';
+    return append(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+
+  bool pad_block() {
+    const size_t remainder = m_buffer.size() % tar_block_size;
+    if (remainder != 0)
+      m_buffer.resize(m_buffer.size() + tar_block_size - remainder);
+    return true;
+  }
+
+  // GNU extension for names longer than 100 bytes
+  bool add_long_name(const char type, const std::string &name) {
+    TarHeader header{};
+    put_string(header.name, std::string{"././@LongLink"});
+    put_number(header.mode, 0644);
+    put_number(header.uid, 0);
+    put_number(header.gid, 0);
+    put_number(header.size, name.size() + 1);
+    put_number(header.mtime, 0);
+    header.typeflag = type;
+    put_string(header.uname, std::string{"root"});
+    put_string(header.gname, std::string{"root"});
+    if (!append_header(header))
+      return false;
+    // the buffer is block aligned after a flush, so this stays aligned
+    m_buffer.insert(m_buffer.end(), name.c_str(), name.c_str() + name.size() + 1);
+    pad_block();
+    return m_buffer.size() < io_buffer_size || flush();
+  }
+
+  bool append_file(const std::string &path, const uint64_t size) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      perror("open");
+      return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    uint64_t remaining = size;
+    while (remaining > 0) {
+      const size_t offset = m_buffer.size();
+      const size_t chunk = std::min<uint64_t>(
+          remaining, io_buffer_size + tar_block_size - offset);
+      m_buffer.resize(offset + chunk);
+      const ssize_t bytes = read(fd, m_buffer.data() + offset, chunk);
+      if (bytes < 0 && errno == EINTR) {
+        m_buffer.resize(offset);
+        continue;
+      }
+      if (bytes <= 0) {
+        // the file has been truncated while archiving it
+        perror("read");
+        close(fd);
+        return false;
+      }
+      m_buffer.resize(offset + bytes);
+      remaining -= bytes;
+      if (m_buffer.size() >= io_buffer_size && !flush()) {
+        close(fd);
+        return false;
+      }
+    }
+    close(fd);
+    pad_block();
+    return m_buffer.size() < io_buffer_size || flush();
+  }
+
+  const std::string &user_name(const uid_t uid) {
+    const auto search = m_users.find(uid);
+    if (search != m_users.end())
+      return search->second;
+    char buffer[4096];
+    struct passwd pwd {};
+    struct passwd *result = nullptr;
+    std::string name{};
+    if (getpwuid_r(uid, &pwd, buffer, sizeof(buffer), &result) == 0 && result)
+      name = pwd.pw_name;
+    return m_users.emplace(uid, std::move(name)).first->second;
+  }
+
+  const std::string &group_name(const gid_t gid) {
+    const auto search = m_groups.find(gid);
+    if (search != m_groups.end())
+      return search->second;
+    char buffer[4096];
+    struct group grp {};
+    struct group *result = nullptr;
+    std::string name{};
+    if (getgrgid_r(gid, &grp, buffer, sizeof(buffer), &result) == 0 && result)
+      name = grp.gr_name;
+    return m_groups.emplace(gid, std::move(name)).first->second;
+  }
+
+  ZstdWriter &m_sink;
+  std::vector<char> m_buffer;
+  uint64_t m_written;
+  std::unordered_map<uid_t, std::string> m_users;
+  std::unordered_map<gid_t, std::string> m_groups;
+};
+
+struct InodeKey {
+  dev_t dev;
+  ino_t ino;
+  bool operator==(const InodeKey &other) const {
+    return dev == other.dev && ino == other.ino;
+  }
+};
+
+struct InodeKeyHash {
+  size_t operator()(const InodeKey &key) const {
+    return std::hash<uint64_t>{}(key.ino) ^
+           (std::hash<uint64_t>{}(key.dev) << 1);
+  }
+};
+
+class DebWriter {
+public:
+  DebWriter(const std::string &pkgdir, const int fd,
+            const DebBuildOptions &options)
+      : m_pkgdir(pkgdir), m_fd(fd), m_options(options),
+        m_epoch(get_source_date_epoch()) {}
+
+  bool write(const Manifest &manifest, const ManifestEntry &root,
+             const ManifestEntry &control) {
+    const int64_t ar_mtime = m_epoch >= 0 ? m_epoch : time(nullptr);
+    if (!write_all(m_fd, ar_magic, sizeof(ar_magic) - 1) ||
+        !write_ar_header("debian-binary", ar_mtime,
+                         sizeof(deb_version) - 1) ||
+        !write_all(m_fd, deb_version, sizeof(deb_version) - 1))
+      return false;
+    return write_tar_member("control.tar.zst", ar_mtime, manifest, control,
+                            true) &&
+           write_tar_member("data.tar.zst", ar_mtime, manifest, root, false);
+  }
+
+private:
+  static int64_t get_source_date_epoch() {
+    const char *epoch = getenv("SOURCE_DATE_EPOCH");
+    if (!epoch || !*epoch)
+      return -1;
+    char *end = nullptr;
+    const long long value = strtoll(epoch, &end, 10);
+    if (*end != '\0' || value < 0)
+      return -1;
+    return value;
+  }
+
+  inline int64_t clamp_mtime(const int64_t mtime) const {
+    return (m_epoch >= 0 && mtime > m_epoch) ? m_epoch : mtime;
+  }
+
+  bool write_ar_header(const char *name, const int64_t mtime,
+                       const uint64_t size) {
+    char header[61];
+    snprintf(header, sizeof(header), "%-16s%-12lld%-6d%-6d%-8o%-10llu`\n",
+             name, static_cast<long long>(mtime), 0, 0, 0100644,
+             static_cast<unsigned long long>(size));
+    return write_all(m_fd, header, sizeof(header) - 1);
+  }
+
+  // the member size is only known after compressing the member, so the
+  // header is written afterwards
+  bool write_tar_member(const char *name, const int64_t ar_mtime,
+                        const Manifest &manifest, const ManifestEntry &root,
+                        const bool control) {
+    const off_t header_offset = lseek(m_fd, 0, SEEK_CUR);
+    if (header_offset < 0 || lseek(m_fd, 60, SEEK_CUR) < 0)
+      return false;
+    ZstdWriter compressor{m_fd, m_options};
+    if (!compressor.valid()) {
+      get_logger()->error(
+          fmt::format("Unable to set up the zstd compressor for {0}", name));
+      return false;
+    }
+    TarWriter tar{compressor};
+    if (!write_tree(tar, manifest, root, control) || !tar.finish() ||
+        !compressor.finish())
+      return false;
+    const off_t end_offset = lseek(m_fd, 0, SEEK_CUR);
+    if (end_offset < 0)
+      return false;
+    const uint64_t size = end_offset - header_offset - 60;
+    if (lseek(m_fd, header_offset, SEEK_SET) < 0 ||
+        !write_ar_header(name, ar_mtime, size) ||
+        lseek(m_fd, end_offset, SEEK_SET) < 0)
+      return false;
+    // ar members are aligned to 2 bytes
+    return (size % 2 == 0) || write_all(m_fd, "\n", 1);
+  }
+
+  bool write_tree(TarWriter &tar, const Manifest &manifest,
+                  const ManifestEntry &root, const bool control) {
+    if (!tar.add("./", root, clamp_mtime(root.mtime), {}, false, {}))
+      return false;
+    std::unordered_map<InodeKey, std::string, InodeKeyHash> hardlinks{};
+    // like dpkg-deb, symlinks are archived after everything else, so that
+    // their targets are already unpacked when they are created
+    std::vector<const ManifestEntry *> symlinks{};
+    for (const auto &entry : manifest.entries) {
+      const auto &path = entry.path;
+      const bool in_control_dir =
+          path.compare(0, control_dir_len, control_dir) == 0 &&
+          (path.size() == control_dir_len || path[control_dir_len] == '/');
+      if (in_control_dir != control || path.size() == control_dir_len)
+        continue;
+      if (S_ISLNK(entry.mode)) {
+        symlinks.push_back(&entry);
+        continue;
+      }
+      const std::string name = archive_name(entry, control);
+      std::string link{};
+      bool hardlink = false;
+      if (entry.nlink > 1 && !S_ISDIR(entry.mode)) {
+        const auto inserted =
+            hardlinks.emplace(InodeKey{entry.dev, entry.ino}, name);
+        if (!inserted.second) {
+          link = inserted.first->second;
+          hardlink = true;
+        }
+      }
+      if (!tar.add(name, entry, clamp_mtime(entry.mtime), link, hardlink,
+                   m_pkgdir + entry.path))
+        return false;
+    }
+    for (const auto *entry : symlinks) {
+      if (!tar.add(archive_name(*entry, control), *entry,
+                   clamp_mtime(entry->mtime), entry->link_target, false, {}))
+        return false;
+    }
+    return true;
+  }
+
+  static std::string archive_name(const ManifestEntry &entry,
+                                  const bool control) {
+    std::string name{"."};
+    name += control ? entry.path.substr(control_dir_len) : entry.path;
+    if (S_ISDIR(entry.mode))
+      name += '/';
+    return name;
+  }
+
+  const std::string &m_pkgdir;
+  const int m_fd;
+  const DebBuildOptions &m_options;
+  const int64_t m_epoch;
+};
+
+bool stat_entry(const std::string &path, ManifestEntry &entry) {
+  struct stat st {};
+  if (lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    return false;
+  entry.mode = st.st_mode;
+  entry.uid = st.st_uid;
+  entry.gid = st.st_gid;
+  entry.mtime = st.st_mtime;
+  entry.nlink = st.st_nlink;
+  return true;
+}
+
+// The sanity checks dpkg-deb -b does before building a package, so that
+// the native writer does not accept a package which dpkg-deb rejects.
+
+constexpr const char *maintainer_scripts[] = {"preinst", "postinst", "prerm",
+                                             "postrm", "config"};
+
+bool deb_error(const std::string &message) {
+  get_logger()->error(message);
+  return false;
+}
+
+inline bool is_digit(const char c) { return c >= '0' && c <= '9'; }
+
+inline bool is_alnum(const char c) {
+  return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Returns why a version is invalid, like dpkg's parseversion()
+const char *version_error(std::string version) {
+  const size_t first = version.find_first_not_of(" \t");
+  if (first == std::string::npos)
+    return "version string is empty";
+  version = version.substr(first, version.find_last_not_of(" \t") + 1 - first);
+  if (version.find_first_of(" \t") != std::string::npos)
+    return "version string has embedded spaces";
+  size_t start = 0;
+  const size_t colon = version.find(':');
+  if (colon != std::string::npos) {
+    if (colon == 0 || !is_digit(version[0]))
+      return "epoch in version is empty";
+    for (size_t i = 0; i < colon; i++) {
+      if (!is_digit(version[i]))
+        return "epoch in version is not number";
+    }
+    if (colon > 10 || std::stoull(version.substr(0, colon)) > INT_MAX)
+      return "epoch in version is too big";
+    start = colon + 1;
+    if (start == version.size())
+      return "nothing after colon in version number";
+  }
+  size_t end = version.size();
+  const size_t hyphen = version.rfind('-');
+  if (hyphen != std::string::npos && hyphen >= start) {
+    if (hyphen + 1 == version.size())
+      return "revision number is empty";
+    end = hyphen;
+  }
+  if (start == end)
+    return "version number is empty";
+  if (!is_digit(version[start]))
+    return "version number does not start with digit";
+  for (size_t i = start; i < end; i++) {
+    if (!is_alnum(version[i]) && !strchr(".-+~:", version[i]))
+      return "invalid character in version number";
+  }
+  for (size_t i = end + 1; i < version.size(); i++) {
+    if (!is_alnum(version[i]) && !strchr(".+~", version[i]))
+      return "invalid character in revision number";
+  }
+  return nullptr;
+}
+
+// Parses DEBIAN/control, which must hold a single paragraph
+bool check_control_file(const std::string &path) {
+  std::ifstream file(path);
+  if (!file)
+    return deb_error(fmt::format("Unable to read {0}", path));
+  std::unordered_map<std::string, std::string> fields{};
+  std::string line{};
+  std::string last_field{};
+  bool ended = false;
+  while (std::getline(file, line)) {
+    if (line.find_first_not_of(" \t") == std::string::npos) {
+      // blank lines end the paragraph
+      ended = !fields.empty();
+      continue;
+    }
+    if (ended)
+      return deb_error(fmt::format(
+          "{0}: several package info entries found, only one allowed", path));
+    if (line[0] == ' ' || line[0] == '\t') {
+      if (last_field.empty())
+        return deb_error(fmt::format(
+            "{0}: continuation line without a field", path));
+      continue;
+    }
+    const size_t colon = line.find(':');
+    if (colon == 0 || colon == std::string::npos)
+      return deb_error(fmt::format(
+          "{0}: field name '{1}' must be followed by colon", path, line));
+    last_field = line.substr(0, colon);
+    const size_t value = line.find_first_not_of(" \t", colon + 1);
+    if (!fields
+             .emplace(last_field,
+                      value == std::string::npos ? "" : line.substr(value))
+             .second)
+      return deb_error(fmt::format("{0}: duplicate value for '{1}' field",
+                                   path, last_field));
+  }
+
+  const auto package = fields.find("Package");
+  if (package == fields.end() || package->second.empty())
+    return deb_error(fmt::format("{0}: missing 'Package' field", path));
+  const std::string &name = package->second;
+  if (!is_alnum(name[0]))
+    return deb_error(fmt::format(
+        "{0}: invalid package name in 'Package' field: must start with an "
+        "alphanumeric character",
+        path));
+  for (const char c : name) {
+    if (!is_alnum(c) && !strchr("-+.", c))
+      return deb_error(fmt::format(
+          "{0}: package name has characters that aren't lowercase alphanums "
+          "or '-+.'",
+          path));
+  }
+  const auto version = fields.find("Version");
+  if (version == fields.end())
+    return deb_error(fmt::format("{0}: missing 'Version' field", path));
+  const char *error = version_error(version->second);
+  if (error)
+    return deb_error(fmt::format("{0}: 'Version' field value '{1}': {2}", path,
+                                 version->second, error));
+  const auto arch = fields.find("Architecture");
+  if (arch == fields.end() || arch->second.empty())
+    return deb_error(
+        fmt::format("{0}: package architecture is missing or empty", path));
+  for (const char *field : {"Maintainer", "Description"}) {
+    if (fields.find(field) == fields.end())
+      get_logger()->warning(
+          fmt::format("{0}: missing '{1}' field", path, field));
+  }
+  return true;
+}
+
+bool check_maintainer_scripts(const std::string &control_dir) {
+  for (const char *script : maintainer_scripts) {
+    const std::string path = control_dir + "/" + script;
+    struct stat st {};
+    if (stat(path.c_str(), &st) != 0) {
+      if (errno == ENOENT)
+        continue;
+      return deb_error(
+          fmt::format("Unable to stat {0}: {1}", path, strerror(errno)));
+    }
+    if (!S_ISREG(st.st_mode))
+      return deb_error(fmt::format(
+          "maintainer script '{0}' is not a plain file or symlink", script));
+    // the owner and the group may write to it, nobody else
+    if ((st.st_mode & 07557) != 0555)
+      return deb_error(
+          fmt::format("maintainer script '{0}' has bad permissions {1:03o} "
+                      "(must be >=0555 and <=0775)",
+                      script, st.st_mode & 07777));
+  }
+  return true;
+}
+
+// The listed conffiles must be in the package, unless they are to be removed
+bool check_conffiles(const std::string &pkgdir) {
+  const std::string path = pkgdir + control_dir + "/conffiles";
+  if (access(path.c_str(), F_OK) != 0)
+    return true;
+  std::ifstream file(path);
+  if (!file)
+    return deb_error(fmt::format("Unable to read {0}", path));
+  std::stringstream buffer{};
+  buffer << file.rdbuf();
+  const std::string contents = buffer.str();
+  if (!contents.empty() && contents.back() != '\n')
+    return deb_error(fmt::format(
+        "conffile name '{0}' is too long, or missing final newline",
+        contents.substr(contents.rfind('\n') + 1)));
+  std::istringstream lines{contents};
+  std::string line{};
+  while (std::getline(lines, line)) {
+    std::string name = line;
+    bool remove = false;
+    if (!line.empty() && line[0] != '/') {
+      const size_t space = line.find(' ');
+      const std::string flag = line.substr(0, space);
+      if (space != std::string::npos && flag != "remove-on-upgrade")
+        return deb_error(fmt::format(
+            "unknown flag '{0}' for conffile '{1}'", flag,
+            line.substr(space + 1)));
+      remove = space != std::string::npos;
+      name = remove ? line.substr(space + 1) : line;
+    }
+    if (name.empty() || name[0] != '/')
+      return deb_error(fmt::format(
+          "conffile name '{0}' is not an absolute pathname", name));
+    struct stat st {};
+    const bool present = lstat((pkgdir + name).c_str(), &st) == 0;
+    if (remove && present)
+      return deb_error(fmt::format(
+          "conffile '{0}' is present but is requested to be removed", name));
+    if (!remove && !present)
+      return deb_error(
+          fmt::format("conffile '{0}' does not appear in package", name));
+  }
+  return true;
+}
+
+bool check_control_dir(const std::string &pkgdir, const ManifestEntry &dir) {
+  if ((dir.mode & 07757) != 0755)
+    return deb_error(fmt::format("control directory has bad permissions {0:03o} "
+                                 "(must be >=0755 and <=0775)",
+                                 dir.mode & 07777));
+  return check_control_file(pkgdir + control_dir + "/control") &&
+         check_maintainer_scripts(pkgdir + control_dir) &&
+         check_conffiles(pkgdir);
+}
+
+} // namespace
+
+int deb_build(const std::string &pkgdir, const std::string &output,
+              const DebBuildOptions &options) {
+  ManifestEntry root{};
+  ManifestEntry control{};
+  if (!stat_entry(pkgdir, root) || !stat_entry(pkgdir + "/DEBIAN", control))
+    return -1;
+  if (!check_control_dir(pkgdir, control))
+    return -1;
+  Manifest manifest{};
+  if (manifest_scan(pkgdir, manifest) != 0)
+    return -1;
+  const int fd =
+      open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror("open");
+    return -1;
+  }
+  DebWriter writer{pkgdir, fd, options};
+  const bool success = writer.write(manifest, root, control);
+  if (close(fd) != 0 || !success) {
+    unlink(output.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+#else
+
+int deb_build(const std::string &, const std::string &,
+              const DebBuildOptions &) {
+  return AB_DEB_UNSUPPORTED;
+}
+
+#endif // HAS_ZSTD
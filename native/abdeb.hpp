@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+struct DebBuildOptions {
+  // zstd compression level
+  int level;
+  // number of compression threads, 0 to compress on the calling thread
+  unsigned int threads;
+};
+
+// The .deb writer is not available (autobuild is built without libzstd),
+// the caller should use dpkg-deb instead.
+constexpr int AB_DEB_UNSUPPORTED = 127;
+
+/**
+ * Builds a binary package from a directory, like dpkg-deb -Zzstd -b does.
+ * The control files are read from DEBIAN/ and the rest of the tree goes into
+ * data.tar.zst. Entries are sorted by path, and their modification times
+ * are clamped to SOURCE_DATE_EPOCH if it is set.
+ * The control file, the maintainer scripts and the conffiles are checked
+ * like dpkg-deb does first, and the package is not written if they are
+ * invalid. The tarballs have the same contents as the ones of dpkg-deb,
+ * but the zstd streams are not necessarily identical.
+ * @return 0 on success, AB_DEB_UNSUPPORTED, or -1 if an error occurred
+ */
+int deb_build(const std::string &pkgdir, const std::string &output,
+              const DebBuildOptions &options);
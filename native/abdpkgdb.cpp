@@ -0,0 +1,231 @@
+#include "abdpkgdb.hpp"
+#include "ablutindex.hpp"
+#include "stdwrapper.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr std::string_view status_not_installed = "not-installed";
+
+static inline std::string_view trim(std::string_view value) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+    value.remove_prefix(1);
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t' ||
+                            value.back() == '\r'))
+    value.remove_suffix(1);
+  return value;
+}
+
+static inline bool get_field(const std::string_view line,
+                             const std::string_view field,
+                             std::string_view &value) {
+  // field names are case-insensitive, but dpkg always writes them like this
+  if (line.size() <= field.size() || line[field.size()] != ':' ||
+      line.compare(0, field.size(), field) != 0)
+    return false;
+  value = trim(line.substr(field.size() + 1));
+  return true;
+}
+
+std::string dpkg_admin_dir() {
+  const char *admindir = getenv("DPKG_ADMINDIR");
+  if (!admindir || !*admindir)
+    return "/var/lib/dpkg";
+  return admindir;
+}
+
+std::string dpkg_status_path() { return dpkg_admin_dir() + "/status"; }
+
+DpkgStatusIndex::~DpkgStatusIndex() { unmap(); }
+
+void DpkgStatusIndex::unmap() {
+  m_versions.clear();
+  m_qualified_versions.clear();
+  if (m_data)
+    munmap(const_cast<char *>(m_data), m_size);
+  m_data = nullptr;
+  m_size = 0;
+}
+
+bool DpkgStatusIndex::refresh(const std::string &status_path) {
+  struct stat st {};
+  if (stat(status_path.c_str(), &st) != 0)
+    return false;
+  // dpkg replaces the status file with rename(2), so a new inode or mtime
+  // means the database has changed
+  if (m_data && status_path == m_path && st.st_dev == m_dev &&
+      st.st_ino == m_ino && st.st_mtim.tv_sec == m_mtime.tv_sec &&
+      st.st_mtim.tv_nsec == m_mtime.tv_nsec &&
+      static_cast<size_t>(st.st_size) == m_size)
+    return true;
+
+  unmap();
+  const int fd = open(status_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  m_path = status_path;
+  m_dev = st.st_dev;
+  m_ino = st.st_ino;
+  m_mtime = st.st_mtim;
+  if (st.st_size == 0) {
+    // an empty database, nothing is installed
+    close(fd);
+    return true;
+  }
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+  m_data = static_cast<const char *>(addr);
+  m_size = st.st_size;
+  madvise(addr, m_size, MADV_SEQUENTIAL);
+  parse();
+  return true;
+}
+
+void DpkgStatusIndex::parse() {
+  const std::string_view data{m_data, m_size};
+  std::string_view package{};
+  std::string_view version{};
+  std::string_view architecture{};
+  std::string_view status{};
+  const auto add_stanza = [&]() {
+    const bool installed =
+        status.size() < status_not_installed.size() ||
+        status.substr(status.size() - status_not_installed.size()) !=
+            status_not_installed;
+    if (!package.empty() && !version.empty() && installed) {
+      m_versions.emplace(package, version);
+      if (!architecture.empty()) {
+        std::string qualified{package};
+        qualified += ':';
+        qualified += architecture;
+        m_qualified_versions.emplace(std::move(qualified), version);
+      }
+    }
+    package = version = architecture = status = {};
+  };
+
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t end = data.find('\n', pos);
+    if (end == std::string_view::npos)
+      end = data.size();
+    const std::string_view line = data.substr(pos, end - pos);
+    pos = end + 1;
+    if (trim(line).empty()) {
+      add_stanza();
+      continue;
+    }
+    // continuation lines of multi-line fields
+    if (line.front() == ' ' || line.front() == '\t')
+      continue;
+    std::string_view value{};
+    if (get_field(line, "Package", value))
+      package = value;
+    else if (get_field(line, "Version", value))
+      version = value;
+    else if (get_field(line, "Architecture", value))
+      architecture = value;
+    else if (get_field(line, "Status", value))
+      status = value;
+  }
+  add_stanza();
+}
+
+std::string_view DpkgStatusIndex::get_version(std::string_view name) const {
+  const auto search = m_versions.find(name);
+  if (search != m_versions.end())
+    return search->second;
+  if (name.find(':') == std::string_view::npos)
+    return {};
+  const auto qualified = m_qualified_versions.find(std::string{name});
+  if (qualified != m_qualified_versions.end())
+    return qualified->second;
+  return {};
+}
+
+static inline std::string_view file_key(const std::string_view path) {
+  if (!path.empty() && path.front() == '/')
+    return path;
+  const size_t slash = path.rfind('/');
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+// Reads every <package>[:<arch>].list in the info directory, and maps both
+// the paths and the file names to the packages.
+static bool read_file_lists(const std::string &info_dir, LutTable &table) {
+  DIR *dir = opendir(info_dir.c_str());
+  if (!dir)
+    return false;
+  constexpr std::string_view list_suffix = ".list";
+  std::string line{};
+  while (const auto *entry = readdir(dir)) {
+    const std::string_view filename{entry->d_name};
+    if (filename.size() <= list_suffix.size() ||
+        filename.substr(filename.size() - list_suffix.size()) != list_suffix)
+      continue;
+    std::string_view package =
+        filename.substr(0, filename.size() - list_suffix.size());
+    package = package.substr(0, package.find(':'));
+    std::ifstream list_file{info_dir + "/" + std::string{filename}};
+    while (std::getline(list_file, line)) {
+      if (line.empty() || line == "/.")
+        continue;
+      table[line].emplace(package);
+      const std::string_view path{line};
+      const auto name = path.substr(path.rfind('/') + 1);
+      if (!name.empty())
+        table[std::string{name}].emplace(package);
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+int dpkg_find_file_owners(const std::string &cache_path,
+                          const std::vector<std::string> &files,
+                          std::set<std::string> &packages) {
+  const std::string info_dir = dpkg_admin_dir() + "/info";
+  LutIndex index{};
+  if (cache_path.empty() ||
+      !index.open(cache_path.c_str(), info_dir.c_str())) {
+    // take the status before reading the lists, so that any change made
+    // while reading them invalidates the new index
+    struct stat info_st {};
+    LutTable table{};
+    if (stat(info_dir.c_str(), &info_st) != 0 ||
+        !read_file_lists(info_dir, table))
+      return -1;
+    std::error_code ec{};
+    if (!cache_path.empty())
+      fs::create_directories(fs::path{cache_path}.parent_path(), ec);
+    if (cache_path.empty() ||
+        !lut_index_write(cache_path.c_str(), table, info_st) ||
+        !index.open(cache_path.c_str(), info_dir.c_str())) {
+      // no cache or the cache is not writable, use the table directly
+      for (const auto &file : files) {
+        const auto search = table.find(std::string{file_key(file)});
+        if (search != table.end())
+          packages.insert(search->second.begin(), search->second.end());
+      }
+      return 0;
+    }
+  }
+  for (const auto &file : files) {
+    index.lookup(file_key(file), [&](const std::string_view package) {
+      packages.emplace(package);
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+#include <set>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * An index of the installed package versions in the dpkg status database.
+ * The status file is memory-mapped and parsed once, and only parsed again
+ * after dpkg has modified it.
+ */
+class DpkgStatusIndex {
+public:
+  DpkgStatusIndex() = default;
+  ~DpkgStatusIndex();
+  DpkgStatusIndex(const DpkgStatusIndex &) = delete;
+  DpkgStatusIndex &operator=(const DpkgStatusIndex &) = delete;
+
+  /**
+   * Loads the status file, unless the index is already up to date.
+   * @return false if the status file could not be read
+   */
+  bool refresh(const std::string &status_path);
+
+  /**
+   * Returns the installed version of a package (or "package:arch"),
+   * or an empty string if the package is not installed.
+   * If several architectures of a package are installed, the first one
+   * in the status file is returned.
+   */
+  std::string_view get_version(std::string_view name) const;
+
+private:
+  void parse();
+  void unmap();
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  std::string m_path{};
+  dev_t m_dev = 0;
+  ino_t m_ino = 0;
+  struct timespec m_mtime {};
+  std::unordered_map<std::string_view, std::string_view> m_versions{};
+  // storage for the "package:arch" keys, which do not exist in the file
+  std::unordered_map<std::string, std::string_view> m_qualified_versions{};
+};
+
+/**
+ * Returns the dpkg database directory, honouring $DPKG_ADMINDIR like dpkg
+ * does.
+ */
+std::string dpkg_admin_dir();
+
+/**
+ * Returns the path of the dpkg status file.
+ */
+std::string dpkg_status_path();
+
+/**
+ * Finds the packages which own the given files, like dpkg -S does.
+ * Absolute paths are matched exactly, other names are matched against the
+ * file names (e.g. a soname matches the library in any directory).
+ * The file lists of the installed packages are indexed in cache_path (if
+ * it is not empty), the index is rebuilt when the modification time of the
+ * info directory changes.
+ * @param packages the names of the packages (without the architecture)
+ * @return 0 on success, -1 if the dpkg database could not be read
+ */
+int dpkg_find_file_owners(const std::string &cache_path,
+                          const std::vector<std::string> &files,
+                          std::set<std::string> &packages);
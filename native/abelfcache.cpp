@@ -0,0 +1,256 @@
+#include "abelfcache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_set>
+
+constexpr char elf_cache_magic[8] = {'A', 'B', 'E', 'L', 'F', 'C', 'A', 'C'};
+constexpr uint32_t elf_cache_version = 1;
+constexpr size_t elf_cache_header_size = 24;
+constexpr size_t elf_cache_record_size = 80;
+constexpr size_t elf_cache_needed_size = 8;
+
+// Record layout (little endian):
+//  0 dev, 8 ino, 16 size, 24 mtime_ns (u64)
+// 32 flags, 36 status (u32)
+// 40 path, 48 build id, 56 soname (u32 offset and u32 length in the pool)
+// 64 first needed library, 68 number of needed libraries (u32)
+// 72 binary type, 73 architecture, 74 debug info present (u8)
+
+static inline uint32_t read_u32(const char *ptr) {
+  uint32_t value = 0;
+  memcpy(&value, ptr, sizeof(value));
+  return le32toh(value);
+}
+
+static inline uint64_t read_u64(const char *ptr) {
+  uint64_t value = 0;
+  memcpy(&value, ptr, sizeof(value));
+  return le64toh(value);
+}
+
+static inline void append_u32(std::vector<char> &buffer, const uint32_t value) {
+  const uint32_t le_value = htole32(value);
+  const char *ptr = reinterpret_cast<const char *>(&le_value);
+  buffer.insert(buffer.end(), ptr, ptr + sizeof(le_value));
+}
+
+static inline void append_u64(std::vector<char> &buffer, const uint64_t value) {
+  const uint64_t le_value = htole64(value);
+  const char *ptr = reinterpret_cast<const char *>(&le_value);
+  buffer.insert(buffer.end(), ptr, ptr + sizeof(le_value));
+}
+
+static inline auto key_tuple(const ElfCacheKey &key) {
+  return std::make_tuple(key.dev, key.ino, key.size, key.mtime_ns);
+}
+
+static inline ElfCacheKey read_key(const char *record) {
+  return {read_u64(record), read_u64(record + 8), read_u64(record + 16),
+          read_u64(record + 24)};
+}
+
+ElfCacheKey elf_cache_key(const struct stat &st) {
+  return {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+          static_cast<uint64_t>(st.st_size),
+          static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000 +
+              static_cast<uint64_t>(st.st_mtim.tv_nsec)};
+}
+
+ElfCache::~ElfCache() {
+  if (m_data)
+    munmap(const_cast<char *>(m_data), m_size);
+}
+
+bool ElfCache::open(const char *cache_path) {
+  const int fd = ::open(cache_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st {};
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < elf_cache_header_size) {
+    close(fd);
+    return false;
+  }
+  const size_t size = st.st_size;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+  const char *data = static_cast<const char *>(addr);
+
+  const uint32_t record_count = read_u32(data + 12);
+  const uint32_t needed_count = read_u32(data + 16);
+  const uint32_t pool_size = read_u32(data + 20);
+  const uint64_t expected_size =
+      elf_cache_header_size +
+      static_cast<uint64_t>(record_count) * elf_cache_record_size +
+      static_cast<uint64_t>(needed_count) * elf_cache_needed_size + pool_size;
+  if (memcmp(data, elf_cache_magic, sizeof(elf_cache_magic)) != 0 ||
+      read_u32(data + 8) != elf_cache_version || expected_size != size) {
+    munmap(addr, size);
+    return false;
+  }
+
+  m_data = data;
+  m_size = size;
+  m_record_count = record_count;
+  m_needed_count = needed_count;
+  m_pool_size = pool_size;
+  m_records = data + elf_cache_header_size;
+  m_needed = m_records + record_count * elf_cache_record_size;
+  m_pool = m_needed + needed_count * elf_cache_needed_size;
+  return true;
+}
+
+const char *ElfCache::record_at(const size_t index) const {
+  return m_records + index * elf_cache_record_size;
+}
+
+bool ElfCache::get_string(const uint32_t offset, const uint32_t length,
+                          std::string &str) const {
+  if (offset > m_pool_size || length > m_pool_size - offset)
+    return false;
+  str.assign(m_pool + offset, length);
+  return true;
+}
+
+bool ElfCache::decode(const char *record, ElfCacheEntry &entry) const {
+  entry.key = read_key(record);
+  entry.flags = static_cast<int>(read_u32(record + 32));
+  entry.status = static_cast<int>(read_u32(record + 36));
+  if (!get_string(read_u32(record + 40), read_u32(record + 44), entry.path) ||
+      !get_string(read_u32(record + 48), read_u32(record + 52),
+                  entry.build_id) ||
+      !get_string(read_u32(record + 56), read_u32(record + 60), entry.soname))
+    return false;
+  const uint32_t first = read_u32(record + 64);
+  const uint32_t count = read_u32(record + 68);
+  if (first > m_needed_count || count > m_needed_count - first)
+    return false;
+  entry.needed_libs.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    const char *needed = m_needed + (first + i) * elf_cache_needed_size;
+    if (!get_string(read_u32(needed), read_u32(needed + 4),
+                    entry.needed_libs[i]))
+      return false;
+  }
+  entry.bin_type = static_cast<BinaryType>(record[72]);
+  entry.arch = static_cast<AOSCArch>(record[73]);
+  entry.has_debug_info = record[74] != 0;
+  return true;
+}
+
+bool ElfCache::lookup(const ElfCacheKey &key, const std::string &path,
+                      const int flags, ElfCacheEntry &entry) const {
+  if (!m_data)
+    return false;
+  size_t low = 0;
+  size_t high = m_record_count;
+  const auto wanted = key_tuple(key);
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    const auto candidate = key_tuple(read_key(record_at(mid)));
+    if (candidate < wanted) {
+      low = mid + 1;
+    } else if (wanted < candidate) {
+      high = mid;
+    } else {
+      const char *record = record_at(mid);
+      return static_cast<int>(read_u32(record + 32)) == flags &&
+             decode(record, entry) && entry.path == path;
+    }
+  }
+  return false;
+}
+
+void ElfCache::record(ElfCacheEntry entry) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_recorded.emplace_back(std::move(entry));
+}
+
+bool ElfCache::write(const char *cache_path) const {
+  std::vector<ElfCacheEntry> entries{};
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    entries = m_recorded;
+  }
+  // keep the entries of the files which were not seen this time (e.g. they
+  // belong to another package built from the same tree)
+  std::unordered_set<std::string> recorded_paths{};
+  for (const auto &entry : entries)
+    recorded_paths.insert(entry.path);
+  for (size_t i = 0; i < m_record_count; i++) {
+    ElfCacheEntry entry{};
+    if (decode(record_at(i), entry) && recorded_paths.count(entry.path) == 0)
+      entries.emplace_back(std::move(entry));
+  }
+  std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+    return key_tuple(a.key) < key_tuple(b.key);
+  });
+
+  std::vector<char> records{};
+  std::vector<char> needed{};
+  std::vector<char> pool{};
+  uint32_t needed_count = 0;
+  const auto add_string = [&pool](const std::string &str,
+                                  std::vector<char> &out) {
+    append_u32(out, pool.size());
+    append_u32(out, str.size());
+    pool.insert(pool.end(), str.begin(), str.end());
+  };
+  records.reserve(entries.size() * elf_cache_record_size);
+  for (const auto &entry : entries) {
+    append_u64(records, entry.key.dev);
+    append_u64(records, entry.key.ino);
+    append_u64(records, entry.key.size);
+    append_u64(records, entry.key.mtime_ns);
+    append_u32(records, static_cast<uint32_t>(entry.flags));
+    append_u32(records, static_cast<uint32_t>(entry.status));
+    add_string(entry.path, records);
+    add_string(entry.build_id, records);
+    add_string(entry.soname, records);
+    append_u32(records, needed_count);
+    append_u32(records, entry.needed_libs.size());
+    for (const auto &lib : entry.needed_libs)
+      add_string(lib, needed);
+    needed_count += entry.needed_libs.size();
+    const char tail[8] = {static_cast<char>(entry.bin_type),
+                          static_cast<char>(entry.arch),
+                          static_cast<char>(entry.has_debug_info)};
+    records.insert(records.end(), tail, tail + sizeof(tail));
+  }
+
+  std::vector<char> header(elf_cache_magic,
+                           elf_cache_magic + sizeof(elf_cache_magic));
+  append_u32(header, elf_cache_version);
+  append_u32(header, entries.size());
+  append_u32(header, needed_count);
+  append_u32(header, pool.size());
+
+  const std::string temp_path = std::string{cache_path} + ".tmp";
+  const int fd = ::open(temp_path.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  bool success = true;
+  for (const auto *part : {&header, &records, &needed, &pool}) {
+    if (!part->empty() &&
+        ::write(fd, part->data(), part->size()) !=
+            static_cast<ssize_t>(part->size())) {
+      success = false;
+      break;
+    }
+  }
+  if (close(fd) != 0 || !success ||
+      rename(temp_path.c_str(), cache_path) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
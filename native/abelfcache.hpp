@@ -0,0 +1,95 @@
+#pragma once
+
+#include "abnativeelf.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// Identifies the contents of a file without reading it
+struct ElfCacheKey {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  uint64_t mtime_ns;
+};
+
+ElfCacheKey elf_cache_key(const struct stat &st);
+
+// What elf_copy_debug_symbols found out about a file, and how it ended
+struct ElfCacheEntry {
+  ElfCacheKey key;
+  std::string path;
+  // the AB_ELF_* flags the file was processed with
+  int flags;
+  // the return value of elf_copy_debug_symbols
+  int status;
+  BinaryType bin_type;
+  AOSCArch arch;
+  bool has_debug_info;
+  std::string build_id;
+  std::string soname;
+  std::vector<std::string> needed_libs;
+};
+
+/**
+ * A memory-mapped cache of the files processed by
+ * elf_copy_debug_symbols_parallel.
+ *
+ * The entries are keyed by the device, inode, size and modification time of
+ * the file after it was processed, so a file which is unchanged since then
+ * does not have to be parsed or stripped again. Lookups are binary searches
+ * on the mapped file, new entries are collected in memory and written out
+ * with write().
+ */
+class ElfCache {
+public:
+  ElfCache() = default;
+  ~ElfCache();
+  ElfCache(const ElfCache &) = delete;
+  ElfCache &operator=(const ElfCache &) = delete;
+
+  /**
+   * Maps the cache file into memory.
+   * @return false if the cache is missing or corrupted, it is then empty
+   */
+  bool open(const char *cache_path);
+
+  /**
+   * Finds the entry of the file at path, processed with the same flags.
+   * May be called from several threads.
+   * @return false if there is none
+   */
+  bool lookup(const ElfCacheKey &key, const std::string &path, int flags,
+              ElfCacheEntry &entry) const;
+
+  // Adds the entry of a processed file, may be called from several threads
+  void record(ElfCacheEntry entry);
+
+  /**
+   * Writes the recorded entries, and the mapped entries of the files which
+   * were not recorded again, to cache_path.
+   * @return false if the file could not be written
+   */
+  bool write(const char *cache_path) const;
+
+private:
+  const char *record_at(size_t index) const;
+  bool decode(const char *record, ElfCacheEntry &entry) const;
+  bool get_string(uint32_t offset, uint32_t length, std::string &str) const;
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  uint32_t m_record_count = 0;
+  uint32_t m_needed_count = 0;
+  uint32_t m_pool_size = 0;
+  const char *m_records = nullptr;
+  const char *m_needed = nullptr;
+  const char *m_pool = nullptr;
+
+  mutable std::mutex m_mutex;
+  std::vector<ElfCacheEntry> m_recorded;
+};
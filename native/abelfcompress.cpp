@@ -0,0 +1,420 @@
+#include "abelfcompress.hpp"
+#include "abcompress.hpp"
+#include "abelfimage.hpp"
+#include "abelflayout.hpp"
+#include "abnativefunctions.h"
+#include "abtrace.hpp"
+#include "stdwrapper.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+// Workaround for older versions of glibc
+#ifndef ELFCOMPRESS_ZSTD
+#define ELFCOMPRESS_ZSTD 2
+#endif // ELFCOMPRESS_ZSTD
+
+namespace {
+
+struct CompressedSection {
+  uint32_t index;
+  // the compression header followed by the compressed contents, empty if
+  // the section is kept as it is
+  std::vector<char> contents;
+};
+
+// A mapped debug symbol file, and its sections to compress
+struct DebugFile {
+  DebugFile(std::string path, const char *data, const size_t size,
+            const mode_t mode, const ElfXX_Ehdr &ehdr)
+      : path(std::move(path)), data(data), size(size), mode(mode), ehdr(ehdr),
+        sections(), remaining(0) {}
+  ~DebugFile() { munmap(const_cast<char *>(data), size); }
+  DebugFile(const DebugFile &) = delete;
+  DebugFile &operator=(const DebugFile &) = delete;
+
+  const std::string path;
+  const char *data;
+  const size_t size;
+  const mode_t mode;
+  const ElfXX_Ehdr ehdr;
+  std::vector<CompressedSection> sections;
+  // the number of sections which are not compressed yet
+  std::atomic<size_t> remaining;
+};
+
+// the index of the file, and of the section in DebugFile::sections
+using DebugTask = std::pair<size_t, size_t>;
+
+const char *compression_name(const DebugCompression compression) {
+  switch (compression) {
+  case DebugCompression::None:
+    return "none";
+  case DebugCompression::Zlib:
+    return "zlib";
+  case DebugCompression::Zstd:
+    return "zstd";
+  }
+  return "";
+}
+
+bool compression_available(const DebugCompression compression) {
+  switch (compression) {
+  case DebugCompression::None:
+    return true;
+  case DebugCompression::Zlib:
+#ifdef HAS_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  case DebugCompression::Zstd:
+#ifdef HAS_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+#ifdef HAS_ZLIB
+// same as objcopy --compress-debug-sections=zlib
+bool compress_zlib(const char *input, const size_t size,
+                   std::vector<char> &output, const size_t offset) {
+  uLongf length = compressBound(size);
+  output.resize(offset + length);
+  if (compress(reinterpret_cast<Bytef *>(&output[offset]), &length,
+               reinterpret_cast<const Bytef *>(input), size) != Z_OK)
+    return false;
+  output.resize(offset + length);
+  return true;
+}
+#endif
+
+#ifdef HAS_ZSTD
+// same as objcopy --compress-debug-sections=zstd (the default level)
+bool compress_zstd(const char *input, const size_t size,
+                   std::vector<char> &output, const size_t offset) {
+  constexpr int level = 3;
+  output.resize(offset + ZSTD_compressBound(size));
+  const size_t length = ZSTD_compress(&output[offset], output.size() - offset,
+                                      input, size, level);
+  if (ZSTD_isError(length))
+    return false;
+  output.resize(offset + length);
+  return true;
+}
+#endif
+
+// Compresses the input into output, after offset bytes left for the header
+bool compress_buffer(const DebugCompression compression, const char *input,
+                     const size_t size, std::vector<char> &output,
+                     const size_t offset) {
+  switch (compression) {
+  case DebugCompression::None:
+    break;
+  case DebugCompression::Zlib:
+#ifdef HAS_ZLIB
+    return compress_zlib(input, size, output, offset);
+#else
+    break;
+#endif
+  case DebugCompression::Zstd:
+#ifdef HAS_ZSTD
+    return compress_zstd(input, size, output, offset);
+#else
+    break;
+#endif
+  }
+  return false;
+}
+
+template <typename Chdr>
+void put_compression_header(std::vector<char> &contents, const uint32_t type,
+                            const uint64_t size, const uint64_t alignment,
+                            const Endianness endian) {
+  Chdr chdr{};
+  put_field(chdr.ch_type, type, endian);
+  put_field(chdr.ch_size, size, endian);
+  put_field(chdr.ch_addralign, alignment, endian);
+  memcpy(contents.data(), &chdr, sizeof(chdr));
+}
+
+void compress_section(const DebugFile &file, CompressedSection &section,
+                      const DebugCompression compression) {
+  const ElfXX_Shdr shdr =
+      get_section_header(file.ehdr, section.index, file.data);
+  const char *input = file.data + shdr.sh_offset();
+  const uint64_t size = shdr.sh_size();
+  const bool is64 = file.ehdr.is_64bit();
+  const size_t chdr_size = is64 ? sizeof(Elf64_Chdr) : sizeof(Elf32_Chdr);
+  auto &contents = section.contents;
+  // keep the sections which do not get any smaller, like objcopy does
+  if (!compress_buffer(compression, input, size, contents, chdr_size) ||
+      contents.size() >= size) {
+    contents.clear();
+    contents.shrink_to_fit();
+    return;
+  }
+  const uint32_t type = compression == DebugCompression::Zlib
+                            ? ELFCOMPRESS_ZLIB
+                            : ELFCOMPRESS_ZSTD;
+  const Endianness endian = file.ehdr.endianness();
+  if (is64) {
+    put_compression_header<Elf64_Chdr>(contents, type, size,
+                                       shdr.sh_addralign(), endian);
+  } else {
+    put_compression_header<Elf32_Chdr>(contents, type, size,
+                                       shdr.sh_addralign(), endian);
+  }
+}
+
+// Lays out the file again with the compressed sections, and replaces it
+template <typename Ehdr, typename Shdr>
+bool write_debug_file(const DebugFile &file, uint64_t &new_size) {
+  const Endianness endian = file.ehdr.endianness();
+  const uint32_t shnum = file.ehdr.e_shnum();
+  Ehdr ehdr{};
+  memcpy(&ehdr, file.data, sizeof(ehdr));
+  std::vector<Shdr> shdrs(shnum);
+  memcpy(shdrs.data(), file.data + file.ehdr.e_shoff(), shnum * sizeof(Shdr));
+
+  std::vector<OutputChunk> chunks{};
+  uint64_t cursor = sizeof(Ehdr);
+  const uint64_t phoff =
+      place_program_headers(file.data, file.ehdr, cursor, chunks);
+  auto compressed = file.sections.begin();
+  for (uint32_t i = 1; i < shnum; i++) {
+    Shdr &shdr = shdrs[i];
+    uint64_t alignment = get_offset(shdr.sh_addralign, endian);
+    if (compressed != file.sections.end() && compressed->index == i &&
+        !compressed->contents.empty()) {
+      const auto &contents = compressed->contents;
+      // the alignment of the compression header
+      alignment = sizeof(Shdr::sh_addralign);
+      put_field(shdr.sh_flags,
+                get_offset(shdr.sh_flags, endian) | SHF_COMPRESSED, endian);
+      put_field(shdr.sh_size, contents.size(), endian);
+      put_field(shdr.sh_addralign, alignment, endian);
+      cursor = align_up(cursor, alignment);
+      chunks.push_back({cursor, contents.data(), contents.size()});
+      put_field(shdr.sh_offset, cursor, endian);
+      cursor += contents.size();
+    } else {
+      const uint64_t size = get_offset(shdr.sh_size, endian);
+      const uint64_t offset = align_up(cursor, alignment);
+      if (get_offset(shdr.sh_type, endian) != SHT_NOBITS) {
+        chunks.push_back({offset, file.data + get_offset(shdr.sh_offset, endian),
+                          size});
+        cursor = offset + size;
+      }
+      put_field(shdr.sh_offset, offset, endian);
+    }
+    if (compressed != file.sections.end() && compressed->index == i)
+      ++compressed;
+  }
+
+  const uint64_t shoff = align_up(cursor, sizeof(Shdr::sh_addralign));
+  put_field(ehdr.e_phoff, phoff, endian);
+  put_field(ehdr.e_shoff, shoff, endian);
+  chunks.push_back({0, reinterpret_cast<const char *>(&ehdr), sizeof(ehdr)});
+  chunks.push_back({shoff, reinterpret_cast<const char *>(shdrs.data()),
+                    shdrs.size() * sizeof(Shdr)});
+  new_size = shoff + shdrs.size() * sizeof(Shdr);
+
+  // the file is replaced, it is not hard linked to anything
+  const auto temp_path = file.path + ".ab-compress";
+  const int fd = open(temp_path.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return false;
+  const bool written = write_chunks(fd, chunks) &&
+                       ftruncate(fd, static_cast<off_t>(new_size)) == 0 &&
+                       fchmod(fd, file.mode & 07777) == 0;
+  if (close(fd) != 0 || !written ||
+      rename(temp_path.c_str(), file.path.c_str()) != 0) {
+    const int saved_errno = errno;
+    unlink(temp_path.c_str());
+    errno = saved_errno;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Maps the file, and finds its .debug_* sections which are not compressed.
+ * @return nullptr if the file is not an ELF file, or there is nothing to
+ *         compress
+ */
+std::unique_ptr<DebugFile> open_debug_file(const std::string &path,
+                                           ElfImage &image) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nullptr;
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size < EI_NIDENT) {
+    close(fd);
+    return nullptr;
+  }
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return nullptr;
+  const char *data = static_cast<const char *>(addr);
+  if (!image.parse(data, st.st_size)) {
+    munmap(addr, st.st_size);
+    return nullptr;
+  }
+  auto file = std::make_unique<DebugFile>(path, data, st.st_size, st.st_mode,
+                                          image.header());
+
+  // extended section numbering is not supported
+  const auto &ehdr = file->ehdr;
+  const uint32_t shnum = ehdr.e_shnum();
+  const uint32_t shstrndx = ehdr.e_shstrndx();
+  if (shnum == 0 || shstrndx >= shnum ||
+      ehdr.e_shentsize() !=
+          (ehdr.is_64bit() ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr)) ||
+      ehdr.e_phoff() > file->size ||
+      static_cast<uint64_t>(ehdr.e_phnum()) * ehdr.e_phentsize() >
+          file->size - ehdr.e_phoff())
+    return nullptr;
+  const ElfXX_Shdr shstrtab = get_section_header(ehdr, shstrndx, data);
+  if (shstrtab.sh_offset() > file->size ||
+      shstrtab.sh_size() > file->size - shstrtab.sh_offset())
+    return nullptr;
+  const char *names = data + shstrtab.sh_offset();
+  const uint64_t names_size = shstrtab.sh_size();
+  constexpr const char *debug_prefix = ".debug_";
+  constexpr size_t debug_prefix_len = 7;
+  for (uint32_t i = 1; i < shnum; i++) {
+    const ElfXX_Shdr shdr = get_section_header(ehdr, i, data);
+    if (shdr.sh_type() == SHT_NOBITS)
+      continue;
+    // every section is copied, so all of them have to be in the file
+    if (shdr.sh_offset() > file->size ||
+        shdr.sh_size() > file->size - shdr.sh_offset())
+      return nullptr;
+    const uint64_t name = shdr.sh_name();
+    if (shdr.sh_size() == 0 ||
+        (shdr.sh_flags() & (SHF_ALLOC | SHF_COMPRESSED)) ||
+        name >= names_size || names_size - name < debug_prefix_len)
+      continue;
+    if (strncmp(names + name, debug_prefix, debug_prefix_len) == 0)
+      file->sections.push_back({i, {}});
+  }
+  if (file->sections.empty())
+    return nullptr;
+  file->remaining = file->sections.size();
+  return file;
+}
+
+} // namespace
+
+bool debug_compression_from_string(const char *value,
+                                   DebugCompression &compression) {
+  if (!value || !*value || strcmp(value, "none") == 0) {
+    compression = DebugCompression::None;
+    return true;
+  }
+  if (strcmp(value, "zlib") == 0) {
+    compression = DebugCompression::Zlib;
+    return true;
+  }
+  if (strcmp(value, "zstd") == 0) {
+    compression = DebugCompression::Zstd;
+    return true;
+  }
+  return false;
+}
+
+int compress_debug_files(const std::string &directory,
+                         const DebugCompression compression) {
+  if (!compression_available(compression))
+    return AB_COMPRESS_UNSUPPORTED;
+  if (compression == DebugCompression::None || !fs::is_directory(directory))
+    return 0;
+
+  // start with the largest files, like elf_copy_debug_symbols_parallel
+  std::vector<std::unique_ptr<DebugFile>> files{};
+  ElfImage image{};
+  for (const auto &entry : fs::recursive_directory_iterator(directory)) {
+    if (!entry.is_regular_file() || entry.is_symlink())
+      continue;
+    auto file = open_debug_file(entry.path().string(), image);
+    if (file)
+      files.emplace_back(std::move(file));
+  }
+  if (files.empty())
+    return 0;
+  std::stable_sort(files.begin(), files.end(),
+                   [](const auto &a, const auto &b) { return a->size > b->size; });
+  // the sections of a file are dealt out to all the workers, so that each
+  // file is finished (and its buffers are released) early
+  std::vector<DebugTask> tasks{};
+  for (size_t i = 0; i < files.size(); i++) {
+    for (size_t j = 0; j < files[i]->sections.size(); j++)
+      tasks.emplace_back(i, j);
+  }
+
+  std::atomic<size_t> written_files{0};
+  std::atomic<uint64_t> size_before{0};
+  std::atomic<uint64_t> size_after{0};
+  ThreadPool<DebugTask, int> pool{
+      [&](const DebugTask &task) {
+        auto &file = files[task.first];
+        {
+          const TraceScope span{"compress", file->path};
+          compress_section(*file, file->sections[task.second], compression);
+        }
+        if (file->remaining.fetch_sub(1) != 1)
+          return 0;
+        // the last section of this file is done
+        uint64_t new_size = 0;
+        const bool written =
+            file->ehdr.is_64bit()
+                ? write_debug_file<Elf64_Ehdr, Elf64_Shdr>(*file, new_size)
+                : write_debug_file<Elf32_Ehdr, Elf32_Shdr>(*file, new_size);
+        if (!written) {
+          get_logger()->error(fmt::format("Unable to write {0}: {1}",
+                                          file->path, strerror(errno)));
+          file.reset();
+          return -1;
+        }
+        written_files++;
+        size_before.fetch_add(file->size);
+        size_after.fetch_add(new_size);
+        file.reset();
+        return 0;
+      },
+      static_cast<unsigned int>(
+          std::min<size_t>(tasks.size(), available_concurrency())),
+      TaskOrder::Fifo};
+  pool.enqueue_batch(std::move(tasks));
+  pool.wait_for_completion();
+
+  constexpr double mib = 1024 * 1024;
+  get_logger()->info(fmt::format(
+      "Compressed the debug sections of {0} files with {1}: {2:.1f} MiB to "
+      "{3:.1f} MiB",
+      written_files.load(), compression_name(compression), size_before.load() / mib,
+      size_after.load() / mib));
+  return pool.has_error() ? -1 : 0;
+}
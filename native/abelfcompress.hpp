@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class DebugCompression : uint8_t {
+  // leave the debug sections as they are
+  None,
+  // ELFCOMPRESS_ZLIB, like objcopy --compress-debug-sections=zlib
+  Zlib,
+  // ELFCOMPRESS_ZSTD, like objcopy --compress-debug-sections=zstd
+  Zstd,
+};
+
+/**
+ * Parses a debug section compressor name ("zlib", "zstd", or "none").
+ * @return false if the name is unknown
+ */
+bool debug_compression_from_string(const char *value,
+                                   DebugCompression &compression);
+
+/**
+ * Compresses the .debug_* sections of the debug symbol files under
+ * directory (as SHF_COMPRESSED sections). The sections of all the files are
+ * compressed in parallel, and each file is written again once its last
+ * section is done. Sections which are already compressed, or which would
+ * not get any smaller, are kept as they are.
+ * The sizes of the files before and after are logged.
+ * @return 0 on success, AB_COMPRESS_UNSUPPORTED if autobuild is built
+ *         without the compressor, -1 if a file could not be written
+ */
+int compress_debug_files(const std::string &directory,
+                         DebugCompression compression);
@@ -0,0 +1,220 @@
+#include "abelfimage.hpp"
+
+#include <cstring>
+
+namespace {
+
+inline size_t section_slot(const ElfSection section) {
+  return static_cast<size_t>(section);
+}
+
+// whether [offset, offset + length) lies in a file of the given size
+inline bool in_file(const uint64_t offset, const uint64_t length,
+                    const size_t size) {
+  return offset <= size && length <= size - offset;
+}
+
+} // namespace
+
+ElfImage::ElfImage()
+    : m_data(nullptr), m_size(0), m_ehdr(), m_shnum(0), m_sections(),
+      m_has_debug_info(false), m_has_soname(false), m_soname(0),
+      m_needed() {}
+
+void ElfImage::reset() {
+  m_data = nullptr;
+  m_size = 0;
+  m_ehdr = ElfXX_Ehdr{};
+  m_shnum = 0;
+  for (auto &index : m_sections)
+    index = 0;
+  m_has_debug_info = false;
+  m_has_soname = false;
+  m_soname = 0;
+  // keeps the capacity for the next file
+  m_needed.clear();
+}
+
+bool ElfImage::parse(const char *data, const size_t size) {
+  reset();
+  if (size < sizeof(Elf32_Ehdr) || memcmp(data, ELFMAG, SELFMAG) != 0)
+    return false;
+  const uint8_t byte_order = data[EI_DATA];
+  if (byte_order != ELFDATA2LSB && byte_order != ELFDATA2MSB)
+    return false;
+  const Endianness endian =
+      (byte_order == ELFDATA2LSB ? Endianness::Little : Endianness::Big);
+  switch (data[EI_CLASS]) {
+  case ELFCLASS32:
+    m_ehdr = ElfXX_Ehdr{reinterpret_cast<const Elf32_Ehdr *>(data), endian};
+    break;
+  case ELFCLASS64:
+    if (size < sizeof(Elf64_Ehdr))
+      return false;
+    m_ehdr = ElfXX_Ehdr{reinterpret_cast<const Elf64_Ehdr *>(data), endian};
+    break;
+  default:
+    return false;
+  }
+  m_data = data;
+  m_size = size;
+
+  // the section header table, if it is usable
+  const uint64_t shoff = m_ehdr.e_shoff();
+  const size_t shentsize = is_64bit() ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr);
+  if (shoff == 0 || m_ehdr.e_shentsize() != shentsize ||
+      !in_file(shoff, shentsize, size))
+    return true;
+  // with 0xff00 sections or more, the count and the index of .shstrtab are
+  // stored in the first section header
+  const ElfXX_Shdr first = get_section_header(m_ehdr, 0, data);
+  uint64_t shnum = m_ehdr.e_shnum();
+  if (shnum == 0)
+    shnum = first.sh_size();
+  uint32_t shstrndx = m_ehdr.e_shstrndx();
+  if (shstrndx == SHN_XINDEX)
+    shstrndx = first.sh_link();
+  if (shnum > UINT32_MAX || !in_file(shoff, shnum * shentsize, size))
+    return true;
+  m_shnum = static_cast<uint32_t>(shnum);
+
+  if (shstrndx == SHN_UNDEF || shstrndx >= m_shnum)
+    return true;
+  const ElfXX_Shdr shstrtab_header = get_section_header(m_ehdr, shstrndx, data);
+  const uint64_t shstrtab_offset = shstrtab_header.sh_offset();
+  const uint64_t shstrtab_size = shstrtab_header.sh_size();
+  if (shstrtab_size == 0 || !in_file(shstrtab_offset, shstrtab_size, size))
+    return true;
+  const char *shstrtab = data + shstrtab_offset;
+  // every name must end within the table
+  if (shstrtab[shstrtab_size - 1] != '\0')
+    return true;
+  index_sections(shstrtab, shstrtab_size);
+  index_dynamic();
+  return true;
+}
+
+void ElfImage::index_sections(const char *shstrtab,
+                              const uint64_t shstrtab_size) {
+  constexpr const char *debug_prefix = ".debug_";
+  constexpr size_t debug_prefix_len = 7;
+  constexpr const char *linux_note = ".note.Linux";
+  constexpr size_t linux_note_len = 11;
+  uint32_t dynamic_link = 0;
+
+  const auto claim = [this](const ElfSection section, const uint32_t index) {
+    auto &slot = m_sections[section_slot(section)];
+    // the first one wins
+    if (slot == 0)
+      slot = index;
+  };
+
+  for (uint32_t i = 1; i < m_shnum; i++) {
+    const ElfXX_Shdr shdr = get_section_header(m_ehdr, i, m_data);
+    const uint32_t name_idx = shdr.sh_name();
+    if (name_idx >= shstrtab_size)
+      continue;
+    const char *name = shstrtab + name_idx;
+    if (!m_has_debug_info &&
+        strncmp(name, debug_prefix, debug_prefix_len) == 0)
+      m_has_debug_info = true;
+
+    const uint32_t type = shdr.sh_type();
+    if (type == SHT_NULL || type == SHT_NOBITS ||
+        !in_file(shdr.sh_offset(), shdr.sh_size(), m_size))
+      continue;
+    switch (type) {
+    case SHT_DYNAMIC:
+      if (!has_section(ElfSection::Dynamic))
+        dynamic_link = shdr.sh_link();
+      claim(ElfSection::Dynamic, i);
+      break;
+    case SHT_STRTAB:
+      if (strcmp(name, ".dynstr") == 0)
+        claim(ElfSection::DynStr, i);
+      break;
+    case SHT_NOTE:
+      if (strcmp(name, ".note.gnu.build-id") == 0)
+        claim(ElfSection::BuildId, i);
+      else if (strncmp(name, linux_note, linux_note_len) == 0)
+        claim(ElfSection::LinuxNote, i);
+      break;
+    case SHT_ARM_ATTRIBUTES:
+      if (strcmp(name, ".ARM.attributes") == 0)
+        claim(ElfSection::ArmAttributes, i);
+      break;
+    case SHT_SYMTAB:
+      claim(ElfSection::SymTab, i);
+      break;
+    default:
+      break;
+    }
+  }
+
+  // a .dynstr without its usual name
+  if (!has_section(ElfSection::DynStr) && dynamic_link != 0 &&
+      dynamic_link < m_shnum) {
+    const ElfXX_Shdr shdr = get_section_header(m_ehdr, dynamic_link, m_data);
+    if (shdr.sh_type() == SHT_STRTAB &&
+        in_file(shdr.sh_offset(), shdr.sh_size(), m_size))
+      claim(ElfSection::DynStr, dynamic_link);
+  }
+}
+
+void ElfImage::index_dynamic() {
+  if (!has_section(ElfSection::Dynamic))
+    return;
+  const char *dyn_start = section_data(ElfSection::Dynamic);
+  const char *dyn_end = dyn_start + section_size(ElfSection::Dynamic);
+  const size_t entry_size = is_64bit() ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
+  while (dyn_start + entry_size <= dyn_end) {
+    const auto dyn = ElfXX_Dyn{dyn_start, is_64bit(), endianness()};
+    const auto tag = dyn.d_tag();
+    if (tag == DT_NULL)
+      break;
+    if (tag == DT_NEEDED) {
+      m_needed.push_back(dyn.d_val());
+    } else if (tag == DT_SONAME && !m_has_soname) {
+      m_soname = dyn.d_val();
+      m_has_soname = true;
+    }
+    dyn_start += entry_size;
+  }
+}
+
+ElfXX_Shdr ElfImage::section_header(const ElfSection section) const {
+  return get_section_header(m_ehdr, m_sections[section_slot(section)], m_data);
+}
+
+const char *ElfImage::section_data(const ElfSection section) const {
+  if (!has_section(section))
+    return nullptr;
+  return m_data + section_header(section).sh_offset();
+}
+
+uint64_t ElfImage::section_size(const ElfSection section) const {
+  if (!has_section(section))
+    return 0;
+  return section_header(section).sh_size();
+}
+
+const char *ElfImage::dynamic_string(const uint64_t offset) const {
+  const char *dynstr = section_data(ElfSection::DynStr);
+  const uint64_t dynstr_size = section_size(ElfSection::DynStr);
+  if (dynstr == nullptr || offset >= dynstr_size)
+    return nullptr;
+  // the string must end within the table
+  if (memchr(dynstr + offset, '\0', dynstr_size - offset) == nullptr)
+    return nullptr;
+  return dynstr + offset;
+}
+
+const char *ElfImage::soname() const {
+  if (!m_has_soname)
+    return nullptr;
+  return dynamic_string(m_soname);
+}
+
+const char *ElfImage::needed(const size_t index) const {
+  return dynamic_string(m_needed[index]);
+}
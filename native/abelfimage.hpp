@@ -0,0 +1,90 @@
+#pragma once
+
+#include "abelfview.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The sections ElfImage looks up by name
+enum class ElfSection : uint8_t {
+  // .dynamic (SHT_DYNAMIC)
+  Dynamic = 0,
+  // .dynstr (SHT_STRTAB)
+  DynStr,
+  // .note.gnu.build-id (SHT_NOTE)
+  BuildId,
+  // .note.Linux (SHT_NOTE), present in kernel modules
+  LinuxNote,
+  // .ARM.attributes (SHT_ARM_ATTRIBUTES)
+  ArmAttributes,
+  // .symtab (SHT_SYMTAB)
+  SymTab,
+  Count,
+};
+
+/**
+ * An index of the sections and dynamic tags of a mapped ELF file.
+ *
+ * parse() walks the section headers and the dynamic section once, and
+ * records where the interesting parts are. The queries afterwards do not
+ * scan the file again. An image may be reused for many files, its buffers
+ * are kept between them.
+ *
+ * Sections which do not fit in the file are treated as missing.
+ */
+class ElfImage {
+public:
+  ElfImage();
+
+  /**
+   * Index the ELF file at data.
+   * @return false if this is not an ELF file, or its headers are truncated
+   */
+  bool parse(const char *data, size_t size);
+
+  inline const ElfXX_Ehdr &header() const { return m_ehdr; }
+  inline const char *data() const { return m_data; }
+  inline size_t size() const { return m_size; }
+  inline bool is_64bit() const { return m_ehdr.is_64bit(); }
+  inline Endianness endianness() const { return m_ehdr.endianness(); }
+  // the number of section headers, including the extended numbering
+  inline uint32_t section_count() const { return m_shnum; }
+
+  // whether the section is present, and its contents are in the file
+  inline bool has_section(const ElfSection section) const {
+    return m_sections[static_cast<size_t>(section)] != 0;
+  }
+  // the header of the section, has_section() must be true
+  ElfXX_Shdr section_header(ElfSection section) const;
+  // the contents of the section, nullptr if it is missing
+  const char *section_data(ElfSection section) const;
+  // the size of the contents of the section, 0 if it is missing
+  uint64_t section_size(ElfSection section) const;
+
+  // whether any .debug_* section is present
+  inline bool has_debug_info() const { return m_has_debug_info; }
+  // DT_SONAME, nullptr if there is none
+  const char *soname() const;
+  // DT_NEEDED, in the order of the dynamic section
+  inline size_t needed_count() const { return m_needed.size(); }
+  const char *needed(size_t index) const;
+
+private:
+  void reset();
+  void index_sections(const char *shstrtab, uint64_t shstrtab_size);
+  void index_dynamic();
+  const char *dynamic_string(uint64_t offset) const;
+
+  const char *m_data;
+  size_t m_size;
+  ElfXX_Ehdr m_ehdr;
+  uint32_t m_shnum;
+  // index of each ElfSection in the section header table, 0 if missing
+  uint32_t m_sections[static_cast<size_t>(ElfSection::Count)];
+  bool m_has_debug_info;
+  // offsets into .dynstr
+  bool m_has_soname;
+  uint64_t m_soname;
+  std::vector<uint64_t> m_needed;
+};
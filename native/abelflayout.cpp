@@ -0,0 +1,43 @@
+#include "abelflayout.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+uint64_t place_program_headers(const char *data, const ElfXX_Ehdr &ehdr,
+                               uint64_t &cursor,
+                               std::vector<OutputChunk> &chunks) {
+  const uint32_t phnum = ehdr.e_phnum();
+  if (phnum == 0)
+    return 0;
+  const uint64_t phoff = cursor;
+  const size_t phdrs_size = phnum * ehdr.e_phentsize();
+  chunks.push_back({phoff, data + ehdr.e_phoff(), phdrs_size});
+  cursor += phdrs_size;
+  return phoff;
+}
+
+bool write_chunk(const int fd, const OutputChunk &chunk) {
+  const char *data = chunk.data;
+  size_t remaining = chunk.size;
+  off_t offset = static_cast<off_t>(chunk.offset);
+  while (remaining > 0) {
+    const ssize_t written = pwrite(fd, data, remaining, offset);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    offset += written;
+    remaining -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+bool write_chunks(const int fd, const std::vector<OutputChunk> &chunks) {
+  for (const auto &chunk : chunks) {
+    if (!write_chunk(fd, chunk))
+      return false;
+  }
+  return true;
+}
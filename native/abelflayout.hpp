@@ -0,0 +1,45 @@
+#pragma once
+
+#include "abelfview.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A piece of an ELF file being written, at its offset in the file
+struct OutputChunk {
+  uint64_t offset;
+  const char *data;
+  size_t size;
+};
+
+inline uint64_t align_up(const uint64_t value, const uint64_t alignment) {
+  if (alignment <= 1)
+    return value;
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Writes a host byte order value into a raw structure field
+template <typename T>
+inline void put_field(T &field, const uint64_t value,
+                      const Endianness endianness) {
+  field = get_offset(static_cast<T>(value), endianness);
+}
+
+/**
+ * Places the program headers of an ELF file at cursor in a debug symbol
+ * file, debuggers use them to match the segments. cursor is moved past them.
+ * @return the new e_phoff, or 0 if the file has no program headers
+ */
+uint64_t place_program_headers(const char *data, const ElfXX_Ehdr &ehdr,
+                               uint64_t &cursor,
+                               std::vector<OutputChunk> &chunks);
+
+// Writes a chunk at its offset, with pwrite
+bool write_chunk(int fd, const OutputChunk &chunk);
+
+/**
+ * Writes the chunks at their offsets. Gaps between the chunks are left as
+ * holes, which read back as zeros.
+ */
+bool write_chunks(int fd, const std::vector<OutputChunk> &chunks);
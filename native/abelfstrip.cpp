@@ -0,0 +1,738 @@
+#include "abelfstrip.hpp"
+#include "abelflayout.hpp"
+#include "abelfview.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct SectionPlan {
+  ElfXX_Shdr header;
+  const char *name;
+  bool keep;
+  uint32_t new_index;
+  uint64_t new_offset;
+  uint64_t new_size;
+  uint32_t new_name;
+};
+
+bool is_debug_section(const char *name) {
+  constexpr const char *prefixes[] = {".debug", ".zdebug", ".gnu.debuglto_",
+                                      ".gnu.linkonce.wi."};
+  constexpr const char *names[] = {".line", ".stab", ".stabstr", ".gdb_index"};
+  for (const auto *prefix : prefixes) {
+    if (strncmp(name, prefix, strlen(prefix)) == 0)
+      return true;
+  }
+  for (const auto *debug_name : names) {
+    if (strcmp(name, debug_name) == 0)
+      return true;
+  }
+  return false;
+}
+
+inline bool is_relocation(const uint32_t type) {
+  return type == SHT_REL || type == SHT_RELA;
+}
+
+class ElfStripper {
+public:
+  ElfStripper(const char *data, const size_t size,
+              const ElfStripOptions &options)
+      : m_data(data), m_size(size), m_options(options), m_relocatable(false),
+        m_shstrndx(0), m_symtab(0), m_symtab_locals(0), m_prefix_end(0),
+        m_removed(0) {}
+
+  // Decides which sections to keep. Returns false if the file is not
+  // something the native engine can handle.
+  bool plan();
+  inline bool has_changes() const { return m_removed > 0; }
+  inline bool is_relocatable() const { return m_relocatable; }
+  int write_debug_file(const char *path) const;
+  int strip_in_place(const char *path);
+  // Lays out a stripped relocatable object from scratch
+  void write_object(std::vector<char> &out);
+
+private:
+  bool load_headers();
+  bool is_removed_by_name(const char *name) const;
+  bool keep_debug_contents(const SectionPlan &section, uint32_t index) const;
+  template <typename Sym> void rewrite_symtab();
+  bool remove_empty_groups();
+  template <typename Rel> bool rewrite_relocations(uint32_t index);
+  bool rewrite_group(uint32_t index);
+  template <typename Ehdr>
+  std::vector<char> patch_elf_header(uint64_t phoff, uint64_t shoff,
+                                     uint32_t shnum, uint32_t shstrndx) const;
+  template <typename Shdr>
+  void emit_section_headers(const std::vector<SectionPlan> &sections,
+                            std::vector<char> &out, bool debug_file) const;
+
+  const char *m_data;
+  const size_t m_size;
+  const ElfStripOptions &m_options;
+  ElfXX_Ehdr m_ehdr;
+  // ET_REL: the section indices may change, but the symbol indices used
+  // by the relocations and the section groups have to be rewritten
+  bool m_relocatable;
+  std::vector<SectionPlan> m_sections;
+  uint32_t m_shstrndx;
+  uint32_t m_symtab;
+  uint32_t m_symtab_locals;
+  uint64_t m_prefix_end;
+  size_t m_removed;
+  std::vector<char> m_symtab_data;
+  // the new index of each symbol, dropped_symbol if it is removed
+  std::vector<uint32_t> m_symbol_map;
+  // the new contents of the rewritten relocation and group sections
+  std::map<uint32_t, std::vector<char>> m_rewritten;
+  std::vector<char> m_shstrtab;
+};
+
+constexpr uint32_t dropped_symbol = UINT32_MAX;
+
+bool ElfStripper::load_headers() {
+  if (m_size < EI_NIDENT || memcmp(m_data, ELFMAG, SELFMAG) != 0)
+    return false;
+  const uint8_t data_encoding = m_data[EI_DATA];
+  if (data_encoding != ELFDATA2LSB && data_encoding != ELFDATA2MSB)
+    return false;
+  const Endianness endian = data_encoding == ELFDATA2LSB ? Endianness::Little
+                                                         : Endianness::Big;
+  switch (m_data[EI_CLASS]) {
+  case ELFCLASS32:
+    if (m_size < sizeof(Elf32_Ehdr))
+      return false;
+    m_ehdr = ElfXX_Ehdr{reinterpret_cast<const Elf32_Ehdr *>(m_data), endian};
+    break;
+  case ELFCLASS64:
+    if (m_size < sizeof(Elf64_Ehdr))
+      return false;
+    m_ehdr = ElfXX_Ehdr{reinterpret_cast<const Elf64_Ehdr *>(m_data), endian};
+    break;
+  default:
+    return false;
+  }
+
+  // linked objects are stripped in-place, since their loadable contents
+  // never move. Relocatable objects are only stripped of debugging
+  // information, and are laid out again
+  const uint16_t e_type = m_ehdr.e_type();
+  m_relocatable = e_type == ET_REL;
+  if (m_relocatable) {
+    // MIPS64 packs several relocation types into r_info
+    if (m_options.mode != ElfStripMode::StripDebug ||
+        m_ehdr.e_machine() == EM_MIPS || m_ehdr.e_phnum() != 0)
+      return false;
+  } else if (e_type != ET_EXEC && e_type != ET_DYN) {
+    return false;
+  }
+
+  const bool is64 = m_ehdr.is_64bit();
+  const uint64_t shnum = m_ehdr.e_shnum();
+  const uint64_t shoff = m_ehdr.e_shoff();
+  // extended section numbering is not supported
+  if (shnum == 0 || m_ehdr.e_shstrndx() >= shnum)
+    return false;
+  if (m_ehdr.e_shentsize() != (is64 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr)))
+    return false;
+  if (shoff > m_size || shnum * m_ehdr.e_shentsize() > m_size - shoff)
+    return false;
+  const uint64_t phnum = m_ehdr.e_phnum();
+  const uint64_t phoff = m_ehdr.e_phoff();
+  if (phnum > 0) {
+    if (m_ehdr.e_phentsize() !=
+        (is64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr)))
+      return false;
+    if (phoff > m_size || phnum * m_ehdr.e_phentsize() > m_size - phoff)
+      return false;
+  }
+
+  m_shstrndx = m_ehdr.e_shstrndx();
+  const ElfXX_Shdr shstrtab_header =
+      get_section_header(m_ehdr, m_shstrndx, m_data);
+  const uint64_t shstrtab_offset = shstrtab_header.sh_offset();
+  const uint64_t shstrtab_size = shstrtab_header.sh_size();
+  if (shstrtab_offset > m_size || shstrtab_size > m_size - shstrtab_offset ||
+      shstrtab_size == 0)
+    return false;
+  const char *shstrtab = m_data + shstrtab_offset;
+  // make sure every name lookup is terminated inside the string table
+  if (shstrtab[shstrtab_size - 1] != '\0')
+    return false;
+
+  m_sections.reserve(shnum);
+  for (uint32_t i = 0; i < shnum; i++) {
+    const ElfXX_Shdr shdr = get_section_header(m_ehdr, i, m_data);
+    const uint64_t offset = shdr.sh_offset();
+    const uint64_t size = shdr.sh_size();
+    if (shdr.sh_type() != SHT_NOBITS &&
+        (offset > m_size || size > m_size - offset))
+      return false;
+    if (shdr.sh_name() >= shstrtab_size)
+      return false;
+    m_sections.push_back(SectionPlan{
+        .header = shdr,
+        .name = shstrtab + shdr.sh_name(),
+        .keep = true,
+        .new_index = i,
+        .new_offset = offset,
+        .new_size = size,
+        .new_name = 0,
+    });
+  }
+  return true;
+}
+
+bool ElfStripper::is_removed_by_name(const char *name) const {
+  for (const auto &section : m_options.remove_sections) {
+    if (section == name)
+      return true;
+  }
+  return false;
+}
+
+bool ElfStripper::plan() {
+  if (!load_headers())
+    return false;
+  const uint32_t shnum = m_sections.size();
+  const bool strip_symbols = m_options.mode != ElfStripMode::StripDebug;
+
+  for (uint32_t i = 1; i < shnum; i++) {
+    auto &section = m_sections[i];
+    // never touch anything that is loaded at runtime
+    if (section.header.sh_flags() & SHF_ALLOC)
+      continue;
+    if (i == m_shstrndx)
+      continue;
+    const uint32_t type = section.header.sh_type();
+    if (is_debug_section(section.name) || is_removed_by_name(section.name) ||
+        (strip_symbols && type == SHT_SYMTAB)) {
+      section.keep = false;
+    }
+  }
+
+  // remove the sections that only make sense along with a removed section
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (uint32_t i = 1; i < shnum; i++) {
+      auto &section = m_sections[i];
+      if (!section.keep || (section.header.sh_flags() & SHF_ALLOC))
+        continue;
+      const uint32_t type = section.header.sh_type();
+      const uint32_t link = section.header.sh_link();
+      const uint32_t info = section.header.sh_info();
+      const bool dangling_link =
+          link != 0 && link < shnum && !m_sections[link].keep &&
+          (is_relocation(type) || type == SHT_SYMTAB_SHNDX ||
+           type == SHT_GROUP);
+      const bool dangling_info =
+          (is_relocation(type) ||
+           (section.header.sh_flags() & SHF_INFO_LINK)) &&
+          info != 0 && info < shnum && !m_sections[info].keep;
+      if (dangling_link || dangling_info) {
+        section.keep = false;
+        changed = true;
+      }
+    }
+  }
+
+  if (m_relocatable && !remove_empty_groups())
+    return false;
+
+  if (strip_symbols) {
+    // the string table of a removed symbol table is not needed either,
+    // unless something else still refers to it
+    for (uint32_t i = 1; i < shnum; i++) {
+      const auto &section = m_sections[i];
+      if (section.keep || section.header.sh_type() != SHT_SYMTAB)
+        continue;
+      const uint32_t strtab = section.header.sh_link();
+      if (strtab == 0 || strtab >= shnum || strtab == m_shstrndx ||
+          (m_sections[strtab].header.sh_flags() & SHF_ALLOC))
+        continue;
+      bool referenced = false;
+      for (uint32_t j = 1; j < shnum; j++) {
+        if (j != i && m_sections[j].keep &&
+            m_sections[j].header.sh_link() == strtab) {
+          referenced = true;
+          break;
+        }
+      }
+      if (!referenced)
+        m_sections[strtab].keep = false;
+    }
+  }
+
+  // assign new indices, the loadable sections must keep their indices
+  // since the dynamic symbol table refers to them
+  uint32_t new_index = 0;
+  for (uint32_t i = 0; i < shnum; i++) {
+    auto &section = m_sections[i];
+    if (!section.keep) {
+      m_removed++;
+      continue;
+    }
+    section.new_index = new_index++;
+    if (!m_relocatable && (section.header.sh_flags() & SHF_ALLOC) &&
+        section.new_index != i)
+      return false;
+  }
+
+  for (uint32_t i = 1; i < shnum; i++) {
+    const auto &section = m_sections[i];
+    if (!section.keep)
+      continue;
+    const uint32_t type = section.header.sh_type();
+    const uint32_t link = section.header.sh_link();
+    if (link != 0 && link < shnum && !m_sections[link].keep)
+      return false;
+    if (type == SHT_SYMTAB_SHNDX || (type == SHT_GROUP && !m_relocatable))
+      return false;
+    if (type == SHT_SYMTAB)
+      m_symtab = i;
+  }
+
+  if (m_symtab != 0 && m_removed > 0) {
+    // symbols of the removed sections are dropped and the section indices of
+    // the remaining ones are renumbered, which would invalidate relocations
+    // against the symbol table of a linked object
+    for (uint32_t i = 1; i < shnum; i++) {
+      const auto &section = m_sections[i];
+      if (!m_relocatable && section.keep &&
+          is_relocation(section.header.sh_type()) &&
+          section.header.sh_link() == m_symtab)
+        return false;
+    }
+    if (m_ehdr.is_64bit())
+      rewrite_symtab<Elf64_Sym>();
+    else
+      rewrite_symtab<Elf32_Sym>();
+  }
+
+  if (m_relocatable && m_symtab != 0 && !m_symtab_data.empty()) {
+    for (uint32_t i = 1; i < shnum; i++) {
+      const auto &section = m_sections[i];
+      if (!section.keep || section.header.sh_link() != m_symtab)
+        continue;
+      const uint32_t type = section.header.sh_type();
+      bool rewritten = false;
+      if (type == SHT_REL)
+        rewritten = m_ehdr.is_64bit() ? rewrite_relocations<Elf64_Rel>(i)
+                                      : rewrite_relocations<Elf32_Rel>(i);
+      else if (type == SHT_RELA)
+        rewritten = m_ehdr.is_64bit() ? rewrite_relocations<Elf64_Rela>(i)
+                                      : rewrite_relocations<Elf32_Rela>(i);
+      else if (type == SHT_GROUP)
+        rewritten = rewrite_group(i);
+      // anything else referring to symbols by index (e.g. the address
+      // significance table of LLVM) is left to the external tools
+      if (!rewritten)
+        return false;
+    }
+  }
+
+  // everything up to the end of the loadable contents stays where it is
+  m_prefix_end = m_ehdr.size();
+  const uint32_t phnum = m_ehdr.e_phnum();
+  if (phnum > 0) {
+    m_prefix_end = std::max<uint64_t>(
+        m_prefix_end, m_ehdr.e_phoff() + phnum * m_ehdr.e_phentsize());
+  }
+  for (uint32_t i = 0; i < phnum; i++) {
+    const ElfXX_Phdr phdr = get_program_header(m_ehdr, i, m_data);
+    const uint64_t end = phdr.p_offset() + phdr.p_filesz();
+    if (end > m_size)
+      return false;
+    m_prefix_end = std::max(m_prefix_end, end);
+  }
+  for (const auto &section : m_sections) {
+    if (!(section.header.sh_flags() & SHF_ALLOC) ||
+        section.header.sh_type() == SHT_NOBITS)
+      continue;
+    m_prefix_end = std::max(m_prefix_end, section.header.sh_offset() +
+                                              section.header.sh_size());
+  }
+
+  // rebuild the section name string table
+  m_shstrtab.push_back('\0');
+  for (auto &section : m_sections) {
+    if (!section.keep || section.new_index == 0)
+      continue;
+    section.new_name = m_shstrtab.size();
+    m_shstrtab.insert(m_shstrtab.end(), section.name,
+                      section.name + strlen(section.name) + 1);
+  }
+  return true;
+}
+
+template <typename Sym> void ElfStripper::rewrite_symtab() {
+  auto &symtab = m_sections[m_symtab];
+  const char *start = m_data + symtab.header.sh_offset();
+  const size_t count = symtab.header.sh_size() / sizeof(Sym);
+  const size_t locals = symtab.header.sh_info();
+  const Endianness endian = m_ehdr.endianness();
+  m_symtab_data.reserve(count * sizeof(Sym));
+  m_symbol_map.assign(count, dropped_symbol);
+  for (size_t i = 0; i < count; i++) {
+    Sym sym{};
+    memcpy(&sym, start + i * sizeof(Sym), sizeof(Sym));
+    const uint16_t shndx = get_offset(sym.st_shndx, endian);
+    if (i > 0 && shndx != SHN_UNDEF && shndx < SHN_LORESERVE) {
+      if (shndx >= m_sections.size() || !m_sections[shndx].keep)
+        continue;
+      put_field(sym.st_shndx, m_sections[shndx].new_index, endian);
+    }
+    if (i < locals)
+      m_symtab_locals++;
+    m_symbol_map[i] = m_symtab_data.size() / sizeof(Sym);
+    const char *raw = reinterpret_cast<const char *>(&sym);
+    m_symtab_data.insert(m_symtab_data.end(), raw, raw + sizeof(Sym));
+  }
+  symtab.new_size = m_symtab_data.size();
+}
+
+bool ElfStripper::remove_empty_groups() {
+  // a group of debugging sections only (e.g. .debug_types) goes away
+  // along with its members
+  const Endianness endian = m_ehdr.endianness();
+  for (uint32_t i = 1; i < m_sections.size(); i++) {
+    auto &section = m_sections[i];
+    if (!section.keep || section.header.sh_type() != SHT_GROUP)
+      continue;
+    const uint64_t size = section.header.sh_size();
+    if (size < sizeof(uint32_t) || size % sizeof(uint32_t) != 0)
+      return false;
+    const char *words = m_data + section.header.sh_offset();
+    bool has_members = false;
+    for (uint64_t offset = sizeof(uint32_t); offset < size;
+         offset += sizeof(uint32_t)) {
+      uint32_t member = 0;
+      memcpy(&member, words + offset, sizeof(member));
+      member = get_offset(member, endian);
+      if (member >= m_sections.size())
+        return false;
+      has_members = has_members || m_sections[member].keep;
+    }
+    if (!has_members)
+      section.keep = false;
+  }
+  return true;
+}
+
+template <typename Rel> bool ElfStripper::rewrite_relocations(uint32_t index) {
+  auto &section = m_sections[index];
+  const uint64_t size = section.header.sh_size();
+  if (size % sizeof(Rel) != 0)
+    return false;
+  const Endianness endian = m_ehdr.endianness();
+  const bool is64 = sizeof(Rel::r_info) == 8;
+  auto &contents = m_rewritten[index];
+  contents.assign(m_data + section.header.sh_offset(),
+                  m_data + section.header.sh_offset() + size);
+  for (uint64_t offset = 0; offset < size; offset += sizeof(Rel)) {
+    Rel rel{};
+    memcpy(&rel, contents.data() + offset, sizeof(Rel));
+    const uint64_t info = get_offset(rel.r_info, endian);
+    const uint64_t symbol = is64 ? ELF64_R_SYM(info) : ELF32_R_SYM(info);
+    const uint64_t type = is64 ? ELF64_R_TYPE(info) : ELF32_R_TYPE(info);
+    if (symbol >= m_symbol_map.size() || m_symbol_map[symbol] == dropped_symbol)
+      return false;
+    const uint64_t new_symbol = m_symbol_map[symbol];
+    put_field(rel.r_info,
+              is64 ? ELF64_R_INFO(new_symbol, type)
+                   : ELF32_R_INFO(new_symbol, type),
+              endian);
+    memcpy(contents.data() + offset, &rel, sizeof(Rel));
+  }
+  return true;
+}
+
+bool ElfStripper::rewrite_group(uint32_t index) {
+  auto &section = m_sections[index];
+  const uint32_t signature = section.header.sh_info();
+  if (signature >= m_symbol_map.size() ||
+      m_symbol_map[signature] == dropped_symbol)
+    return false;
+  const Endianness endian = m_ehdr.endianness();
+  const char *words = m_data + section.header.sh_offset();
+  const uint64_t size = section.header.sh_size();
+  auto &contents = m_rewritten[index];
+  // the flags, then the members which are kept
+  contents.assign(words, words + sizeof(uint32_t));
+  for (uint64_t offset = sizeof(uint32_t); offset < size;
+       offset += sizeof(uint32_t)) {
+    uint32_t member = 0;
+    memcpy(&member, words + offset, sizeof(member));
+    const auto &target = m_sections[get_offset(member, endian)];
+    if (!target.keep)
+      continue;
+    put_field(member, target.new_index, endian);
+    const char *raw = reinterpret_cast<const char *>(&member);
+    contents.insert(contents.end(), raw, raw + sizeof(member));
+  }
+  section.new_size = contents.size();
+  return true;
+}
+
+bool ElfStripper::keep_debug_contents(const SectionPlan &section,
+                                      const uint32_t index) const {
+  const uint32_t type = section.header.sh_type();
+  if (index == 0 || type == SHT_NOBITS)
+    return false;
+  if (type == SHT_NOTE)
+    return true;
+  if (section.header.sh_flags() & SHF_ALLOC)
+    return false;
+  return index == m_shstrndx || type == SHT_SYMTAB || type == SHT_STRTAB ||
+         is_debug_section(section.name);
+}
+
+template <typename Ehdr>
+std::vector<char> ElfStripper::patch_elf_header(const uint64_t phoff,
+                                                const uint64_t shoff,
+                                                const uint32_t shnum,
+                                                const uint32_t shstrndx) const {
+  const Endianness endian = m_ehdr.endianness();
+  Ehdr ehdr{};
+  memcpy(&ehdr, m_data, sizeof(Ehdr));
+  put_field(ehdr.e_phoff, phoff, endian);
+  put_field(ehdr.e_shoff, shoff, endian);
+  put_field(ehdr.e_shnum, shnum, endian);
+  put_field(ehdr.e_shstrndx, shstrndx, endian);
+  const char *raw = reinterpret_cast<const char *>(&ehdr);
+  return {raw, raw + sizeof(Ehdr)};
+}
+
+template <typename Shdr>
+void ElfStripper::emit_section_headers(
+    const std::vector<SectionPlan> &sections, std::vector<char> &out,
+    const bool debug_file) const {
+  const Endianness endian = m_ehdr.endianness();
+  const uint32_t shnum = sections.size();
+  for (uint32_t i = 0; i < shnum; i++) {
+    const auto &section = sections[i];
+    Shdr shdr{};
+    memcpy(&shdr, section.header.raw(), sizeof(Shdr));
+    if (debug_file) {
+      // the debug companion keeps every section at its original index
+      if (!keep_debug_contents(section, i) && i != 0 &&
+          section.header.sh_type() != SHT_NOBITS)
+        put_field(shdr.sh_type, SHT_NOBITS, endian);
+      put_field(shdr.sh_offset, section.new_offset, endian);
+    } else {
+      if (!section.keep)
+        continue;
+      const uint32_t type = section.header.sh_type();
+      const uint32_t link = section.header.sh_link();
+      const uint32_t info = section.header.sh_info();
+      put_field(shdr.sh_name, section.new_name, endian);
+      put_field(shdr.sh_offset, section.new_offset, endian);
+      put_field(shdr.sh_size, section.new_size, endian);
+      if (link != 0 && link < shnum)
+        put_field(shdr.sh_link, sections[link].new_index, endian);
+      if ((is_relocation(type) ||
+           (section.header.sh_flags() & SHF_INFO_LINK)) &&
+          info != 0 && info < shnum)
+        put_field(shdr.sh_info, sections[info].new_index, endian);
+      if (i == m_symtab && !m_symtab_data.empty())
+        put_field(shdr.sh_info, m_symtab_locals, endian);
+      if (type == SHT_GROUP && !m_symbol_map.empty())
+        put_field(shdr.sh_info, m_symbol_map[info], endian);
+    }
+    const char *raw = reinterpret_cast<const char *>(&shdr);
+    out.insert(out.end(), raw, raw + sizeof(Shdr));
+  }
+}
+
+int ElfStripper::write_debug_file(const char *path) const {
+  std::vector<OutputChunk> chunks{};
+  std::vector<SectionPlan> sections{m_sections};
+  const bool is64 = m_ehdr.is_64bit();
+  uint64_t cursor = m_ehdr.size();
+  const uint64_t phoff = place_program_headers(m_data, m_ehdr, cursor, chunks);
+  for (uint32_t i = 1; i < sections.size(); i++) {
+    auto &section = sections[i];
+    const uint64_t offset = align_up(cursor, section.header.sh_addralign());
+    section.new_offset = offset;
+    if (!keep_debug_contents(section, i))
+      continue;
+    const uint64_t size = section.header.sh_size();
+    chunks.push_back({offset, m_data + section.header.sh_offset(), size});
+    cursor = offset + size;
+  }
+
+  const uint64_t shoff = align_up(cursor, is64 ? 8 : 4);
+  std::vector<char> shdrs{};
+  std::vector<char> ehdr{};
+  if (is64) {
+    emit_section_headers<Elf64_Shdr>(sections, shdrs, true);
+    ehdr = patch_elf_header<Elf64_Ehdr>(phoff, shoff, m_sections.size(),
+                                        m_shstrndx);
+  } else {
+    emit_section_headers<Elf32_Shdr>(sections, shdrs, true);
+    ehdr = patch_elf_header<Elf32_Ehdr>(phoff, shoff, m_sections.size(),
+                                        m_shstrndx);
+  }
+  chunks.push_back({0, ehdr.data(), ehdr.size()});
+  chunks.push_back({shoff, shdrs.data(), shdrs.size()});
+
+  const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror("open");
+    return -1;
+  }
+  if (!write_chunks(fd, chunks)) {
+    perror("pwrite");
+    close(fd);
+    return -1;
+  }
+  if (ftruncate(fd, static_cast<off_t>(shoff + shdrs.size())) != 0) {
+    perror("ftruncate");
+    close(fd);
+    return -1;
+  }
+  return close(fd) == 0 ? 0 : -1;
+}
+
+int ElfStripper::strip_in_place(const char *path) {
+  const bool is64 = m_ehdr.is_64bit();
+  // stage everything after the loadable contents in memory first, since the
+  // kept sections may be read from the region being overwritten
+  std::vector<char> tail{};
+  uint64_t cursor = m_prefix_end;
+  for (uint32_t i = 1; i < m_sections.size(); i++) {
+    auto &section = m_sections[i];
+    if (!section.keep || (section.header.sh_flags() & SHF_ALLOC) ||
+        i == m_shstrndx)
+      continue;
+    const uint32_t type = section.header.sh_type();
+    const uint64_t offset = section.header.sh_offset();
+    const uint64_t size = section.header.sh_size();
+    const bool rewritten = i == m_symtab && !m_symtab_data.empty();
+    if (type == SHT_NOBITS || (!rewritten && offset + size <= m_prefix_end))
+      continue;
+    const uint64_t new_offset = align_up(cursor, section.header.sh_addralign());
+    tail.resize(new_offset - m_prefix_end);
+    if (rewritten) {
+      tail.insert(tail.end(), m_symtab_data.begin(), m_symtab_data.end());
+    } else {
+      tail.insert(tail.end(), m_data + offset, m_data + offset + size);
+    }
+    section.new_offset = new_offset;
+    cursor = m_prefix_end + tail.size();
+  }
+  auto &shstrtab = m_sections[m_shstrndx];
+  shstrtab.new_offset = cursor;
+  shstrtab.new_size = m_shstrtab.size();
+  tail.insert(tail.end(), m_shstrtab.begin(), m_shstrtab.end());
+  cursor = m_prefix_end + tail.size();
+
+  const uint64_t shoff = align_up(cursor, is64 ? 8 : 4);
+  tail.resize(shoff - m_prefix_end);
+  const uint32_t shnum = m_sections.size() - m_removed;
+  std::vector<char> ehdr{};
+  if (is64) {
+    emit_section_headers<Elf64_Shdr>(m_sections, tail, false);
+    ehdr = patch_elf_header<Elf64_Ehdr>(m_ehdr.e_phoff(), shoff, shnum,
+                                        shstrtab.new_index);
+  } else {
+    emit_section_headers<Elf32_Shdr>(m_sections, tail, false);
+    ehdr = patch_elf_header<Elf32_Ehdr>(m_ehdr.e_phoff(), shoff, shnum,
+                                        shstrtab.new_index);
+  }
+
+  // the file is updated in-place to preserve its inode: permissions,
+  // ownership, extended attributes and hard links stay intact
+  const int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror("open");
+    return -1;
+  }
+  if (!write_chunk(fd, {m_prefix_end, tail.data(), tail.size()}) ||
+      ftruncate(fd, static_cast<off_t>(m_prefix_end + tail.size())) != 0 ||
+      !write_chunk(fd, {0, ehdr.data(), ehdr.size()})) {
+    perror("write");
+    close(fd);
+    return -1;
+  }
+  return close(fd) == 0 ? 0 : -1;
+}
+
+void ElfStripper::write_object(std::vector<char> &out) {
+  const bool is64 = m_ehdr.is_64bit();
+  out.assign(m_ehdr.size(), '\0');
+  auto &shstrtab = m_sections[m_shstrndx];
+  shstrtab.new_size = m_shstrtab.size();
+  for (uint32_t i = 1; i < m_sections.size(); i++) {
+    auto &section = m_sections[i];
+    if (!section.keep)
+      continue;
+    section.new_offset = align_up(out.size(), section.header.sh_addralign());
+    if (section.header.sh_type() == SHT_NOBITS)
+      continue;
+    out.resize(section.new_offset);
+    const auto rewritten = m_rewritten.find(i);
+    if (i == m_shstrndx) {
+      out.insert(out.end(), m_shstrtab.begin(), m_shstrtab.end());
+    } else if (i == m_symtab && !m_symtab_data.empty()) {
+      out.insert(out.end(), m_symtab_data.begin(), m_symtab_data.end());
+    } else if (rewritten != m_rewritten.end()) {
+      out.insert(out.end(), rewritten->second.begin(),
+                 rewritten->second.end());
+    } else {
+      const char *start = m_data + section.header.sh_offset();
+      out.insert(out.end(), start, start + section.header.sh_size());
+    }
+  }
+
+  const uint64_t shoff = align_up(out.size(), is64 ? 8 : 4);
+  out.resize(shoff);
+  const uint32_t shnum = m_sections.size() - m_removed;
+  std::vector<char> ehdr{};
+  if (is64) {
+    emit_section_headers<Elf64_Shdr>(m_sections, out, false);
+    ehdr = patch_elf_header<Elf64_Ehdr>(0, shoff, shnum, shstrtab.new_index);
+  } else {
+    emit_section_headers<Elf32_Shdr>(m_sections, out, false);
+    ehdr = patch_elf_header<Elf32_Ehdr>(0, shoff, shnum, shstrtab.new_index);
+  }
+  std::copy(ehdr.begin(), ehdr.end(), out.begin());
+}
+
+} // namespace
+
+int elf_strip_native(const char *data, const size_t size, const char *src_path,
+                     const char *debug_path, const ElfStripOptions &options) {
+  ElfStripper stripper{data, size, options};
+  if (!stripper.plan() || stripper.is_relocatable())
+    return AB_ELF_STRIP_UNSUPPORTED;
+  if (debug_path) {
+    const int ret = stripper.write_debug_file(debug_path);
+    if (ret != 0)
+      return ret;
+  }
+  if (!stripper.has_changes())
+    return 0;
+  return stripper.strip_in_place(src_path);
+}
+
+int elf_strip_object_native(const char *data, const size_t size,
+                            const ElfStripOptions &options,
+                            std::vector<char> &out) {
+  ElfStripper stripper{data, size, options};
+  out.clear();
+  if (!stripper.plan() || !stripper.is_relocatable())
+    return AB_ELF_STRIP_UNSUPPORTED;
+  if (stripper.has_changes())
+    stripper.write_object(out);
+  return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ElfStripMode : uint8_t {
+  // -s: remove the symbol table and all debugging sections
+  StripAll,
+  // --strip-debug: remove debugging sections and the symbols referring to them
+  StripDebug,
+  // --strip-unneeded: for linked objects this is the same as StripAll
+  StripUnneeded,
+};
+
+struct ElfStripOptions {
+  ElfStripMode mode;
+  // --remove-section=<name>
+  std::vector<std::string> remove_sections;
+};
+
+// The layout of the file can not be handled by the native strip engine.
+// Nothing has been written, the caller should use the external tools instead.
+constexpr int AB_ELF_STRIP_UNSUPPORTED = 1;
+
+/**
+ * Strip an ELF file in-place, without running strip(1) or eu-strip(1).
+ * @param data mapped contents of the file at src_path
+ * @param size size of the mapped contents
+ * @param src_path path of the file to be stripped
+ * @param debug_path if not null, the debug companion (as produced by
+ *        objcopy --only-keep-debug) is written to this path before stripping
+ * @param options strip mode and sections to remove
+ * @return 0 on success, AB_ELF_STRIP_UNSUPPORTED if the native engine does
+ *         not handle this file, -1 if an I/O error occurred
+ */
+int elf_strip_native(const char *data, size_t size, const char *src_path,
+                     const char *debug_path, const ElfStripOptions &options);
+
+/**
+ * Strip the debugging information from a relocatable object in memory,
+ * e.g. a member of a static library, like strip --strip-debug.
+ * @param data contents of the object
+ * @param size size of the contents
+ * @param options the mode must be ElfStripMode::StripDebug
+ * @param out the stripped object, left empty if there is nothing to strip
+ * @return 0 on success, AB_ELF_STRIP_UNSUPPORTED if the native engine does
+ *         not handle this object
+ */
+int elf_strip_object_native(const char *data, size_t size,
+                            const ElfStripOptions &options,
+                            std::vector<char> &out);
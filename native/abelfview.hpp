@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <elf.h>
+#include <endian.h>
+
+#if __cplusplus >= 201703L && !defined(IFCONSTEXPR)
+#define IFCONSTEXPR constexpr
+#elif !defined(IFCONSTEXPR)
+#define IFCONSTEXPR
+#endif
+
+enum class Endianness : bool {
+  Little = true,
+  Big = false,
+};
+
+// Converts between the file byte order and the host byte order.
+// The conversion is symmetric, so it is used for both reading and writing.
+template <typename ElfXX_Off>
+static inline ElfXX_Off get_offset(const ElfXX_Off offset,
+                                   const Endianness endianness) {
+  constexpr size_t size = sizeof(ElfXX_Off);
+  static_assert(size == 2 || size == 4 || size == 8, "Invalid size");
+  if (endianness == Endianness::Little) {
+    switch (size) {
+    case 2:
+      return le16toh(offset);
+    case 4:
+      return le32toh(offset);
+    case 8:
+      return le64toh(offset);
+    }
+  } else {
+    switch (size) {
+    case 2:
+      return be16toh(offset);
+    case 4:
+      return be32toh(offset);
+    case 8:
+      return be64toh(offset);
+    }
+  }
+  // UNREACHABLE
+  __builtin_unreachable();
+}
+
+#define ELFXX_ADD_GETTER_INNER(name, getter)                                   \
+  using ElfXX_##name##_t = decltype(BaseWrapper::elf64->getter);               \
+  inline ElfXX_##name##_t name() const {                                       \
+    if IFCONSTEXPR (sizeof(ElfXX_##name##_t) > 1)                              \
+      return m_is64bit ? get_offset(m_data.elf64->getter, m_endianness)        \
+                       : get_offset(m_data.elf32->getter, m_endianness);       \
+    else                                                                       \
+      return m_is64bit ? m_data.elf64->getter : m_data.elf32->getter;          \
+  }
+
+#define ELFXX_ADD_GETTER(name) ELFXX_ADD_GETTER_INNER(name, name)
+
+template <typename Elf32Type, typename Elf64Type> class ElfXX_Header_Base {
+public:
+  ElfXX_Header_Base(Elf32Type *elf32, Endianness endianness)
+      : m_is64bit(false), m_data({.elf32 = elf32}), m_endianness(endianness) {}
+  ElfXX_Header_Base(Elf64Type *elf64, Endianness endianness)
+      : m_is64bit(true), m_data({.elf64 = elf64}), m_endianness(endianness) {}
+  ElfXX_Header_Base()
+      : m_is64bit(false), m_data({}), m_endianness(Endianness::Little) {}
+  ElfXX_Header_Base(const char *data, bool is64bit, Endianness endianness)
+      : m_is64bit(is64bit), m_endianness(endianness) {
+    if (m_is64bit) {
+      m_data.elf64 = reinterpret_cast<Elf64Type *>(data);
+    } else {
+      m_data.elf32 = reinterpret_cast<Elf32Type *>(data);
+    }
+  }
+  inline bool is_64bit() const { return m_is64bit; }
+  inline Endianness endianness() const { return m_endianness; }
+  inline size_t size() const {
+    return m_is64bit ? sizeof(Elf64Type) : sizeof(Elf32Type);
+  }
+  // pointer to the raw (file byte order) structure
+  inline const char *raw() const {
+    return m_is64bit ? reinterpret_cast<const char *>(m_data.elf64)
+                     : reinterpret_cast<const char *>(m_data.elf32);
+  }
+
+protected:
+  union BaseWrapper {
+    const Elf32Type *elf32;
+    const Elf64Type *elf64;
+  };
+
+  bool m_is64bit;
+  BaseWrapper m_data;
+  Endianness m_endianness;
+};
+
+class ElfXX_Ehdr
+    : public ElfXX_Header_Base<const Elf32_Ehdr, const Elf64_Ehdr> {
+public:
+  ElfXX_Ehdr(const Elf32_Ehdr *elf32, Endianness endianness)
+      : ElfXX_Header_Base(elf32, endianness) {}
+  ElfXX_Ehdr(const Elf64_Ehdr *elf64, Endianness endianness)
+      : ElfXX_Header_Base(elf64, endianness) {}
+  ElfXX_Ehdr() : ElfXX_Header_Base() {}
+
+  // Add getters using macros
+  ELFXX_ADD_GETTER(e_type);
+  ELFXX_ADD_GETTER(e_entry);
+  ELFXX_ADD_GETTER(e_phoff);
+  ELFXX_ADD_GETTER(e_phnum);
+  ELFXX_ADD_GETTER(e_phentsize);
+  ELFXX_ADD_GETTER(e_shnum);
+  ELFXX_ADD_GETTER(e_shstrndx);
+  ELFXX_ADD_GETTER(e_shoff);
+  ELFXX_ADD_GETTER(e_shentsize);
+  ELFXX_ADD_GETTER(e_machine);
+  ELFXX_ADD_GETTER(e_flags);
+};
+
+class ElfXX_Phdr
+    : public ElfXX_Header_Base<const Elf32_Phdr, const Elf64_Phdr> {
+public:
+  ElfXX_Phdr(const Elf32_Phdr *elf32, Endianness endianness)
+      : ElfXX_Header_Base(elf32, endianness) {}
+  ElfXX_Phdr(const Elf64_Phdr *elf64, Endianness endianness)
+      : ElfXX_Header_Base(elf64, endianness) {}
+  ElfXX_Phdr() : ElfXX_Header_Base() {}
+  ElfXX_Phdr(const char *data, bool is64bit, Endianness endianness)
+      : ElfXX_Header_Base(data, is64bit, endianness) {}
+
+  // Add getters using macros
+  ELFXX_ADD_GETTER(p_type);
+  ELFXX_ADD_GETTER(p_offset);
+  ELFXX_ADD_GETTER(p_filesz);
+};
+
+class ElfXX_Shdr
+    : public ElfXX_Header_Base<const Elf32_Shdr, const Elf64_Shdr> {
+public:
+  ElfXX_Shdr(const Elf32_Shdr *elf32, Endianness endianness)
+      : ElfXX_Header_Base(elf32, endianness) {}
+  ElfXX_Shdr(const Elf64_Shdr *elf64, Endianness endianness)
+      : ElfXX_Header_Base(elf64, endianness) {}
+  ElfXX_Shdr() : ElfXX_Header_Base() {}
+
+  // Add getters using macros
+  ELFXX_ADD_GETTER(sh_name);
+  ELFXX_ADD_GETTER(sh_type);
+  ELFXX_ADD_GETTER(sh_flags);
+  ELFXX_ADD_GETTER(sh_offset);
+  ELFXX_ADD_GETTER(sh_size);
+  ELFXX_ADD_GETTER(sh_link);
+  ELFXX_ADD_GETTER(sh_info);
+  ELFXX_ADD_GETTER(sh_addralign);
+  ELFXX_ADD_GETTER(sh_entsize);
+};
+
+class ElfXX_Nhdr
+    : public ElfXX_Header_Base<const Elf32_Nhdr, const Elf64_Nhdr> {
+public:
+  ElfXX_Nhdr(const Elf32_Nhdr *elf32, Endianness endianness)
+      : ElfXX_Header_Base(elf32, endianness) {}
+  ElfXX_Nhdr(const Elf64_Nhdr *elf64, Endianness endianness)
+      : ElfXX_Header_Base(elf64, endianness) {}
+  ElfXX_Nhdr() : ElfXX_Header_Base() {}
+  ElfXX_Nhdr(const char *data, bool is64bit, Endianness endianness)
+      : ElfXX_Header_Base(data, is64bit, endianness) {}
+
+  // Add getters using macros
+  ELFXX_ADD_GETTER(n_type);
+  ELFXX_ADD_GETTER(n_namesz);
+  ELFXX_ADD_GETTER(n_descsz);
+};
+
+class ElfXX_Dyn : public ElfXX_Header_Base<const Elf32_Dyn, const Elf64_Dyn> {
+public:
+  ElfXX_Dyn(const Elf32_Dyn *elf32, Endianness endianness)
+      : ElfXX_Header_Base(elf32, endianness) {}
+  ElfXX_Dyn(const Elf64_Dyn *elf64, Endianness endianness)
+      : ElfXX_Header_Base(elf64, endianness) {}
+  ElfXX_Dyn() : ElfXX_Header_Base() {}
+  ElfXX_Dyn(const char *data, bool is64bit, Endianness endianness)
+      : ElfXX_Header_Base(data, is64bit, endianness) {}
+
+  // Add getters using macros
+  ELFXX_ADD_GETTER(d_tag);
+  ELFXX_ADD_GETTER_INNER(d_val, d_un.d_val);
+  ELFXX_ADD_GETTER_INNER(d_ptr, d_un.d_ptr);
+};
+
+class ElfXX_Sym : public ElfXX_Header_Base<const Elf32_Sym, const Elf64_Sym> {
+public:
+  ElfXX_Sym(const Elf32_Sym *elf32, Endianness endianness)
+      : ElfXX_Header_Base(elf32, endianness) {}
+  ElfXX_Sym(const Elf64_Sym *elf64, Endianness endianness)
+      : ElfXX_Header_Base(elf64, endianness) {}
+  ElfXX_Sym() : ElfXX_Header_Base() {}
+  ElfXX_Sym(const char *data, bool is64bit, Endianness endianness)
+      : ElfXX_Header_Base(data, is64bit, endianness) {}
+
+  // Add getters using macros
+  ELFXX_ADD_GETTER(st_name);
+  ELFXX_ADD_GETTER(st_info);
+  ELFXX_ADD_GETTER(st_shndx);
+};
+
+#undef ELFXX_ADD_GETTER
+#undef ELFXX_ADD_GETTER_INNER
+
+static inline const ElfXX_Shdr get_section_header(const ElfXX_Ehdr &elf_header,
+                                                  const uint32_t index,
+                                                  const char *file_start) {
+  const char *section_header_start =
+      reinterpret_cast<const char *>(file_start) + elf_header.e_shoff();
+  if (elf_header.is_64bit()) {
+    const auto *shdr =
+        &reinterpret_cast<const Elf64_Shdr *>(section_header_start)[index];
+    return {shdr, elf_header.endianness()};
+  } else {
+    const auto *shdr =
+        &reinterpret_cast<const Elf32_Shdr *>(section_header_start)[index];
+    return {shdr, elf_header.endianness()};
+  }
+}
+
+static inline const ElfXX_Phdr get_program_header(const ElfXX_Ehdr &elf_header,
+                                                  const uint32_t index,
+                                                  const char *file_start) {
+  const char *program_header_start = file_start + elf_header.e_phoff() +
+                                     index * elf_header.e_phentsize();
+  return {program_header_start, elf_header.is_64bit(),
+          elf_header.endianness()};
+}
@@ -0,0 +1,107 @@
+#include "abjobserver.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the jobserver this process takes its job slots from
+static int jobserver_fd = -1;
+static std::once_flag jobserver_attached{};
+// the named pipe created by jobserver_create(), and its owner
+static std::string jobserver_path{};
+static pid_t jobserver_owner = 0;
+
+static void jobserver_cleanup() {
+  // forked subshells exit through here as well
+  if (getpid() != jobserver_owner)
+    return;
+  unlink(jobserver_path.c_str());
+  rmdir(jobserver_path.substr(0, jobserver_path.rfind('/')).c_str());
+}
+
+// Joins the jobserver of a parent make, if there is one.
+// Only the named pipe flavour is supported: the file descriptors of the
+// anonymous pipe flavour are not inherited by autobuild reliably.
+static void jobserver_attach() {
+  if (jobserver_fd >= 0)
+    return;
+  const char *makeflags = getenv("MAKEFLAGS");
+  if (!makeflags)
+    return;
+  constexpr std::string_view auth_option = "--jobserver-auth=fifo:";
+  const std::string_view flags{makeflags};
+  // the last option wins, like in make
+  const size_t pos = flags.rfind(auth_option);
+  if (pos == std::string_view::npos)
+    return;
+  const auto path_start = pos + auth_option.size();
+  const std::string path{
+      flags.substr(path_start, flags.find(' ', path_start) - path_start)};
+  jobserver_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+}
+
+bool jobserver_create(const unsigned int jobs, std::string &auth) {
+  const char *tmpdir = getenv("TMPDIR");
+  std::string dir{(tmpdir && *tmpdir) ? tmpdir : "/tmp"};
+  dir += "/abjobserver.XXXXXX";
+  if (!mkdtemp(dir.data()))
+    return false;
+  const std::string path = dir + "/fifo";
+  if (mkfifo(path.c_str(), 0600) != 0) {
+    rmdir(dir.c_str());
+    return false;
+  }
+  // opened for both reading and writing, so that the pipe stays usable
+  // while no client has it open
+  const int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+    return false;
+  }
+  const std::string tokens(jobs > 1 ? jobs - 1 : 0, '+');
+  if (write(fd, tokens.data(), tokens.size()) !=
+      static_cast<ssize_t>(tokens.size())) {
+    close(fd);
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+    return false;
+  }
+
+  if (jobserver_fd >= 0)
+    close(jobserver_fd);
+  jobserver_fd = fd;
+  if (jobserver_path.empty())
+    atexit(jobserver_cleanup);
+  else
+    jobserver_cleanup();
+  jobserver_path = path;
+  jobserver_owner = getpid();
+  auth = "fifo:" + path;
+  return true;
+}
+
+bool jobserver_acquire(char &token) {
+  std::call_once(jobserver_attached, jobserver_attach);
+  if (jobserver_fd < 0)
+    return false;
+  while (true) {
+    const ssize_t bytes = read(jobserver_fd, &token, 1);
+    if (bytes == 1)
+      return true;
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    // the jobserver is gone, run without a limit
+    return false;
+  }
+}
+
+void jobserver_release(const char token) {
+  while (write(jobserver_fd, &token, 1) < 0 && errno == EINTR) {
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Creates a GNU make jobserver (the named pipe flavour of make 4.4) with
+ * the given number of job slots, and makes this process its first client.
+ * One of the slots is the implicit slot of the process that runs the
+ * top-level make, so jobs - 1 tokens are put in the pipe.
+ * The pipe is removed when the creating process exits.
+ * @param auth the value for --jobserver-auth= in MAKEFLAGS
+ * @return false if the pipe could not be created
+ */
+bool jobserver_create(unsigned int jobs, std::string &auth);
+
+/**
+ * Takes a job slot, blocking until one is available.
+ * If this process has no jobserver (it did not create one, and MAKEFLAGS
+ * does not name one), there is no limit and this returns false without
+ * taking anything.
+ * @return true if a token was taken and must be released
+ */
+bool jobserver_acquire(char &token);
+
+/**
+ * Gives a job slot taken with jobserver_acquire() back.
+ */
+void jobserver_release(char token);
+
+/**
+ * Holds a job slot for its lifetime.
+ */
+class JobToken {
+public:
+  explicit JobToken(const bool acquire)
+      : m_token(0), m_held(acquire && jobserver_acquire(m_token)) {}
+  ~JobToken() {
+    if (m_held)
+      jobserver_release(m_token);
+  }
+  JobToken(const JobToken &) = delete;
+  JobToken &operator=(const JobToken &) = delete;
+
+private:
+  char m_token;
+  const bool m_held;
+};
@@ -0,0 +1,199 @@
+#include "ablutindex.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+constexpr char lut_index_magic[8] = {'A', 'B', 'L', 'U', 'T', 'I', 'D', 'X'};
+constexpr uint32_t lut_index_version = 1;
+constexpr size_t lut_index_header_size = 32;
+constexpr size_t lut_index_record_size = 16;
+constexpr size_t lut_index_value_size = 8;
+
+static inline uint32_t read_u32(const char *ptr) {
+  uint32_t value = 0;
+  memcpy(&value, ptr, sizeof(value));
+  return le32toh(value);
+}
+
+static inline uint64_t read_u64(const char *ptr) {
+  uint64_t value = 0;
+  memcpy(&value, ptr, sizeof(value));
+  return le64toh(value);
+}
+
+static inline void append_u32(std::vector<char> &buffer, const uint32_t value) {
+  const uint32_t le_value = htole32(value);
+  const char *ptr = reinterpret_cast<const char *>(&le_value);
+  buffer.insert(buffer.end(), ptr, ptr + sizeof(le_value));
+}
+
+static inline void append_u64(std::vector<char> &buffer, const uint64_t value) {
+  const uint64_t le_value = htole64(value);
+  const char *ptr = reinterpret_cast<const char *>(&le_value);
+  buffer.insert(buffer.end(), ptr, ptr + sizeof(le_value));
+}
+
+static inline bool is_newer(const struct stat &a, const struct stat &b) {
+  if (a.st_mtim.tv_sec != b.st_mtim.tv_sec)
+    return a.st_mtim.tv_sec > b.st_mtim.tv_sec;
+  return a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+}
+
+LutIndex::~LutIndex() {
+  if (m_data)
+    munmap(const_cast<char *>(m_data), m_size);
+}
+
+bool LutIndex::open(const char *index_path, const char *source_path) {
+  const int fd = ::open(index_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat index_st {};
+  struct stat source_st {};
+  if (fstat(fd, &index_st) != 0 || stat(source_path, &source_st) != 0 ||
+      is_newer(source_st, index_st) ||
+      static_cast<size_t>(index_st.st_size) < lut_index_header_size) {
+    close(fd);
+    return false;
+  }
+  const size_t size = index_st.st_size;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+  const char *data = static_cast<const char *>(addr);
+
+  const uint32_t key_count = read_u32(data + 12);
+  const uint32_t value_count = read_u32(data + 16);
+  const uint32_t pool_size = read_u32(data + 20);
+  const uint64_t source_size = read_u64(data + 24);
+  const uint64_t expected_size =
+      lut_index_header_size +
+      static_cast<uint64_t>(key_count) * lut_index_record_size +
+      static_cast<uint64_t>(value_count) * lut_index_value_size + pool_size;
+  if (memcmp(data, lut_index_magic, sizeof(lut_index_magic)) != 0 ||
+      read_u32(data + 8) != lut_index_version || expected_size != size ||
+      source_size != static_cast<uint64_t>(source_st.st_size)) {
+    munmap(addr, size);
+    return false;
+  }
+
+  m_data = data;
+  m_size = size;
+  m_key_count = key_count;
+  m_value_count = value_count;
+  m_pool_size = pool_size;
+  m_records = data + lut_index_header_size;
+  m_values = m_records + key_count * lut_index_record_size;
+  m_pool = m_values + value_count * lut_index_value_size;
+  return true;
+}
+
+std::string_view LutIndex::get_string(const uint32_t offset,
+                                      const uint32_t length) const {
+  if (offset > m_pool_size || length > m_pool_size - offset)
+    return {};
+  return {m_pool + offset, length};
+}
+
+bool LutIndex::find(const std::string_view key, size_t &first,
+                    size_t &count) const {
+  if (!m_data)
+    return false;
+  size_t low = 0;
+  size_t high = m_key_count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    const char *record = m_records + mid * lut_index_record_size;
+    const std::string_view candidate =
+        get_string(read_u32(record), read_u32(record + 4));
+    const int cmp = candidate.compare(key);
+    if (cmp == 0) {
+      first = read_u32(record + 8);
+      count = read_u32(record + 12);
+      return first <= m_value_count && count <= m_value_count - first;
+    }
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return false;
+}
+
+bool LutIndex::get_value(const size_t index, std::string_view &value) const {
+  if (index >= m_value_count)
+    return false;
+  const char *entry = m_values + index * lut_index_value_size;
+  value = get_string(read_u32(entry), read_u32(entry + 4));
+  return true;
+}
+
+bool lut_index_write(const char *index_path, const LutTable &table,
+                     const struct stat &source_st) {
+  std::vector<char> records{};
+  std::vector<char> values{};
+  std::vector<char> pool{};
+  std::unordered_map<std::string_view, uint32_t> pool_offsets{};
+  uint32_t value_count = 0;
+  const auto add_string = [&](const std::string &str, std::vector<char> &out) {
+    const auto search = pool_offsets.find(str);
+    uint32_t offset = 0;
+    if (search != pool_offsets.end()) {
+      offset = search->second;
+    } else {
+      offset = pool.size();
+      pool.insert(pool.end(), str.begin(), str.end());
+      // the strings are owned by the table, which outlives this function
+      pool_offsets.emplace(str, offset);
+    }
+    append_u32(out, offset);
+    append_u32(out, str.size());
+  };
+  for (const auto &[key, key_values] : table) {
+    add_string(key, records);
+    append_u32(records, value_count);
+    append_u32(records, key_values.size());
+    for (const auto &value : key_values)
+      add_string(value, values);
+    value_count += key_values.size();
+  }
+
+  std::vector<char> header(lut_index_magic,
+                           lut_index_magic + sizeof(lut_index_magic));
+  append_u32(header, lut_index_version);
+  append_u32(header, table.size());
+  append_u32(header, value_count);
+  append_u32(header, pool.size());
+  append_u64(header, source_st.st_size);
+
+  const std::string temp_path = std::string{index_path} + ".tmp";
+  const int fd = ::open(temp_path.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  bool success = true;
+  for (const auto *part : {&header, &records, &values, &pool}) {
+    if (!part->empty() &&
+        write(fd, part->data(), part->size()) !=
+            static_cast<ssize_t>(part->size())) {
+      success = false;
+      break;
+    }
+  }
+  const struct timespec times[2] = {source_st.st_mtim, source_st.st_mtim};
+  success = success && futimens(fd, times) == 0;
+  if (close(fd) != 0 || !success ||
+      rename(temp_path.c_str(), index_path) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+
+using LutTable = std::map<std::string, std::set<std::string>>;
+
+/**
+ * A memory-mapped lookup table which maps a key to a list of strings.
+ * The table is a sorted string table generated by build_spiral_index.py
+ * or lut_index_write(), lookups are binary searches on the mapped file
+ * without any parsing or heap allocation.
+ */
+class LutIndex {
+public:
+  LutIndex() = default;
+  ~LutIndex();
+  LutIndex(const LutIndex &) = delete;
+  LutIndex &operator=(const LutIndex &) = delete;
+
+  /**
+   * Maps the index file into memory.
+   * @param index_path path to the index
+   * @param source_path the file the index was generated from, the index is
+   *        rejected if it is older than this file or has a different size
+   * @return false if the index is missing, corrupted or stale
+   */
+  bool open(const char *index_path, const char *source_path);
+  inline bool is_open() const { return m_data != nullptr; }
+
+  /**
+   * Calls callback(std::string_view) for each value of the key.
+   * @return false if the key is not found
+   */
+  template <typename F> bool lookup(std::string_view key, F &&callback) const {
+    size_t first = 0;
+    size_t count = 0;
+    if (!find(key, first, count))
+      return false;
+    for (size_t i = first; i < first + count; i++) {
+      std::string_view value{};
+      if (!get_value(i, value))
+        return false;
+      callback(value);
+    }
+    return true;
+  }
+
+private:
+  bool find(std::string_view key, size_t &first, size_t &count) const;
+  bool get_value(size_t index, std::string_view &value) const;
+  std::string_view get_string(uint32_t offset, uint32_t length) const;
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  const char *m_records = nullptr;
+  const char *m_values = nullptr;
+  const char *m_pool = nullptr;
+  uint32_t m_key_count = 0;
+  uint32_t m_value_count = 0;
+  uint32_t m_pool_size = 0;
+};
+
+/**
+ * Saves a lookup table in the format read by LutIndex.
+ * The index takes the size and the modification time of the source, so
+ * that it becomes stale as soon as the source is modified again.
+ * @param source_st status of the source, taken before reading it
+ * @return false if the index could not be written
+ */
+bool lut_index_write(const char *index_path, const LutTable &table,
+                     const struct stat &source_st);
@@ -0,0 +1,180 @@
+#include "abmanifest.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+struct InodeKey {
+  dev_t dev;
+  ino_t ino;
+  bool operator==(const InodeKey &other) const {
+    return dev == other.dev && ino == other.ino;
+  }
+};
+
+struct InodeKeyHash {
+  size_t operator()(const InodeKey &key) const {
+    return std::hash<uint64_t>{}(key.ino) ^
+           (std::hash<uint64_t>{}(key.dev) << 1);
+  }
+};
+
+std::string read_link_at(const int dirfd, const char *name, size_t size) {
+  // st_size of a symlink is the length of its target, but it may be 0 on
+  // some pseudo file systems
+  std::string target(size > 0 ? size : 256, '\0');
+  while (true) {
+    const ssize_t len = readlinkat(dirfd, name, target.data(), target.size());
+    if (len < 0)
+      return {};
+    if (static_cast<size_t>(len) < target.size()) {
+      target.resize(len);
+      return target;
+    }
+    target.resize(target.size() * 2);
+  }
+}
+
+class ManifestWalker : public ThreadPool<std::string, int> {
+public:
+  explicit ManifestWalker(const int root_fd)
+      : ThreadPool<std::string, int>(
+            [&](const std::string &directory) { return walk(directory); }),
+        m_root_fd(root_fd) {}
+
+  std::vector<ManifestEntry> take_entries() { return std::move(m_entries); }
+
+private:
+  // lists one directory, subdirectories are queued as new tasks
+  int walk(const std::string &directory) {
+    const int fd =
+        openat(m_root_fd, directory.empty() ? "." : directory.c_str() + 1,
+               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+      perror("openat");
+      return -1;
+    }
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+      perror("fdopendir");
+      close(fd);
+      return -1;
+    }
+    std::vector<ManifestEntry> entries{};
+    int ret = 0;
+    while (const struct dirent *dirent = readdir(dir)) {
+      const char *name = dirent->d_name;
+      if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        continue;
+      struct stat st {};
+      if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        perror("fstatat");
+        ret = -1;
+        continue;
+      }
+      ManifestEntry entry{
+          .path = directory + '/' + name,
+          .link_target = {},
+          .mode = st.st_mode,
+          .uid = st.st_uid,
+          .gid = st.st_gid,
+          .rdev = st.st_rdev,
+          .size = static_cast<uint64_t>(st.st_size),
+          .blocks = static_cast<uint64_t>(st.st_blocks),
+          .dev = st.st_dev,
+          .ino = st.st_ino,
+          .nlink = st.st_nlink,
+          .mtime = st.st_mtime,
+      };
+      if (S_ISLNK(st.st_mode)) {
+        entry.link_target = read_link_at(fd, name, st.st_size);
+      } else if (S_ISDIR(st.st_mode)) {
+        enqueue(std::string{entry.path});
+      }
+      entries.emplace_back(std::move(entry));
+    }
+    closedir(dir);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.insert(m_entries.end(), std::make_move_iterator(entries.begin()),
+                     std::make_move_iterator(entries.end()));
+    return ret;
+  }
+
+  const int m_root_fd;
+  std::mutex m_mutex;
+  std::vector<ManifestEntry> m_entries;
+};
+
+} // namespace
+
+int manifest_scan(const std::string &root, Manifest &manifest) {
+  const int root_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd < 0) {
+    perror("open");
+    return -1;
+  }
+  struct stat root_st {};
+  if (fstat(root_fd, &root_st) != 0) {
+    perror("fstat");
+    close(root_fd);
+    return -1;
+  }
+  bool has_error = false;
+  {
+    ManifestWalker walker{root_fd};
+    walker.enqueue(std::string{});
+    walker.wait_for_completion();
+    has_error = walker.has_error();
+    manifest.entries = walker.take_entries();
+  }
+  close(root_fd);
+
+  auto &entries = manifest.entries;
+  std::sort(entries.begin(), entries.end(),
+            [](const ManifestEntry &a, const ManifestEntry &b) {
+              return a.path < b.path;
+            });
+
+  // count each inode once, and point the other links of an inode to the
+  // first one so that they can be archived as hard links
+  std::unordered_map<InodeKey, const std::string *, InodeKeyHash> inodes{};
+  uint64_t blocks = root_st.st_blocks;
+  for (auto &entry : entries) {
+    if (entry.nlink > 1 && !S_ISDIR(entry.mode)) {
+      const auto inserted =
+          inodes.emplace(InodeKey{entry.dev, entry.ino}, &entry.path);
+      if (!inserted.second) {
+        if (!S_ISLNK(entry.mode))
+          entry.link_target = *inserted.first->second;
+        continue;
+      }
+    }
+    blocks += entry.blocks;
+  }
+  // du(1) reports in 1 KiB units, rounded up
+  manifest.installed_size = (blocks * 512 + 1023) / 1024;
+  return has_error ? -1 : 0;
+}
+
+int manifest_write_conffiles(const Manifest &manifest, const char *path) {
+  std::ofstream file(path, std::ios::out | std::ios::trunc);
+  if (!file.is_open())
+    return -1;
+  for (const auto &entry : manifest.entries) {
+    if (S_ISREG(entry.mode) && entry.path.compare(0, 5, "/etc/") == 0)
+      file << entry.path << '\n';
+  }
+  return file.good() ? 0 : -1;
+}
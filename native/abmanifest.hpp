@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+struct ManifestEntry {
+  // path relative to the root, starting with a slash (e.g. /usr/bin/foo)
+  std::string path;
+  // symlink target, or for the hard links after the first one, the path of
+  // the first link (in manifest order) to the same inode
+  std::string link_target;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  // device number of character and block devices
+  dev_t rdev;
+  uint64_t size;
+  // allocated size in 512-byte blocks
+  uint64_t blocks;
+  dev_t dev;
+  ino_t ino;
+  nlink_t nlink;
+  int64_t mtime;
+
+  inline bool is_hardlink() const {
+    return !link_target.empty() && !S_ISLNK(mode);
+  }
+};
+
+struct Manifest {
+  // sorted by path, the root directory itself is not included
+  std::vector<ManifestEntry> entries;
+  // disk usage in KiB, hard links are counted once (same as du -s)
+  uint64_t installed_size;
+};
+
+/**
+ * Walks the directory tree in parallel and collects the metadata of every
+ * file in it. Symlinks are not followed.
+ * @return 0 on success, -1 if a directory could not be read
+ */
+int manifest_scan(const std::string &root, Manifest &manifest);
+
+/**
+ * Writes the regular files under /etc (the conffiles candidates) to a file,
+ * one path per line.
+ */
+int manifest_write_conffiles(const Manifest &manifest, const char *path);
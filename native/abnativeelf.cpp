@@ -1,8 +1,21 @@
 #include "abnativeelf.hpp"
+#include "abarchive.hpp"
+#include "abcompress.hpp"
+#include "abcopy.hpp"
+#include "abelfcache.hpp"
+#include "abelfimage.hpp"
+#include "abelfstrip.hpp"
+#include "aboutput.hpp"
+#include "abelfview.hpp"
 #include "abnativefunctions.h"
+#include "abprobe.hpp"
+#include "abrusage.hpp"
+#include "abtrace.hpp"
 #include "stdwrapper.hpp"
 #include "threadpool.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <cstdarg>
 #include <cstring>
 #include <deque>
@@ -24,17 +37,6 @@
 #define EM_LOONGARCH 258
 #endif // EM_LOONGARCH
 
-// {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'}
-constexpr std::array<uint8_t, 8> ar_magic = {0x21, 0x3C, 0x61, 0x72,
-                                             0x63, 0x68, 0x3E, 0x0A};
-
-// {'!', '<', 't', 'h', 'i', 'n', '>', '\n'}
-constexpr std::array<uint8_t, 8> ar_thin_magic = {0x21, 0x3C, 0x74, 0x68,
-                                                  0x69, 0x6E, 0x3E, 0x0A};
-
-// {'B', 'C', '\xC0', '\xDE'}
-constexpr std::array<uint8_t, 4> llvm_bc_magic = {0x42, 0x43, 0xC0, 0xDE};
-
 // Loongson2F (MIPS-III)
 constexpr uint32_t elf_flags_loongson2f = 0x20000007;
 
@@ -44,253 +46,21 @@ constexpr uint32_t elf_flags_loongson3 = 0x80a20007;
 // MIPS64R6EL
 constexpr uint32_t elf_flags_mips64r6el = 0xa0000407;
 
-constexpr uint32_t elf_min_size = sizeof(Elf32_Ehdr);
-
-enum class Endianness : bool {
-  Little = true,
-  Big = false,
-};
-
-template <typename ElfXX_Off>
-static inline ElfXX_Off get_offset(const ElfXX_Off offset,
-                                   const Endianness endianness) {
-  constexpr size_t size = sizeof(ElfXX_Off);
-  static_assert(size == 2 || size == 4 || size == 8, "Invalid size");
-  if (endianness == Endianness::Little) {
-    switch (size) {
-    case 2:
-      return le16toh(offset);
-    case 4:
-      return le32toh(offset);
-    case 8:
-      return le64toh(offset);
-    }
-  } else {
-    switch (size) {
-    case 2:
-      return be16toh(offset);
-    case 4:
-      return be32toh(offset);
-    case 8:
-      return be64toh(offset);
-    }
-  }
-  // UNREACHABLE
-  __builtin_unreachable();
-}
-
-#define ELFXX_ADD_GETTER_INNER(name, getter)                                   \
-  using ElfXX_##name##_t = decltype(BaseWrapper::elf64->getter);               \
-  inline ElfXX_##name##_t name() const {                                       \
-    if IFCONSTEXPR (sizeof(ElfXX_##name##_t) > 1)                              \
-      return m_is64bit ? get_offset(m_data.elf64->getter, m_endianness)        \
-                       : get_offset(m_data.elf32->getter, m_endianness);       \
-    else                                                                       \
-      return m_is64bit ? m_data.elf64->getter : m_data.elf32->getter;          \
-  }
-
-#define ELFXX_ADD_GETTER(name) ELFXX_ADD_GETTER_INNER(name, name)
-
-template <typename Elf32Type, typename Elf64Type> class ElfXX_Header_Base {
-public:
-  ElfXX_Header_Base(Elf32Type *elf32, Endianness endianness)
-      : m_is64bit(false), m_data({.elf32 = elf32}), m_endianness(endianness) {}
-  ElfXX_Header_Base(Elf64Type *elf64, Endianness endianness)
-      : m_is64bit(true), m_data({.elf64 = elf64}), m_endianness(endianness) {}
-  ElfXX_Header_Base()
-      : m_is64bit(false), m_data({}), m_endianness(Endianness::Little) {}
-  ElfXX_Header_Base(const char *data, bool is64bit, Endianness endianness)
-      : m_is64bit(is64bit), m_endianness(endianness) {
-    if (m_is64bit) {
-      m_data.elf64 = reinterpret_cast<Elf64Type *>(data);
-    } else {
-      m_data.elf32 = reinterpret_cast<Elf32Type *>(data);
-    }
-  }
-  inline bool is_64bit() const { return m_is64bit; }
-  inline Endianness endianness() const { return m_endianness; }
-  inline size_t size() const {
-    return m_is64bit ? sizeof(Elf64Type) : sizeof(Elf32Type);
-  }
-
-protected:
-  union BaseWrapper {
-    const Elf32Type *elf32;
-    const Elf64Type *elf64;
-  };
-
-  bool m_is64bit;
-  BaseWrapper m_data;
-  Endianness m_endianness;
-};
-
-class ElfXX_Ehdr
-    : public ElfXX_Header_Base<const Elf32_Ehdr, const Elf64_Ehdr> {
-public:
-  ElfXX_Ehdr(const Elf32_Ehdr *elf32, Endianness endianness)
-      : ElfXX_Header_Base(elf32, endianness) {}
-  ElfXX_Ehdr(const Elf64_Ehdr *elf64, Endianness endianness)
-      : ElfXX_Header_Base(elf64, endianness) {}
-  ElfXX_Ehdr() : ElfXX_Header_Base() {}
-
-  // Add getters using macros
-  ELFXX_ADD_GETTER(e_type);
-  ELFXX_ADD_GETTER(e_entry);
-  ELFXX_ADD_GETTER(e_shnum);
-  ELFXX_ADD_GETTER(e_shstrndx);
-  ELFXX_ADD_GETTER(e_shoff);
-  ELFXX_ADD_GETTER(e_machine);
-  ELFXX_ADD_GETTER(e_flags);
-};
-
-class ElfXX_Shdr
-    : public ElfXX_Header_Base<const Elf32_Shdr, const Elf64_Shdr> {
-public:
-  ElfXX_Shdr(const Elf32_Shdr *elf32, Endianness endianness)
-      : ElfXX_Header_Base(elf32, endianness) {}
-  ElfXX_Shdr(const Elf64_Shdr *elf64, Endianness endianness)
-      : ElfXX_Header_Base(elf64, endianness) {}
-  ElfXX_Shdr() : ElfXX_Header_Base() {}
-
-  // Add getters using macros
-  ELFXX_ADD_GETTER(sh_name);
-  ELFXX_ADD_GETTER(sh_type);
-  ELFXX_ADD_GETTER(sh_offset);
-  ELFXX_ADD_GETTER(sh_size);
-};
-
-class ElfXX_Nhdr
-    : public ElfXX_Header_Base<const Elf32_Nhdr, const Elf64_Nhdr> {
-public:
-  ElfXX_Nhdr(const Elf32_Nhdr *elf32, Endianness endianness)
-      : ElfXX_Header_Base(elf32, endianness) {}
-  ElfXX_Nhdr(const Elf64_Nhdr *elf64, Endianness endianness)
-      : ElfXX_Header_Base(elf64, endianness) {}
-  ElfXX_Nhdr() : ElfXX_Header_Base() {}
-  ElfXX_Nhdr(const char *data, bool is64bit, Endianness endianness)
-      : ElfXX_Header_Base(data, is64bit, endianness) {}
-
-  // Add getters using macros
-  ELFXX_ADD_GETTER(n_type);
-  ELFXX_ADD_GETTER(n_namesz);
-  ELFXX_ADD_GETTER(n_descsz);
-};
-
-class ElfXX_Dyn : public ElfXX_Header_Base<const Elf32_Dyn, const Elf64_Dyn> {
-public:
-  ElfXX_Dyn(const Elf32_Dyn *elf32, Endianness endianness)
-      : ElfXX_Header_Base(elf32, endianness) {}
-  ElfXX_Dyn(const Elf64_Dyn *elf64, Endianness endianness)
-      : ElfXX_Header_Base(elf64, endianness) {}
-  ElfXX_Dyn() : ElfXX_Header_Base() {}
-  ElfXX_Dyn(const char *data, bool is64bit, Endianness endianness)
-      : ElfXX_Header_Base(data, is64bit, endianness) {}
-
-  // Add getters using macros
-  ELFXX_ADD_GETTER(d_tag);
-  ELFXX_ADD_GETTER_INNER(d_val, d_un.d_val);
-  ELFXX_ADD_GETTER_INNER(d_ptr, d_un.d_ptr);
-};
-
-#undef ELFXX_ADD_GETTER
-#undef ELFXX_ADD_GETTER_INNER
-
-static inline const ElfXX_Shdr get_section_header(const ElfXX_Ehdr &elf_header,
-                                                  const uint32_t index,
-                                                  const char *file_start) {
-  const char *section_header_start =
-      reinterpret_cast<const char *>(file_start) + elf_header.e_shoff();
-  if (elf_header.is_64bit()) {
-    const auto *shdr =
-        &reinterpret_cast<const Elf64_Shdr *>(section_header_start)[index];
-    return {shdr, elf_header.endianness()};
-  } else {
-    const auto *shdr =
-        &reinterpret_cast<const Elf32_Shdr *>(section_header_start)[index];
-    return {shdr, elf_header.endianness()};
-  }
-}
-
-static const ElfXX_Shdr *
-find_elf_section_header(const std::vector<ElfXX_Shdr> &section_headers,
-                        const char *shstrtab,
-                        const char *name,
-                        const uint32_t type) {
-  for (const auto &shdr : section_headers) {
-    const uint32_t sh_type = shdr.sh_type();
-    if (sh_type != type)
-      continue;
-    const uint32_t name_idx = shdr.sh_name();
-    const char *section_name =
-            reinterpret_cast<const char *>(shstrtab + name_idx);
-    if (memcmp(section_name, name, strlen(name)) != 0)
-      continue;
-    return &shdr;
-  }
-  return nullptr;
-}
-
-static const char *
-get_elf_dynstrtab(const char *file_start,
-                  const std::vector<ElfXX_Shdr> &section_headers,
-                  const char *shstrtab) {
-  // constexpr const char *sh_dyn = ".dynamic";
-  constexpr const char *sh_dynstr = ".dynstr";
-  const auto shdr = find_elf_section_header(
-          section_headers, shstrtab, sh_dynstr, SHT_STRTAB);
-  if (shdr != nullptr) {
-    return reinterpret_cast<const char *>(file_start) + shdr->sh_offset();
-  } else {
-    return nullptr;
-  }
-}
-
-static std::vector<const char *>
-get_elf_needed(const char *file_start,
-               const std::vector<ElfXX_Shdr> &section_headers,
-               const char *dynstrtab) {
-  std::vector<const char *> needed{};
-  if (dynstrtab == nullptr)
-    return needed;
-  for (const auto &shdr : section_headers) {
-    const uint32_t type = shdr.sh_type();
-    if (type != SHT_DYNAMIC)
-      continue;
-
-    const char *dyn_start =
-        reinterpret_cast<const char *>(file_start) + shdr.sh_offset();
-    const char *dyn_end = dyn_start + shdr.sh_size();
-    while (dyn_start < dyn_end) {
-      const auto dyn = ElfXX_Dyn{dyn_start, shdr.is_64bit(), shdr.endianness()};
-      if (dyn.d_tag() == DT_NEEDED) {
-        const uint32_t name_idx = dyn.d_val();
-        const char *section_name =
-            reinterpret_cast<const char *>(dynstrtab + name_idx);
-        needed.push_back(section_name);
-      }
-      dyn_start += dyn.size();
-    }
-  }
-  return needed;
-}
-
-static std::string
-get_elf_build_id(const char *file_start,
-                 const std::vector<ElfXX_Shdr> &section_headers,
-                 const char *shstrtab) {
+static std::string get_elf_build_id(const ElfImage &image) {
   constexpr const char table[] = {'0', '1', '2', '3', '4', '5', '6', '7',
                                   '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
   std::string build_id{};
-  constexpr const char *sh_gnu_build_id = ".note.gnu.build-id";
-  // constexpr const char *sh_go_build_id = ".note.go.buildid";
-  const auto section_header = find_elf_section_header(
-          section_headers, shstrtab, sh_gnu_build_id, SHT_NOTE);
-  if (section_header == nullptr)
+  // .note.go.buildid is not used
+  if (!image.has_section(ElfSection::BuildId))
     return build_id;
-  const char *note_start = file_start + section_header->sh_offset();
-  ElfXX_Nhdr note_header = {note_start, section_header->is_64bit(),
-                            section_header->endianness()};
+  const char *note_start = image.section_data(ElfSection::BuildId);
+  const uint64_t note_size = image.section_size(ElfSection::BuildId);
+  ElfXX_Nhdr note_header = {note_start, image.is_64bit(), image.endianness()};
   const size_t header_size = note_header.size();
+  if (note_size < header_size ||
+      note_header.n_namesz() > note_size - header_size ||
+      note_header.n_descsz() > note_size - header_size - note_header.n_namesz())
+    return build_id;
   const unsigned char *value =
       reinterpret_cast<const unsigned char *>(note_start) + header_size +
       note_header.n_namesz();
@@ -333,20 +103,18 @@ is_null_terminated_string(const uint64_t tag) {
 // Ref: ELF for the Arm Architecture - Section 5.3.6
 // Ref: readelf.c from binutils
 static AOSCArch
-get_elf_arm_arch(const char *file_start,
-                 const std::vector<ElfXX_Shdr> &section_headers,
-                 const char *shstrtab) {
-  constexpr const char *sh_abi_tag = ".ARM.attributes";
+get_elf_arm_arch(const ElfImage &image) {
   constexpr const char *vendor_name = "aeabi";
   bool hard_float = false;
   const auto vendor_name_len = strlen(vendor_name);
   auto ret = AOSCArch::NONE;
-  const auto section_header = find_elf_section_header(
-          section_headers, shstrtab, sh_abi_tag, SHT_ARM_ATTRIBUTES);
-  if (section_header == nullptr)
+  if (!image.has_section(ElfSection::ArmAttributes))
+    return ret;
+  const unsigned char *start = reinterpret_cast<const unsigned char *>(
+      image.section_data(ElfSection::ArmAttributes));
+  const auto size = image.section_size(ElfSection::ArmAttributes);
+  if (size == 0)
     return ret;
-  const unsigned char *start = reinterpret_cast<const unsigned char *>(file_start) + section_header->sh_offset();
-  const auto size = section_header->sh_size();
   // Version identifier 'A'
   if (*start != 'A')
     return ret;
@@ -355,7 +123,7 @@ get_elf_arm_arch(const char *file_start,
   // Parse sections
   while (pos < size) {
     uint32_t section_length = *reinterpret_cast<const uint32_t *>(start + pos);
-    if (section_header->endianness() == Endianness::Little) {
+    if (image.endianness() == Endianness::Little) {
       section_length = le32toh(section_length);
     } else {
       section_length = be32toh(section_length);
@@ -432,113 +200,77 @@ get_elf_arm_arch(const char *file_start,
   return ret;
 }
 
-static std::string
-get_elf_soname(const char *file_start,
-               const std::vector<ElfXX_Shdr> &section_headers,
-               const char *dynstrtab) {
-  for (const ElfXX_Shdr &shdr : section_headers) {
-    const uint32_t type = shdr.sh_type();
-    // soname section is a dynamic section
-    if (type != SHT_DYNAMIC) {
-      continue;
+// Classifies the members of a static library: an LTO bitcode member makes the
+// whole library LLVM IR, like a single bitcode file
+static void identify_archive_members(const char *data, const size_t size,
+                                     const char *path, ELFParseResult &result) {
+  ArArchive archive{};
+  if (!archive.parse(data, size))
+    return;
+  if (archive.is_thin()) {
+    // the members are stored next to the library, and stripped on their own
+    if (path == nullptr)
+      return;
+    std::vector<std::string> member_paths{};
+    for (const auto &member : archive.members()) {
+      if (member.kind == ArMemberKind::Regular)
+        member_paths.emplace_back(archive.member_path(member, path));
     }
-    const char *dyn_start =
-            reinterpret_cast<const char *>(file_start) + shdr.sh_offset();
-    const char *dyn_end = dyn_start + shdr.sh_size();
-    while (dyn_start < dyn_end) {
-      const auto dyn = ElfXX_Dyn{dyn_start, shdr.is_64bit(), shdr.endianness()};
-      if (dyn.d_tag() == DT_SONAME) {
-        const uint32_t name_idx = dyn.d_val();
-        const char *section_name =
-                reinterpret_cast<const char *>(dynstrtab + name_idx);
-        return std::string{section_name};
+    for (const auto magic : probe_files(member_paths)) {
+      if (magic == FileMagic::LLVMBitcode) {
+        result.bin_type = BinaryType::LLVM_IR;
+        return;
       }
-      dyn_start += dyn.size();
     }
+    return;
   }
-  return std::string{};
-}
-
-static bool maybe_kernel_object(const std::vector<ElfXX_Shdr> &section_headers,
-                                const char *shstrtab) {
-  constexpr const char *sh_note = ".note.Linux";
-  for (const ElfXX_Shdr &section_header : section_headers) {
-    const uint32_t type = section_header.sh_type();
-    if (type != SHT_NOTE) {
+  thread_local ElfImage image{};
+  thread_local std::vector<uint64_t> buffer{};
+  for (const auto &member : archive.members()) {
+    if (member.kind != ArMemberKind::Regular)
       continue;
-    }
-    const uint32_t name_idx = section_header.sh_name();
-    const char *section_name =
-        reinterpret_cast<const char *>(shstrtab + name_idx);
-    if (memcmp(section_name, sh_note, strlen(sh_note)) == 0) {
-      return true;
-    }
-  }
-  return false;
-}
-
-static inline bool
-is_debug_info_present(const std::vector<ElfXX_Shdr> &section_headers,
-                      const char *shstrtab) {
-  constexpr const char *sh_debug_info = ".debug_";
-  const size_t sh_debug_info_sz = strlen(sh_debug_info);
-  for (const ElfXX_Shdr &section_header : section_headers) {
-    const uint32_t name_idx = section_header.sh_name();
-    const char *section_name =
-        reinterpret_cast<const char *>(shstrtab + name_idx);
-    if (strncmp(section_name, sh_debug_info, sh_debug_info_sz) == 0) {
-      return true;
+    const char *contents = archive.aligned_member_data(member, buffer);
+    switch (classify_magic(contents, member.size)) {
+    case FileMagic::LLVMBitcode:
+      result.bin_type = BinaryType::LLVM_IR;
+      return;
+    case FileMagic::Elf:
+      if (!result.has_debug_info && image.parse(contents, member.size))
+        result.has_debug_info = image.has_debug_info();
+      break;
+    default:
+      break;
     }
   }
-  return false;
 }
 
-static ELFParseResult identify_binary_data(const char *data,
-                                           const size_t size) {
+/**
+ * @param path the path of the file, used to find the members of a thin
+ *        archive, may be nullptr
+ */
+static ELFParseResult identify_binary_data(const char *data, const size_t size,
+                                           const char *path = nullptr) {
   ELFParseResult result{};
-  if (size >= 8 && memcmp(data, ar_magic.data(), ar_magic.size()) == 0) {
-    result.bin_type = BinaryType::Static;
-    return result;
-  } else if (size >= 8 &&
-             memcmp(data, ar_thin_magic.data(), ar_thin_magic.size()) == 0) {
+  switch (classify_magic(data, size)) {
+  case FileMagic::Archive:
     result.bin_type = BinaryType::Static;
+    identify_archive_members(data, size, path, result);
     return result;
-  } else if (size >= 4 &&
-             memcmp(data, llvm_bc_magic.data(), llvm_bc_magic.size()) == 0) {
+  case FileMagic::LLVMBitcode:
     result.bin_type = BinaryType::LLVM_IR;
     return result;
+  default:
+    break;
   }
 
-  // identify ELF files
-  if (size < elf_min_size) {
-    result.bin_type = BinaryType::Invalid;
-    return result;
-  }
-  if (memcmp(data, ELFMAG, SELFMAG) != 0) {
-    result.bin_type = BinaryType::Invalid;
-    return result;
-  }
-
-  ElfXX_Ehdr ehdr{};
-  const char *shstr_start = nullptr;
-  const uint8_t endianness = data[EI_DATA];
-  if (endianness != ELFDATA2LSB && endianness != ELFDATA2MSB) {
+  // identify ELF files, the image is reused by the files of this thread
+  thread_local ElfImage image{};
+  if (!image.parse(data, size)) {
     result.bin_type = BinaryType::Invalid;
     return result;
   }
-  const Endianness endian =
-      (endianness == ELFDATA2LSB ? Endianness::Little : Endianness::Big);
-
-  switch (data[EI_CLASS]) {
-  case ELFCLASS32:
-    ehdr = ElfXX_Ehdr{reinterpret_cast<const Elf32_Ehdr *>(data), endian};
-    break;
-  case ELFCLASS64:
-    ehdr = ElfXX_Ehdr{reinterpret_cast<const Elf64_Ehdr *>(data), endian};
-    break;
-  default:
-    return result;
-  }
+  const ElfXX_Ehdr &ehdr = image.header();
+  const Endianness endian = image.endianness();
 
   const uint16_t e_type = ehdr.e_type();
 
@@ -560,32 +292,24 @@ static ELFParseResult identify_binary_data(const char *data,
   }
 
   result.bin_type = type;
-  if (ehdr.e_shstrndx() == SHN_UNDEF)
+  if (image.section_count() == 0)
     return result;
-  shstr_start = reinterpret_cast<const char *>(
-      data + get_section_header(ehdr, ehdr.e_shstrndx(), data).sh_offset());
-
-  const size_t num_sections = ehdr.e_shnum();
-  std::vector<ElfXX_Shdr> section_headers{};
-  for (uint32_t i = 0; i < num_sections; i++) {
-    ElfXX_Shdr shdr = get_section_header(ehdr, i, data);
-    section_headers.emplace_back(shdr);
-  }
 
   // extract build id and library depends
-  const auto dynstrtab = get_elf_dynstrtab(data, section_headers, shstr_start);
-  const auto build_id = get_elf_build_id(data, section_headers, shstr_start);
-  const auto soname = get_elf_soname(data, section_headers, dynstrtab);
+  result.build_id = get_elf_build_id(image);
+  if (const char *soname = image.soname())
+    result.soname = soname;
   if (type == BinaryType::Relocatable &&
-      maybe_kernel_object(section_headers, shstr_start)) {
+      image.has_section(ElfSection::LinuxNote)) {
     type = BinaryType::KernelObject;
   } else {
-    auto needed = get_elf_needed(data, section_headers, dynstrtab);
-    result.needed_libs = std::move(needed);
+    result.needed_libs.reserve(image.needed_count());
+    for (size_t i = 0; i < image.needed_count(); i++) {
+      if (const char *needed = image.needed(i))
+        result.needed_libs.push_back(needed);
+    }
   }
-  result.build_id = std::move(build_id);
-  result.soname = std::move(soname);
-  result.has_debug_info = is_debug_info_present(section_headers, shstr_start);
+  result.has_debug_info = image.has_debug_info();
 
   // detect architecture
   switch (ehdr.e_machine()) {
@@ -597,7 +321,7 @@ static ELFParseResult identify_binary_data(const char *data,
     break;
   case EM_ARM:
     // Checks .ARM.attributes
-    result.arch = get_elf_arm_arch(data, section_headers, shstr_start);
+    result.arch = get_elf_arm_arch(image);
     break;
   // Assumes EM_386 binaries are always i486-compatible
   case EM_386:
@@ -677,6 +401,16 @@ inline static fs::path get_filename_from_build_id(const std::string &build_id,
   return final_path;
 }
 
+// Where the debug symbols of a file are saved, files without a build id
+// are saved with their name
+static fs::path get_debug_file_path(const char *src_path, const char *dst_path,
+                                    const std::string &build_id,
+                                    const int flags) {
+  if ((flags & AB_ELF_SAVE_WITH_PATH) || build_id.empty())
+    return fs::path{dst_path} / fs::path{src_path}.filename();
+  return get_filename_from_build_id(build_id, dst_path);
+}
+
 class MappedFile {
 public:
   MappedFile(int fd, size_t size) : m_fd{fd}, m_size{size} {
@@ -702,13 +436,29 @@ private:
 };
 
 static inline int forked_execvp(const char *path, char *const argv[]) {
+  // the output of the tool belongs to the task running on this thread
+  auto *task_output = current_task_output();
+  const int output_fd = task_output ? open_spill_file() : -1;
+  TraceScope span{"exec", path};
   const pid_t pid = fork();
   if (pid == 0) {
+    if (output_fd >= 0) {
+      dup2(output_fd, STDOUT_FILENO);
+      dup2(output_fd, STDERR_FILENO);
+    }
     execvp(path, argv);
+    _exit(127);
   }
+  span.set_child_pid(pid);
   // wait for the child process to exit
   int status = 0;
-  waitpid(pid, &status, 0);
+  struct rusage usage {};
+  if (wait4(pid, &status, 0, &usage) == pid)
+    span.set_usage(usage_from_rusage(usage));
+  if (output_fd >= 0) {
+    task_output->append_file(output_fd);
+    close(output_fd);
+  }
   return status;
 }
 
@@ -762,9 +512,44 @@ private:
   int m_fd;
 };
 
+// Records the soname and the libraries needed by the file at src_path
+template <typename Iterator>
+static void elf_collect_names(const char *src_path, const int flags,
+                              const std::string &soname, const AOSCArch arch,
+                              Iterator needed_begin, Iterator needed_end,
+                              GuardedSet<std::string> &symbols,
+                              GuardedSet<std::string> &sonames) {
+  constexpr const char *base_path = "/usr/lib/";
+  constexpr const size_t base_len = sizeof(base_path);
+
+  const std::string filename(basename(src_path));
+  const size_t filename_len = filename.size();
+  const size_t src_len = strlen(src_path);
+  bool in_usr_lib = false;
+  if (src_len >= (base_len + filename_len)) {
+    const int src_offset = src_len - base_len - filename_len - 1;
+    in_usr_lib = (memcmp(src_path + src_offset, base_path, base_len) == 0);
+  }
+  if ((flags & AB_ELF_FIND_SONAMES) && in_usr_lib && (! soname.empty())) {
+    const auto suffixes = aosc_arch_to_debian_arch_suffix(arch);
+    if (suffixes.empty()) {
+      sonames.emplace(soname);
+    } else {
+      for (const auto& suffix : suffixes) {
+        sonames.emplace(fmt::format("{0}:{1}", soname, suffix));
+      }
+    }
+  }
+
+  if (flags & AB_ELF_FIND_SO_DEPS) {
+    symbols.insert(needed_begin, needed_end);
+  }
+}
+
 int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
                            int flags, GuardedSet<std::string> &symbols,
-                           GuardedSet<std::string> &sonames) {
+                           GuardedSet<std::string> &sonames,
+                           ElfCacheEntry *cache_entry) {
   int fd = open(src_path, O_RDONLY, 0);
   if (fd < 0) {
     perror("open");
@@ -784,33 +569,20 @@ int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
   args.reserve(8);
   extra_args.reserve(1);
   const char *data = static_cast<const char *>(file.addr());
-  const ELFParseResult result = identify_binary_data(data, size);
-
-  constexpr const char *base_path = "/usr/lib/";
-  constexpr const size_t base_len = sizeof(base_path);
-
-  const std::string filename(basename(src_path));
-  const size_t filename_len = filename.size();
-  const size_t src_len = strlen(src_path);
-  bool in_usr_lib = false;
-  if (src_len >= (base_len + filename_len)) {
-    const int src_offset = src_len - base_len - filename_len - 1;
-    in_usr_lib = (memcmp(src_path + src_offset, base_path, base_len) == 0);
-  }
-  if ((flags & AB_ELF_FIND_SONAMES) && in_usr_lib && (! result.soname.empty())) {
-    const auto suffixes = aosc_arch_to_debian_arch_suffix(result.arch);
-    if (suffixes.empty()) {
-      sonames.emplace(result.soname);
-    } else {
-      for (const auto& suffix : suffixes) {
-        sonames.emplace(fmt::format("{0}:{1}", result.soname, suffix));
-      }
-    }
-  }
+  const ELFParseResult result = identify_binary_data(data, size, src_path);
 
-  if (flags & AB_ELF_FIND_SO_DEPS) {
-    symbols.insert(result.needed_libs.begin(), result.needed_libs.end());
+  if (cache_entry) {
+    cache_entry->bin_type = result.bin_type;
+    cache_entry->arch = result.arch;
+    cache_entry->has_debug_info = result.has_debug_info;
+    cache_entry->build_id = result.build_id;
+    cache_entry->soname = result.soname;
+    cache_entry->needed_libs.assign(result.needed_libs.begin(),
+                                    result.needed_libs.end());
   }
+  elf_collect_names(src_path, flags, result.soname, result.arch,
+                    result.needed_libs.begin(), result.needed_libs.end(),
+                    symbols, sonames);
 
   if (flags & AB_ELF_CHECK_ONLY)
     return 0;
@@ -828,8 +600,11 @@ int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
     // skip and also notify the caller
     return 1;
   case BinaryType::Static:
-    // skip static library
+    // strip the debug information of each object, like relocatables
     flags |= AB_ELF_STRIP_ONLY;
+    flags &= ~AB_ELF_USE_EU_STRIP;
+    args.emplace_back("--strip-debug");
+    extra_args.emplace_back("--enable-deterministic-archives");
     break;
   case BinaryType::Executable:
     // strip all symbols
@@ -849,8 +624,9 @@ int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
     break;
   }
 
-  get_logger()->info(
-      fmt::format("Saving and stripping debug symbols from {0}", src_path));
+  get_logger()->logLazy(LogLevel::Info, [src_path] {
+    return fmt::format("Saving and stripping debug symbols from {0}", src_path);
+  });
 
   if (!result.has_debug_info) {
     get_logger()->warning(
@@ -861,16 +637,17 @@ int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
   if (result.build_id.empty() && !(flags & AB_ELF_SAVE_WITH_PATH)) {
     // For binaries without build-id, save with path
     flags |= AB_ELF_SAVE_WITH_PATH;
-    get_logger()->warning(fmt::format("No build id found in {0}. Saving with relative path", src_path));
+    if (!(flags & AB_ELF_STRIP_ONLY))
+      get_logger()->warning(fmt::format("No build id found in {0}. Saving with relative path", src_path));
   }
 
 
-  fs::path final_path;
+  const fs::path final_path =
+      get_debug_file_path(src_path, dst_path, result.build_id, flags);
   if (flags & AB_ELF_SAVE_WITH_PATH) {
-    final_path = fs::path{dst_path} / fs::path{src_path}.filename();
-    get_logger()->debug(fmt::format("Saving to {0}", final_path.string()));
-  } else {
-    final_path = get_filename_from_build_id(result.build_id, dst_path);
+    get_logger()->logLazy(LogLevel::Debug, [&final_path] {
+      return fmt::format("Saving to {0}", final_path.string());
+    });
   }
 
   if (!(flags & AB_ELF_STRIP_ONLY)) {
@@ -879,6 +656,37 @@ int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
     fs::create_directories(final_prefix);
   }
 
+  if (!(flags & AB_ELF_USE_EXTERNAL_STRIP) &&
+      (result.bin_type == BinaryType::Executable ||
+       result.bin_type == BinaryType::Dynamic)) {
+    const ElfStripOptions options{
+        result.bin_type == BinaryType::Executable ? ElfStripMode::StripAll
+                                                  : ElfStripMode::StripUnneeded,
+        {".comment", ".note"}};
+    const auto path = final_path.string();
+    const int ret = elf_strip_native(
+        data, size, src_path,
+        (flags & AB_ELF_STRIP_ONLY) ? nullptr : path.c_str(), options);
+    if (ret != AB_ELF_STRIP_UNSUPPORTED)
+      return ret;
+    get_logger()->logLazy(LogLevel::Debug, [src_path] {
+      return fmt::format("Unable to strip {0} natively, using external tools",
+                         src_path);
+    });
+  }
+  if (!(flags & AB_ELF_USE_EXTERNAL_STRIP) &&
+      result.bin_type == BinaryType::Static) {
+    const ElfStripOptions options{ElfStripMode::StripDebug,
+                                  {".comment", ".note"}};
+    const int ret = ar_strip_debug_native(data, size, src_path, options);
+    if (ret != AB_ELF_STRIP_UNSUPPORTED)
+      return ret;
+    get_logger()->logLazy(LogLevel::Debug, [src_path] {
+      return fmt::format("Unable to strip {0} natively, using external tools",
+                         src_path);
+    });
+  }
+
   if (flags & AB_ELF_USE_EU_STRIP) {
     args[0] = "eu-strip";
     if (!(flags & AB_ELF_STRIP_ONLY)) {
@@ -906,13 +714,37 @@ int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
   return forked_execvp("strip", const_cast<char *const *>(args.data()));
 }
 
+BinaryType elf_identify_file(const char *path) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return BinaryType::Invalid;
+  // most files are not binaries, do not map them
+  char header[probe_size];
+  const ssize_t header_size = pread(fd, header, sizeof(header), 0);
+  if (header_size <= 0 ||
+      classify_magic(header, header_size) == FileMagic::Unknown) {
+    close(fd);
+    return BinaryType::Invalid;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return BinaryType::Invalid;
+  }
+  const MappedFile file{fd, static_cast<size_t>(st.st_size)};
+  if (file.addr() == MAP_FAILED)
+    return BinaryType::Invalid;
+  return identify_binary_data(static_cast<const char *>(file.addr()),
+                              file.size())
+      .bin_type;
+}
+
 int elf_copy_to_symdir(const char *src_path, const char *dst_path,
                        const char *build_id) {
   const fs::path final_path = get_filename_from_build_id(build_id, dst_path);
   const fs::path final_prefix = final_path.parent_path();
   fs::create_directories(final_prefix);
-  if (fs::copy_file(src_path, final_path,
-                    fs::copy_options::overwrite_existing)) {
+  if (copy_file_fast(src_path, final_path.string()) != 0) {
     return 127;
   }
   const int ret = chmod(final_path.c_str(), 0644);
@@ -922,14 +754,43 @@ int elf_copy_to_symdir(const char *src_path, const char *dst_path,
   return chown(final_path.c_str(), 0, 0);
 }
 
-class ELFWorkerPool : public ThreadPool<std::string, int> {
+// the index of the file in submission order, and its path
+using ELFTask = std::pair<size_t, std::string>;
+
+class ELFWorkerPool : public ThreadPool<ELFTask, int> {
 public:
-  ELFWorkerPool(std::string  symdir, int flags)
-      : ThreadPool<std::string, int>([&, flags](const std::string& src_path) {
-          return elf_copy_debug_symbols(src_path.c_str(), m_symdir.c_str(),
-                                        flags, m_sodeps, m_sonames);
-        }),
-        m_symdir(std::move(symdir)), m_sodeps(), m_sonames() {}
+  ELFWorkerPool(std::string symdir, int flags, OutputCollector *collector,
+                ElfCache *cache)
+      : ThreadPool<ELFTask, int>(
+            [&, flags](const ELFTask &task) {
+              const auto &src_path = task.second;
+              const auto start = std::chrono::steady_clock::now();
+              std::unique_ptr<TaskOutput> output{};
+              if (m_collector)
+                output = std::make_unique<TaskOutput>();
+              int ret = 0;
+              {
+                const TraceScope span{"elf", src_path};
+                const TaskOutputScope scope{output.get()};
+                ret = process_file(src_path, flags);
+              }
+              if (m_collector)
+                m_collector->complete(task.first, std::move(output));
+              const uint64_t elapsed =
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+              m_busy_us.fetch_add(elapsed);
+              uint64_t longest = m_longest_us.load();
+              while (elapsed > longest &&
+                     !m_longest_us.compare_exchange_weak(longest, elapsed)) {
+              }
+              return ret;
+            },
+            available_concurrency(), TaskOrder::Fifo),
+        m_symdir(std::move(symdir)), m_sodeps(), m_sonames(),
+        m_collector(collector), m_cache(cache), m_cache_hits(0),
+        m_busy_us(0), m_longest_us(0) {}
 
   const std::unordered_set<std::string> get_sodeps() const {
     return m_sodeps.get_set();
@@ -939,28 +800,178 @@ public:
     return m_sonames.get_set();
   }
 
+  // number of files skipped because they are unchanged since the last run
+  size_t cache_hits() const { return m_cache_hits.load(); }
+  // sum of the time spent on every file
+  uint64_t busy_us() const { return m_busy_us.load(); }
+  // time spent on the most expensive file
+  uint64_t longest_us() const { return m_longest_us.load(); }
+
 private:
+  int process_file(const std::string &src_path, const int flags) {
+    struct stat st{};
+    if (!m_cache || stat(src_path.c_str(), &st) != 0) {
+      return elf_copy_debug_symbols(src_path.c_str(), m_symdir.c_str(), flags,
+                                    m_sodeps, m_sonames);
+    }
+    ElfCacheEntry entry{};
+    if (m_cache->lookup(elf_cache_key(st), src_path, flags, entry) &&
+        debug_file_exists(src_path, flags, entry)) {
+      get_logger()->logLazy(LogLevel::Debug, [&src_path] {
+        return fmt::format("{0} is unchanged since the last run", src_path);
+      });
+      elf_collect_names(src_path.c_str(), flags, entry.soname, entry.arch,
+                        entry.needed_libs.begin(), entry.needed_libs.end(),
+                        m_sodeps, m_sonames);
+      m_cache_hits.fetch_add(1);
+      const int status = entry.status;
+      m_cache->record(std::move(entry));
+      return status;
+    }
+    const int ret = elf_copy_debug_symbols(src_path.c_str(), m_symdir.c_str(),
+                                           flags, m_sodeps, m_sonames, &entry);
+    // other errors may go away when the file is processed again,
+    // -3: no debug symbols
+    if ((ret != 0 && ret != -3) || stat(src_path.c_str(), &st) != 0)
+      return ret;
+    // the key of the file as it is now, after stripping
+    entry.key = elf_cache_key(st);
+    entry.path = src_path;
+    entry.flags = flags;
+    entry.status = ret;
+    m_cache->record(std::move(entry));
+    return ret;
+  }
+
+  // whether the debug symbols saved by an earlier run are still in the
+  // symbol directory, which may have been cleaned since
+  bool debug_file_exists(const std::string &src_path, const int flags,
+                         const ElfCacheEntry &entry) const {
+    const bool saved =
+        entry.status == 0 && entry.has_debug_info &&
+        !(flags & AB_ELF_STRIP_ONLY) &&
+        (entry.bin_type == BinaryType::Executable ||
+         entry.bin_type == BinaryType::Dynamic ||
+         entry.bin_type == BinaryType::KernelObject);
+    if (!saved)
+      return true;
+    const auto path = get_debug_file_path(src_path.c_str(), m_symdir.c_str(),
+                                          entry.build_id, flags);
+    if (access(path.c_str(), F_OK) == 0)
+      return true;
+    get_logger()->logLazy(LogLevel::Debug, [&src_path, &path] {
+      return fmt::format("The debug symbols of {0} are missing from {1}",
+                         src_path, path.string());
+    });
+    return false;
+  }
+
   const std::string m_symdir;
   GuardedSet<std::string> m_sodeps;
   GuardedSet<std::string> m_sonames;
+  // collects the output of each file, or nullptr to write it directly
+  OutputCollector *m_collector;
+  // files processed by earlier runs, or nullptr
+  ElfCache *m_cache;
+  std::atomic<size_t> m_cache_hits;
+  std::atomic<uint64_t> m_busy_us;
+  std::atomic<uint64_t> m_longest_us;
 };
 
 int elf_copy_debug_symbols_parallel(const std::vector<std::string> &directories,
                                     const char *dst_path,
                                     std::unordered_set<std::string> &so_deps,
                                     std::unordered_set<std::string> &sonames,
-                                    int flags) {
-  ELFWorkerPool pool{dst_path, flags};
+                                    int flags, OutputOrder output_order,
+                                    const std::string &cache_path,
+                                    DebugCompression debug_compression) {
+  // the file size is used as the cost estimate: start the largest files
+  // first, so that a huge library does not end up as the last task
+  std::vector<std::pair<uintmax_t, std::string>> files{};
+  std::vector<std::string> paths{};
+  std::vector<uintmax_t> sizes{};
   for (const auto &directory : directories) {
     for (const auto &entry : fs::recursive_directory_iterator(directory)) {
       if (entry.is_regular_file() && (!entry.is_symlink())) {
-        // queue the files
-        pool.enqueue(entry.path().string());
+        sizes.emplace_back(entry.file_size());
+        paths.emplace_back(entry.path().string());
       }
     }
   }
-
+  // only read the headers of the files which are not binaries, instead of
+  // locking and mapping them. Unreadable files are kept, so that the error
+  // is reported
+  const auto magics = probe_files(paths);
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (magics[i] != FileMagic::Unknown)
+      files.emplace_back(sizes[i], std::move(paths[i]));
+  }
+  if (files.size() < paths.size()) {
+    get_logger()->debug(fmt::format("Skipped {0} files which are not binaries",
+                                    paths.size() - files.size()));
+  }
+  std::stable_sort(files.begin(), files.end(),
+                   [](const auto &a, const auto &b) { return a.first > b.first; });
+  std::vector<ELFTask> tasks{};
+  tasks.reserve(files.size());
+  for (auto &file : files) {
+    tasks.emplace_back(tasks.size(), std::move(file.second));
+  }
+
+  std::unique_ptr<OutputCollector> collector{};
+  if (output_order != OutputOrder::Direct)
+    collector = std::make_unique<OutputCollector>(get_logger(), tasks.size(),
+                                                  output_order);
+  std::unique_ptr<ElfCache> cache{};
+  if (!cache_path.empty()) {
+    cache = std::make_unique<ElfCache>();
+    // a missing or corrupted cache is the same as an empty one
+    cache->open(cache_path.c_str());
+  }
+  ELFWorkerPool pool{dst_path, flags, collector.get(), cache.get()};
+
+  const auto start = std::chrono::steady_clock::now();
+  pool.enqueue_batch(std::move(tasks));
   pool.wait_for_completion();
+  if (collector)
+    collector->flush();
+  const uint64_t makespan_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  if (!files.empty()) {
+    // no schedule can finish before the busiest file, or before the total
+    // amount of work is evenly spread over all the workers
+    const uint64_t ideal_us = std::max<uint64_t>(
+        pool.busy_us() / pool.thread_count(), pool.longest_us());
+    get_logger()->info(fmt::format(
+        "Processed {0} files in {1:.2f}s using {2} threads (ideal: {3:.2f}s)",
+        files.size(), makespan_us / 1e6, pool.thread_count(),
+        ideal_us / 1e6));
+  }
+  if (cache) {
+    if (pool.cache_hits() > 0) {
+      get_logger()->info(fmt::format(
+          "Skipped {0} files which are unchanged since the last run",
+          pool.cache_hits()));
+    }
+    if (!cache->write(cache_path.c_str())) {
+      get_logger()->warning(
+          fmt::format("Unable to write the ELF cache {0}", cache_path));
+    }
+  }
+
+  bool compress_failed = false;
+  if (debug_compression != DebugCompression::None &&
+      !(flags & (AB_ELF_STRIP_ONLY | AB_ELF_CHECK_ONLY))) {
+    const int ret = compress_debug_files(dst_path, debug_compression);
+    if (ret == AB_COMPRESS_UNSUPPORTED) {
+      get_logger()->warning(
+          "autobuild is built without the compressor, the debug sections "
+          "are saved uncompressed");
+    }
+    compress_failed = ret < 0;
+  }
 
   if (flags & AB_ELF_FIND_SO_DEPS) {
     const auto pool_results = pool.get_sodeps();
@@ -972,6 +983,9 @@ int elf_copy_debug_symbols_parallel(const std::vector<std::string> &directories,
     sonames.insert(sonames_results.begin(), sonames_results.end());
   }
 
+  // the debug symbols could not be compressed as requested
+  if (compress_failed)
+    return -1;
   if (pool.has_error())
     return 1;
 
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "abelfcompress.hpp"
+#include "aboutput.hpp"
+
 #include <cstdint>
 #include <mutex>
 #include <string>
@@ -35,6 +38,8 @@ enum class AOSCArch : uint8_t {
   SPARC64,
 };
 
+struct ElfCacheEntry;
+
 struct ELFParseResult {
   std::vector<const char *> needed_libs;
   std::string build_id;
@@ -69,14 +74,29 @@ constexpr int AB_ELF_FIND_SO_DEPS = 1 << 2;
 constexpr int AB_ELF_CHECK_ONLY = 1 << 3;
 constexpr int AB_ELF_SAVE_WITH_PATH = 1 << 4;
 constexpr int AB_ELF_FIND_SONAMES = 1 << 5;
+constexpr int AB_ELF_USE_EXTERNAL_STRIP = 1 << 6;
 
+// Returns the type of the binary at path, or BinaryType::Invalid if the file
+// is not a binary or can not be read.
+BinaryType elf_identify_file(const char *path);
 int elf_copy_to_symdir(const char *src_path, const char *dst_path,
                        const char *build_id);
+// If cache_entry is not null, what is found out about the file is saved
+// there (everything but the key, path, flags and status).
 int elf_copy_debug_symbols(const char *src_path, const char *dst_path,
                            int flags, GuardedSet<std::string> &symbols,
-                           GuardedSet<std::string> &sonames);
+                           GuardedSet<std::string> &sonames,
+                           ElfCacheEntry *cache_entry = nullptr);
+// If cache_path is not empty, the files which are unchanged since they
+// were processed with the same flags are skipped, see ElfCache.
+// The debug sections of the files saved to dst_path are then compressed
+// with debug_compression, see compress_debug_files. Returns -1 if they
+// could not be compressed, 1 if some of the files could not be processed.
 int elf_copy_debug_symbols_parallel(const std::vector<std::string> &directories,
                                     const char *dst_path,
                                     std::unordered_set<std::string> &so_deps,
                                     std::unordered_set<std::string> &sonames,
-                                    int flags = AB_ELF_USE_EU_STRIP);
+                                    int flags = AB_ELF_USE_EU_STRIP,
+                                    OutputOrder output_order = OutputOrder::Submission,
+                                    const std::string &cache_path = {},
+                                    DebugCompression debug_compression = DebugCompression::None);
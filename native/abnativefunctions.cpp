@@ -1,24 +1,42 @@
 #include "logger.hpp"
 
+#include "abcompress.hpp"
+#include "abconcurrency.hpp"
+#include "abcopy.hpp"
 #include "abconfig.h"
+#include "abdeb.hpp"
+#include "abdpkgdb.hpp"
+#include "abjobserver.hpp"
 #include "abjsondata.hpp"
+#include "abmanifest.hpp"
 #include "abnativeelf.hpp"
 #include "abnativefunctions.h"
+#include "abqa.hpp"
+#include "abrusage.hpp"
+#include "abschedule.hpp"
 #include "abserialize.hpp"
 #include "abspiral.hpp"
+#include "abtrace.hpp"
 #include "bashinterface.hpp"
 #include "pm.hpp"
 #include "stdwrapper.hpp"
 #include "threadpool.hpp"
 
 #include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <poll.h>
 #include <random>
+#include <sstream>
 #include <string>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <unordered_set>
 
@@ -61,16 +79,24 @@ static inline std::string get_all_args(WORD_LIST *list,
     return {};
   std::string args{};
   args.reserve(16);
-  while (list) {
+  for (; list; list = list->next) {
     auto *word = get_argv1(list);
     if (!word)
       continue;
-    int i = 0;
-    int len = 0;
-    args += escape ? ansicstr(word, STRLEN(word), 1, &i, &len) : word;
+    if (escape) {
+      int i = 0;
+      int len = 0;
+      // NULL for an empty word
+      char *escaped = ansicstr(word, STRLEN(word), 1, &i, &len);
+      if (escaped) {
+        args += escaped;
+        free(escaped);
+      }
+    } else {
+      args += word;
+    }
     if (list->next)
       args += " ";
-    list = list->next;
   }
   return args;
 }
@@ -321,28 +347,26 @@ constexpr const char *ab_get_current_architecture() {
   return native_arch_name;
 }
 
-static int abinfo(WORD_LIST *list) {
-  const auto message = get_all_args(list, true);
-  get_logger()->info(message);
+// the arguments are only joined if the level is enabled (see $ABLOGLEVEL)
+static int ab_log_args(const LogLevel level, WORD_LIST *list) {
+  get_logger()->logLazy(level, [list] { return get_all_args(list, true); });
   return 0;
 }
 
+static int abinfo(WORD_LIST *list) {
+  return ab_log_args(LogLevel::Info, list);
+}
+
 static int abwarn(WORD_LIST *list) {
-  const auto message = get_all_args(list, true);
-  get_logger()->warning(message);
-  return 0;
+  return ab_log_args(LogLevel::Warning, list);
 }
 
 static int aberr(WORD_LIST *list) {
-  const auto message = get_all_args(list, true);
-  get_logger()->error(message);
-  return 0;
+  return ab_log_args(LogLevel::Error, list);
 }
 
 static int abdbg(WORD_LIST *list) {
-  const auto message = get_all_args(list, true);
-  get_logger()->debug(message);
-  return 0;
+  return ab_log_args(LogLevel::Debug, list);
 }
 
 static int abdie(WORD_LIST *list) {
@@ -367,6 +391,7 @@ static int abdie(WORD_LIST *list) {
   }
   log->logDiagnostic(diag);
   log->logException(message ? message : std::string());
+  log->flush();
 
   // reset the traps to avoid double-triggering
   autobuild_switch_strict_mode(false);
@@ -374,7 +399,17 @@ static int abdie(WORD_LIST *list) {
   __builtin_unreachable();
 }
 
+static void register_log_level_from_env() {
+  const auto *var = find_variable_tempenv("ABLOGLEVEL");
+  if (!var || !var->value || !*var->value)
+    return;
+  LogLevel level = LogLevel::Debug;
+  if (log_level_from_string(var->value, level))
+    BaseLogger::setLogLevel(level);
+}
+
 static void register_logger_from_env() {
+  register_log_level_from_env();
   const auto *var = find_variable_tempenv("ABREPORTER");
   const auto *no_color_string = getenv("NO_COLOR");
   const bool no_color = no_color_string && no_color_string[0] == '1';
@@ -780,7 +815,7 @@ static int abelf_copy_dbg(WORD_LIST *list) {
   int flags = AB_ELF_FIND_SO_DEPS;
   reset_internal_getopt();
   int opt = 0;
-  while ((opt = internal_getopt(list, const_cast<char *>("exrp"))) != -1) {
+  while ((opt = internal_getopt(list, const_cast<char *>("exrpt"))) != -1) {
     switch (opt) {
       case 'x':
         flags |= AB_ELF_STRIP_ONLY;
@@ -794,6 +829,9 @@ static int abelf_copy_dbg(WORD_LIST *list) {
       case 'p':
         flags |= AB_ELF_SAVE_WITH_PATH;
         break;
+      case 't':
+        flags |= AB_ELF_USE_EXTERNAL_STRIP;
+        break;
       default:
         return 1;
     }
@@ -828,10 +866,15 @@ static void ab_set_to_bash_array(const char *varname, const std::unordered_set<s
 /**
  * Copy debug symbols for all files specified:
  * @param list arguments of the following form:
- *      <-flags> <source directories> <destination directory>
+ *      <-flags> [-c <cache>] [-z <zlib|zstd|none>] <source directories>
+ *      <destination directory>
+ * With -c, the files which are unchanged since they were processed with the
+ * same flags are skipped, their sonames and dependencies are taken from the
+ * cache.
+ * With -z, the debug sections of the saved debug symbols are compressed.
  * @return command status code:
  *       0  - success
- *       1  - invalid flags
+ *       1  - invalid flags or compressor
  *       2  - bad usage, incorrect number of arguments applied
  *      10  - error occurred during processing
  */
@@ -839,11 +882,23 @@ static int abelf_copy_dbg_parallel(WORD_LIST *list) {
   constexpr const char *varname_so_deps = "__AB_SO_DEPS";
   constexpr const char *varname_sonames = "__AB_SONAMES";
   int flags = AB_ELF_FIND_SO_DEPS | AB_ELF_FIND_SONAMES;
+  std::string cache_path{};
+  DebugCompression debug_compression = DebugCompression::None;
 
   reset_internal_getopt();
   int opt = 0;
-  while ((opt = internal_getopt(list, const_cast<char *>("exrp"))) != -1) {
+  while ((opt = internal_getopt(list, const_cast<char *>("exrptc:z:"))) != -1) {
     switch (opt) {
+    case 'c':
+      cache_path = list_optarg;
+      break;
+    case 'z':
+      if (!debug_compression_from_string(list_optarg, debug_compression)) {
+        get_logger()->error(fmt::format(
+            "Unknown debug section compressor: {0}", list_optarg));
+        return 1;
+      }
+      break;
     case 'x':
       flags |= AB_ELF_STRIP_ONLY;
       break;
@@ -856,6 +911,9 @@ static int abelf_copy_dbg_parallel(WORD_LIST *list) {
     case 'p':
       flags |= AB_ELF_SAVE_WITH_PATH;
       break;
+    case 't':
+      flags |= AB_ELF_USE_EXTERNAL_STRIP;
+      break;
     default:
       return 1;
     }
@@ -868,8 +926,11 @@ static int abelf_copy_dbg_parallel(WORD_LIST *list) {
   args.pop_back();
   std::unordered_set<std::string> so_deps{};
   std::unordered_set<std::string> sonames;
-  const int ret =
-      elf_copy_debug_symbols_parallel(args, dst.c_str(), so_deps, sonames, flags);
+  const auto output_order =
+      output_order_from_string(get_string_value("ABOUTPUTORDER"));
+  const int ret = elf_copy_debug_symbols_parallel(
+      args, dst.c_str(), so_deps, sonames, flags, output_order, cache_path,
+      debug_compression);
   if (ret < 0)
     return 10;
   // copy the data to the bash variable
@@ -878,6 +939,37 @@ static int abelf_copy_dbg_parallel(WORD_LIST *list) {
   return 0;
 }
 
+// The path of a package in the /debs archive
+static fs::path aosc_archive_path(const std::string &package_name) {
+  std::string prefix{package_name[0]};
+  if (package_name.size() > 3 && package_name.substr(0, 3) == "lib") {
+    prefix = package_name.substr(0, 4);
+  }
+  fs::path path{"/debs"};
+  path /= prefix;
+  fs::create_directories(path);
+  path /= package_name;
+  return path;
+}
+
+// Copies the packages into the archive, in parallel
+static int aosc_archive_copy(const std::vector<std::string> &packages) {
+  std::vector<std::pair<std::string, std::string>> files{};
+  for (const auto &package : packages)
+    files.emplace_back(package, aosc_archive_path(package).string());
+  const char *archive_link = get_string_value("ABARCHIVELINK");
+  const bool hard_link = archive_link && autobuild_bool(archive_link) == 1;
+  std::vector<int> statuses{};
+  const size_t failed = copy_files_parallel(files, hard_link, &statuses);
+  for (size_t i = 0; i < files.size(); i++) {
+    if (statuses[i] != 0)
+      continue;
+    std::cout << fmt::format("'{0}' -> '{1}'", files[i].first, files[i].second)
+              << std::endl;
+  }
+  return failed ? 10 : 0;
+}
+
 static int abpm_aosc_archive(WORD_LIST *list) {
   const auto *package_name = get_argv1(list);
   if (!package_name)
@@ -895,21 +987,9 @@ static int abpm_aosc_archive(WORD_LIST *list) {
   if (!arch)
     return 1;
 
-  fs::path path{"/debs"};
-  const std::string package_name_str{package_name};
   const std::string package_filename =
       fmt::format("{0}_{1}_{2}_{3}.deb", package_name, version, release, arch);
-  std::string prefix{package_name[0]};
-  if (package_name_str.size() > 3 && package_name_str.substr(0, 3) == "lib") {
-    prefix = package_name_str.substr(0, 4);
-  }
-  path /= prefix;
-  fs::create_directories(path);
-  path /= package_filename;
-  fs::copy(package_filename, path, fs::copy_options::overwrite_existing);
-  std::cout << fmt::format("'{0}' -> '{1}'", package_filename, path.string())
-            << std::endl;
-  return 0;
+  return aosc_archive_copy({package_filename});
 }
 
 static int abpm_aosc_archive_new(WORD_LIST *list) {
@@ -920,24 +1000,13 @@ static int abpm_aosc_archive_new(WORD_LIST *list) {
   if (!packages_v || !(packages_v->attributes & att_array))
     return 1;
   const auto *packages_a = array_cell(packages_v);
+  std::vector<std::string> package_names{};
   for (const ARRAY_ELEMENT *ae = element_forw(packages_a->head);
        ae != packages_a->head; ae = element_forw(ae)) {
     // each element is a package name
-    char *package_name = ae->value;
-    const std::string package_name_str{package_name};
-    std::string prefix{package_name[0]};
-    if (package_name_str.size() > 3 && package_name_str.substr(0, 3) == "lib") {
-      prefix = package_name_str.substr(0, 4);
-    }
-    fs::path path{"/debs"};
-    path /= prefix;
-    fs::create_directories(path);
-    path /= package_name;
-    fs::copy(package_name, path, fs::copy_options::overwrite_existing);
-    std::cout << fmt::format("'{0}' -> '{1}'", package_name, path.string())
-              << std::endl;
+    package_names.emplace_back(ae->value);
   }
-  return 0;
+  return aosc_archive_copy(package_names);
 }
 
 static inline COMMAND *generate_function_call(char *name, char *arg) {
@@ -960,38 +1029,603 @@ static inline COMMAND *generate_function_call(char *name, char *arg) {
   return command;
 }
 
-class ShellThreadPool : public ThreadPool<char *, int> {
-public:
-  explicit ShellThreadPool(char *func_name)
-      : ThreadPool<char *, int>([&](auto arg) {
-          COMMAND *call = generate_function_call(func_name_, arg);
-          return execute_command(call);
-        }),
-        func_name_(func_name) {}
+static bool read_full(const int fd, void *buffer, const size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t bytes =
+        read(fd, static_cast<char *>(buffer) + done, size - done);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes <= 0)
+      return false;
+    done += bytes;
+  }
+  return true;
+}
+
+static bool write_full(const int fd, const void *buffer, const size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t bytes =
+        write(fd, static_cast<const char *>(buffer) + done, size - done);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes <= 0)
+      return false;
+    done += bytes;
+  }
+  return true;
+}
 
-private:
-  char *func_name_;
+struct ParallelTask {
+  SHELL_VAR *func;
+  // the argument passed to the function, if any
+  char *arg;
+  // variables set by the function, which are copied back to the shell
+  std::vector<std::string> exports;
 };
 
+struct ParallelResult {
+  uint32_t index;
+  int32_t status;
+  // size of the captured output following the result
+  uint64_t output_size;
+  // size of the exported variables following the output
+  uint64_t state_size;
+  // size of the trace spans (see abtrace.hpp) following the variables
+  uint64_t trace_size;
+};
+
+/**
+ * Sends the result of a task to the parent, followed by the output it
+ * captured in output_fd (if any), the variables it exported and the spans
+ * it recorded.
+ */
+static bool abpp_report(const int result_fd, const uint32_t index,
+                        const int status, const int output_fd,
+                        const std::string &state) {
+  const auto trace = trace_capture_take();
+  ParallelResult result{index, status, 0, state.size(), trace.size()};
+  if (output_fd >= 0) {
+    const off_t size = lseek(output_fd, 0, SEEK_END);
+    result.output_size = size > 0 ? size : 0;
+    lseek(output_fd, 0, SEEK_SET);
+  }
+  if (!write_full(result_fd, &result, sizeof(result)))
+    return false;
+  char buffer[65536];
+  uint64_t remaining = result.output_size;
+  while (remaining > 0) {
+    const ssize_t bytes =
+        read(output_fd, buffer, std::min<uint64_t>(sizeof(buffer), remaining));
+    if (bytes <= 0) {
+      // the parent expects exactly output_size bytes
+      memset(buffer, 0, sizeof(buffer));
+      const size_t padding = std::min<uint64_t>(sizeof(buffer), remaining);
+      if (!write_full(result_fd, buffer, padding))
+        return false;
+      remaining -= padding;
+      continue;
+    }
+    if (!write_full(result_fd, buffer, bytes))
+      return false;
+    remaining -= bytes;
+  }
+  return write_full(result_fd, state.data(), state.size()) &&
+         write_full(result_fd, trace.data(), trace.size());
+}
+
+// Records the span of a task run by a worker, with the resources it used
+// if they were measured
+static void abpp_trace_task(const ParallelTask &task, const char *category,
+                            const uint64_t start, ResourceMeter *meter) {
+  std::string name{task.func->name};
+  if (task.arg)
+    name = fmt::format("{0} {1}", name, task.arg);
+  const auto usage = meter ? meter->stop() : ResourceUsage{};
+  trace_record(TraceSpan{std::move(name), category, start,
+                         trace_clock() - start, getpid(), getpid(), 0,
+                         usage});
+}
+
+/**
+ * The main loop of a forked worker: takes task indices from the task pipe
+ * until it is closed, and reports the exit code of each task. If output_fd
+ * is valid, the output of each task is captured in it and sent along.
+ * Each task is traced as a span of the given category, with the resources
+ * it used if measure is set.
+ */
+[[noreturn]] static void abpp_worker(const std::vector<ParallelTask> &tasks,
+                                     const char *category, const bool measure,
+                                     const int task_fd, const int result_fd,
+                                     const int output_fd) {
+  volatile uint32_t current = UINT32_MAX;
+  volatile uint64_t start = 0;
+  // static, as it is used after the jump back to the top level
+  static std::unique_ptr<ResourceMeter> meter{};
+  trace_capture_begin();
+  const int saved_stdout = output_fd >= 0 ? dup(STDOUT_FILENO) : -1;
+  const int saved_stderr = output_fd >= 0 ? dup(STDERR_FILENO) : -1;
+  // exit (e.g. from abdie) and errexit jump back to the top level, which
+  // is here in the worker: the task failed, and this worker is done
+  if (setjmp_nosigs(top_level)) {
+    const int status = last_command_exit_value ? last_command_exit_value : 1;
+    fflush(stdout);
+    fflush(stderr);
+    if (current != UINT32_MAX) {
+      abpp_trace_task(tasks[current], category, start, meter.get());
+      abpp_report(result_fd, current, status, output_fd, {});
+    }
+    // _exit skips the flush at exit
+    LogWriter::instance().flush();
+    _exit(status);
+  }
+  uint32_t index = 0;
+  while (read_full(task_fd, &index, sizeof(index))) {
+    current = index;
+    start = trace_clock();
+    if (measure)
+      meter = std::make_unique<ResourceMeter>();
+    if (output_fd >= 0) {
+      ftruncate(output_fd, 0);
+      lseek(output_fd, 0, SEEK_SET);
+      dup2(output_fd, STDOUT_FILENO);
+      dup2(output_fd, STDERR_FILENO);
+    }
+    const auto &task = tasks[index];
+    WORD_LIST *arg_list =
+        task.arg ? make_word_list(make_word(task.arg), nullptr) : nullptr;
+    const int status = execute_shell_function(task.func, arg_list);
+    if (arg_list)
+      dispose_words(arg_list);
+    fflush(stdout);
+    fflush(stderr);
+    abpp_trace_task(task, category, start, meter.get());
+    if (output_fd >= 0) {
+      dup2(saved_stdout, STDOUT_FILENO);
+      dup2(saved_stderr, STDERR_FILENO);
+    }
+    const auto state = task.exports.empty()
+                           ? std::string{}
+                           : autobuild_serialized_variables(task.exports);
+    if (!abpp_report(result_fd, index, status, output_fd, state))
+      break;
+  }
+  LogWriter::instance().flush();
+  _exit(0);
+}
+
+/**
+ * Reads one result (the captured output, and the exported variables) from
+ * a worker. index is set to the task that has finished, if any.
+ * @return false once the worker has exited
+ */
+static bool abpp_collect(const int result_fd, std::vector<int> &statuses,
+                         OutputCollector *collector, uint32_t &index) {
+  ParallelResult result{};
+  if (!read_full(result_fd, &result, sizeof(result)))
+    return false;
+  auto output = std::make_unique<TaskOutput>();
+  char buffer[65536];
+  uint64_t remaining = result.output_size;
+  // the output is split at line ends, so that the records logged by the
+  // worker are replayed whole
+  std::string partial_line{};
+  while (remaining > 0) {
+    const size_t chunk = std::min<uint64_t>(sizeof(buffer), remaining);
+    if (!read_full(result_fd, buffer, chunk))
+      return false;
+    partial_line.append(buffer, chunk);
+    const size_t end = partial_line.rfind('\n');
+    if (end != std::string::npos) {
+      output->append_raw(partial_line.data(), end + 1);
+      partial_line.erase(0, end + 1);
+    }
+    remaining -= chunk;
+  }
+  output->append_raw(partial_line.data(), partial_line.size());
+  std::string state(result.state_size, '\0');
+  if (!read_full(result_fd, state.data(), state.size()))
+    return false;
+  std::string trace(result.trace_size, '\0');
+  if (!read_full(result_fd, trace.data(), trace.size()))
+    return false;
+  if (!trace.empty())
+    trace_import(trace);
+  if (result.index >= statuses.size())
+    return true;
+  index = result.index;
+  statuses[result.index] = result.status;
+  if (!state.empty() && autobuild_restore_variables(state) != 0)
+    get_logger()->warning("Unable to restore the variables set by a task");
+  if (collector)
+    collector->complete(result.index, std::move(output));
+  return true;
+}
+
+/**
+ * Feeds the tasks to the workers and collects their exit codes (and their
+ * output). The task pipe may fill up before the workers are done with the
+ * results, so all the pipes are polled. With a schedule, a task is only
+ * queued once the tasks it depends on have succeeded.
+ */
+static void abpp_dispatch(const int task_fd, const std::vector<int> &result_fds,
+                          std::vector<int> &statuses,
+                          OutputCollector *collector, TaskSchedule *schedule) {
+  std::vector<uint32_t> queue{};
+  if (schedule) {
+    for (const auto index : schedule->take_ready())
+      queue.push_back(index);
+  } else {
+    for (uint32_t i = 0; i < statuses.size(); i++)
+      queue.push_back(i);
+  }
+  size_t next_task = 0;
+  // tasks queued, but not reported yet
+  size_t running = 0;
+  int write_fd = task_fd;
+  fcntl(task_fd, F_SETFL, fcntl(task_fd, F_GETFL) | O_NONBLOCK);
+  std::vector<struct pollfd> fds{};
+  for (const int fd : result_fds)
+    fds.push_back({fd, POLLIN, 0});
+  while (!fds.empty()) {
+    // all tasks are queued (or none of the remaining tasks can be started),
+    // let the workers exit once the queue is empty
+    if (write_fd >= 0 && next_task == queue.size() &&
+        (!schedule || schedule->all_taken() || running == 0)) {
+      close(write_fd);
+      write_fd = -1;
+    }
+    const bool feeding = write_fd >= 0 && next_task < queue.size();
+    if (feeding)
+      fds.push_back({write_fd, POLLOUT, 0});
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (feeding)
+        fds.pop_back();
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (feeding) {
+      const auto revents = fds.back().revents;
+      fds.pop_back();
+      if (revents & (POLLOUT | POLLERR)) {
+        while (next_task < queue.size()) {
+          if (write(write_fd, &queue[next_task], sizeof(uint32_t)) < 0)
+            break;
+          next_task++;
+          running++;
+        }
+        // no worker is left
+        if (next_task < queue.size() && errno == EPIPE) {
+          close(write_fd);
+          write_fd = -1;
+        }
+      }
+    }
+    for (auto it = fds.begin(); it != fds.end();) {
+      if (!(it->revents & (POLLIN | POLLHUP | POLLERR))) {
+        ++it;
+        continue;
+      }
+      uint32_t index = UINT32_MAX;
+      if (!abpp_collect(it->fd, statuses, collector, index)) {
+        // EOF: the worker has exited
+        it = fds.erase(it);
+        continue;
+      }
+      ++it;
+      if (index == UINT32_MAX)
+        continue;
+      running--;
+      if (schedule && statuses[index] == 0) {
+        schedule->complete(index);
+        for (const auto ready : schedule->take_ready())
+          queue.push_back(ready);
+      }
+    }
+  }
+  if (write_fd >= 0)
+    close(write_fd);
+}
+
+/**
+ * Runs the tasks in forked copies of the shell, see abpp_parallelize.
+ * The exit code of each task is saved to statuses (255 if it never ran).
+ * @return 0 if the tasks were run, 10 if no worker could be started
+ */
+static int abpp_run(const std::vector<ParallelTask> &tasks, unsigned int jobs,
+                    const char *category, const bool measure,
+                    TaskSchedule *schedule, std::vector<int> &statuses) {
+  if (jobs == 0) {
+    const char *threads = get_string_value("ABTHREADS");
+    jobs = threads ? std::max(std::atoi(threads), 1) : available_concurrency();
+  }
+  jobs = std::min<size_t>(jobs, std::max<size_t>(tasks.size(), 1));
+  const auto output_order =
+      output_order_from_string(get_string_value("ABOUTPUTORDER"));
+
+  // tasks that are never reported have not been run
+  statuses.assign(tasks.size(), 255);
+  int task_pipe[2] = {-1, -1};
+  if (pipe2(task_pipe, O_CLOEXEC) != 0) {
+    perror("pipe2");
+    return 10;
+  }
+  // bash reaps any child on SIGCHLD, so it is blocked until the workers
+  // have been waited for
+  sigset_t sigchld_mask{};
+  sigset_t old_mask{};
+  sigemptyset(&sigchld_mask);
+  sigaddset(&sigchld_mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &sigchld_mask, &old_mask);
+  // do not let the workers inherit unflushed output
+  fflush(stdout);
+  fflush(stderr);
+  std::cout.flush();
+  std::vector<pid_t> workers{};
+  std::vector<int> result_fds{};
+  for (unsigned int i = 0; i < jobs; i++) {
+    int result_pipe[2] = {-1, -1};
+    if (pipe2(result_pipe, O_CLOEXEC) != 0) {
+      perror("pipe2");
+      break;
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+      sigprocmask(SIG_SETMASK, &old_mask, nullptr);
+      close(task_pipe[1]);
+      close(result_pipe[0]);
+      for (const int fd : result_fds)
+        close(fd);
+      const int output_fd =
+          output_order == OutputOrder::Direct ? -1 : open_spill_file();
+      abpp_worker(tasks, category, measure, task_pipe[0], result_pipe[1],
+                  output_fd);
+    }
+    close(result_pipe[1]);
+    if (pid < 0) {
+      perror("fork");
+      close(result_pipe[0]);
+      break;
+    }
+    workers.push_back(pid);
+    result_fds.push_back(result_pipe[0]);
+  }
+  close(task_pipe[0]);
+
+  if (workers.empty()) {
+    close(task_pipe[1]);
+  } else {
+    std::unique_ptr<OutputCollector> collector{};
+    if (output_order != OutputOrder::Direct)
+      collector = std::make_unique<OutputCollector>(get_logger(), tasks.size(),
+                                                    output_order);
+    // if every worker crashes, writing to the task pipe fails with EPIPE
+    // instead of killing the shell
+    struct sigaction ignore_action {};
+    struct sigaction old_action {};
+    ignore_action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore_action, &old_action);
+    abpp_dispatch(task_pipe[1], result_fds, statuses, collector.get(),
+                  schedule);
+    sigaction(SIGPIPE, &old_action, nullptr);
+  }
+  for (const int fd : result_fds)
+    close(fd);
+  for (const auto pid : workers) {
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {
+    }
+  }
+  sigprocmask(SIG_SETMASK, &old_mask, nullptr);
+  return workers.empty() ? 10 : 0;
+}
+
+static int abpp_finish(const char *status_varname,
+                       const std::vector<int> &statuses) {
+  if (status_varname) {
+    auto *status_a =
+        array_cell(make_new_array_variable(const_cast<char *>(status_varname)));
+    for (const auto status : statuses)
+      bash_array_push(status_a,
+                      const_cast<char *>(std::to_string(status).c_str()));
+  }
+  for (const auto status : statuses) {
+    if (status != 0)
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * Run a shell function for each argument, in forked copies of the shell:
+ * @param list arguments of the following form:
+ *      [-j <number of workers>] [-v <variable name>] [-t <category>] [-u]
+ *      <function> <args...>
+ * The number of workers defaults to $ABTHREADS. The workers take the
+ * arguments from a pipe, so that long tasks do not hold up the others.
+ * Changes made by the function to the shell state are not kept. With -v,
+ * the exit code of each task is saved to an indexed array, in the order
+ * of the arguments (tasks which never ran due to a crashed worker get 255).
+ * The output of each task is captured and printed as a whole, in the order
+ * set by $ABOUTPUTORDER (see aboutput.hpp). Each task is traced as a span
+ * of the category given by -t ("task" by default), see abtrace.hpp. With
+ * -u, the resources used by each task are measured and logged.
+ * @return command status code:
+ *       0  - success
+ *       1  - one of the tasks failed, or invalid flags
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred while starting the workers
+ */
 static int abpp_parallelize(WORD_LIST *list) {
+  unsigned int jobs = 0;
+  const char *status_varname = nullptr;
+  const char *category = "task";
+  bool measure = false;
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(list, const_cast<char *>("j:v:t:u"))) != -1) {
+    switch (opt) {
+    case 'j':
+      jobs = std::max(std::atoi(list_optarg), 1);
+      break;
+    case 'v':
+      status_varname = list_optarg;
+      break;
+    case 't':
+      category = list_optarg;
+      break;
+    case 'u':
+      measure = true;
+      break;
+    default:
+      return 1;
+    }
+  }
+  list = loptend;
   auto *src = get_argv1(list);
   if (!src)
-    return 1;
+    return EX_BADUSAGE;
   SHELL_VAR *var = find_function(src);
   if (!var || !(var->attributes & att_function)) {
     return 1;
   }
-  // protect the variable from being unset
-  var->attributes |= (att_nounset | att_readonly);
-  ShellThreadPool thread_pool(src);
+  std::vector<ParallelTask> tasks{};
   for (list = list->next; list; list = list->next) {
-    thread_pool.enqueue(get_argv1(list));
+    tasks.push_back({var, get_argv1(list), {}});
   }
+  std::vector<int> statuses{};
+  if (abpp_run(tasks, jobs, category, measure, nullptr, statuses) != 0)
+    return 10;
+  return abpp_finish(status_varname, statuses);
+}
 
-  if (thread_pool.has_error())
-    return 1;
+// Returns the lines of array_name[key], if array_name is an associative array
+static std::vector<std::string> get_assoc_lines(const char *array_name,
+                                                const char *key) {
+  std::vector<std::string> lines{};
+  if (!array_name)
+    return lines;
+  const auto *array_var = find_variable(array_name);
+  if (!array_var || !(array_var->attributes & att_assoc))
+    return lines;
+  const auto *elem = hash_search(key, assoc_cell(array_var), 0);
+  if (!elem || !elem->data)
+    return lines;
+  std::string line{};
+  std::istringstream stream{static_cast<char *>(elem->data)};
+  while (std::getline(stream, line)) {
+    if (!line.empty())
+      lines.emplace_back(std::move(line));
+  }
+  return lines;
+}
 
-  return 0;
+/**
+ * Run shell functions in forked copies of the shell, concurrently when
+ * they do not depend on each other:
+ * @param list arguments of the following form:
+ *      [-j <number of workers>] [-v <variable name>] [-t <category>] [-u]
+ *      [-r <reads>] [-w <writes>] [-a <after>] [-o <exports>]
+ *      [-l <variable name>] <functions...>
+ * -r, -w, -a and -o name associative arrays, keyed by function name, which
+ * list (one per line) the paths each function reads and writes, the
+ * functions it has to run after, and the variables it sets for the rest
+ * of the build. Functions run in the order they are given, except that
+ * functions which neither conflict on a path nor have to run after one
+ * another run concurrently (see abschedule.hpp). A function without any
+ * path never runs alongside another one. The variables listed in -o are
+ * copied back to the shell once the function has finished; other changes
+ * to the shell state are not kept. If a function fails, the functions
+ * which have to run after it are not started. -j, -v, -t and -u are the
+ * same as in abpp_parallelize. With -l, nothing is run: the functions are
+ * saved to an indexed array in the order to run them in one at a time.
+ * @return command status code:
+ *       0  - success
+ *       1  - one of the functions failed, or invalid flags
+ *       2  - bad usage, unknown function or cyclic ordering constraints
+ *      10  - error occurred while starting the workers
+ */
+static int abpp_schedule(WORD_LIST *list) {
+  unsigned int jobs = 0;
+  const char *status_varname = nullptr;
+  const char *reads_varname = nullptr;
+  const char *writes_varname = nullptr;
+  const char *after_varname = nullptr;
+  const char *exports_varname = nullptr;
+  const char *order_varname = nullptr;
+  const char *category = "task";
+  bool measure = false;
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(
+              list, const_cast<char *>("j:v:t:ur:w:a:o:l:"))) != -1) {
+    switch (opt) {
+    case 'j':
+      jobs = std::max(std::atoi(list_optarg), 1);
+      break;
+    case 'v':
+      status_varname = list_optarg;
+      break;
+    case 't':
+      category = list_optarg;
+      break;
+    case 'u':
+      measure = true;
+      break;
+    case 'r':
+      reads_varname = list_optarg;
+      break;
+    case 'w':
+      writes_varname = list_optarg;
+      break;
+    case 'a':
+      after_varname = list_optarg;
+      break;
+    case 'o':
+      exports_varname = list_optarg;
+      break;
+    case 'l':
+      order_varname = list_optarg;
+      break;
+    default:
+      return 1;
+    }
+  }
+  std::vector<ParallelTask> tasks{};
+  std::vector<ScheduledTask> scheduled{};
+  for (list = loptend; list; list = list->next) {
+    const char *name = get_argv1(list);
+    SHELL_VAR *var = find_function(name);
+    if (!var || !(var->attributes & att_function)) {
+      get_logger()->error(fmt::format("{0} is not a function", name));
+      return EX_BADUSAGE;
+    }
+    tasks.push_back({var, nullptr, get_assoc_lines(exports_varname, name)});
+    scheduled.push_back({
+        .name = name,
+        .reads = get_assoc_lines(reads_varname, name),
+        .writes = get_assoc_lines(writes_varname, name),
+        .after = get_assoc_lines(after_varname, name),
+    });
+  }
+  TaskSchedule schedule{};
+  if (!schedule.build(scheduled)) {
+    get_logger()->error("The functions have cyclic ordering constraints");
+    return EX_BADUSAGE;
+  }
+  if (order_varname) {
+    auto *order_a =
+        array_cell(make_new_array_variable(const_cast<char *>(order_varname)));
+    for (const auto index : schedule.serial_order())
+      bash_array_push(order_a,
+                      const_cast<char *>(scheduled[index].name.c_str()));
+    return 0;
+  }
+  std::vector<int> statuses{};
+  if (abpp_run(tasks, jobs, category, measure, &schedule, statuses) != 0)
+    return 10;
+  return abpp_finish(status_varname, statuses);
 }
 
 static std::mutex ab_gil{};
@@ -1353,6 +1987,386 @@ static int abspiral_from_sonames(WORD_LIST *list) {
   return 0;
 }
 
+/**
+ * Walk a directory once and record its manifest:
+ * @param list arguments of the following form:
+ *      [-c <conffiles output>] [-v <variable prefix>] <directory>
+ * The manifest is saved to the following variables (the prefix defaults to
+ * __AB_MANIFEST): <prefix>_PATHS, <prefix>_MODES (octal), <prefix>_SIZES,
+ * <prefix>_TARGETS (symlink targets, or the first path of a hard link group)
+ * and <prefix>_INSTALLED_SIZE (in KiB, same as du -s).
+ * @return command status code:
+ *       0  - success
+ *       1  - invalid flags
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred during processing
+ */
+static int abmanifest(WORD_LIST *list) {
+  const char *conffiles_path = nullptr;
+  std::string prefix{"__AB_MANIFEST"};
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(list, const_cast<char *>("c:v:"))) != -1) {
+    switch (opt) {
+    case 'c':
+      conffiles_path = list_optarg;
+      break;
+    case 'v':
+      prefix = list_optarg;
+      break;
+    default:
+      return 1;
+    }
+  }
+  const auto *directory = get_argv1(loptend);
+  if (!directory)
+    return EX_BADUSAGE;
+
+  Manifest manifest{};
+  if (manifest_scan(directory, manifest) != 0) {
+    get_logger()->error(fmt::format("Unable to walk through {0}", directory));
+    return 10;
+  }
+  if (conffiles_path &&
+      manifest_write_conffiles(manifest, conffiles_path) != 0) {
+    get_logger()->error(fmt::format("Unable to write {0}", conffiles_path));
+    return 10;
+  }
+
+  auto *paths_a =
+      array_cell(make_new_array_variable(const_cast<char *>((prefix + "_PATHS").c_str())));
+  auto *modes_a =
+      array_cell(make_new_array_variable(const_cast<char *>((prefix + "_MODES").c_str())));
+  auto *sizes_a =
+      array_cell(make_new_array_variable(const_cast<char *>((prefix + "_SIZES").c_str())));
+  auto *targets_a =
+      array_cell(make_new_array_variable(const_cast<char *>((prefix + "_TARGETS").c_str())));
+  for (const auto &entry : manifest.entries) {
+    bash_array_push(paths_a, const_cast<char *>(entry.path.c_str()));
+    bash_array_push(modes_a,
+                    const_cast<char *>(fmt::format("{0:o}", entry.mode).c_str()));
+    bash_array_push(sizes_a,
+                    const_cast<char *>(std::to_string(entry.size).c_str()));
+    bash_array_push(targets_a, const_cast<char *>(entry.link_target.c_str()));
+  }
+  const auto installed_size = std::to_string(manifest.installed_size);
+  if (!bind_variable((prefix + "_INSTALLED_SIZE").c_str(),
+                     const_cast<char *>(installed_size.c_str()), ASS_FORCE))
+    return EX_BADASSIGN;
+  return 0;
+}
+
+/**
+ * Run the post-build QA checks on the package directory:
+ * @param list arguments of the following form:
+ *      <package directory> <error log> <warning log>
+ * The issues found are appended to the error and the warning log.
+ * @return command status code:
+ *       0  - success
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred during processing
+ */
+static int abqa_post_build(WORD_LIST *list) {
+  const auto args = get_all_args_vector(list);
+  if (args.size() != 3)
+    return EX_BADUSAGE;
+  std::vector<QAIssue> issues{};
+  if (qa_post_build_check(args[0], issues) != 0) {
+    get_logger()->error(fmt::format("Unable to walk through {0}", args[0]));
+    return 10;
+  }
+  for (const auto &issue : issues) {
+    std::string paths{};
+    for (const auto &path : issue.paths) {
+      paths += path;
+      paths += '\n';
+    }
+    const auto message = fmt::format("QA ({0}): {1}:\n\n{2}", issue.code,
+                                     issue.message, paths);
+    const bool is_error = issue.severity == QASeverity::Error;
+    if (is_error)
+      get_logger()->error(message);
+    else
+      get_logger()->warning(message);
+    std::ofstream log(is_error ? args[1] : args[2], std::ios::app);
+    log << message;
+    if (!log.good())
+      return 10;
+  }
+  return 0;
+}
+
+/**
+ * Look up the installed versions of packages in the dpkg status database:
+ * @param list arguments of the following form:
+ *      <variable name> <package names...>
+ * The versions are saved to an indexed array, in the same order as the
+ * package names. Packages that are not installed get an empty version.
+ * @return command status code:
+ *       0  - success
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred during processing
+ */
+static int abpm_dpkg_getver(WORD_LIST *list) {
+  // the index is kept for the whole build and reloaded when dpkg changes it
+  static DpkgStatusIndex status_index{};
+  const auto args = get_all_args_vector(list);
+  if (args.empty())
+    return EX_BADUSAGE;
+  const auto status_path = dpkg_status_path();
+  if (!status_index.refresh(status_path)) {
+    get_logger()->error(fmt::format("Unable to read {0}", status_path));
+    return 10;
+  }
+  auto *versions_a =
+      array_cell(make_new_array_variable(const_cast<char *>(args[0].c_str())));
+  for (size_t i = 1; i < args.size(); i++) {
+    const std::string version{status_index.get_version(args[i])};
+    bash_array_push(versions_a, const_cast<char *>(version.c_str()));
+  }
+  return 0;
+}
+
+/**
+ * Find the packages owning the given files (like dpkg -S):
+ * @param list arguments of the following form:
+ *      [-c <index cache>] <variable name> <paths or file names...>
+ * The package names are saved to an indexed array, sorted and deduplicated.
+ * @return command status code:
+ *       0  - success
+ *       1  - invalid flags
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred during processing
+ */
+static int abpm_dpkg_owners(WORD_LIST *list) {
+  std::string cache_path{};
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(list, const_cast<char *>("c:"))) != -1) {
+    switch (opt) {
+    case 'c':
+      cache_path = list_optarg;
+      break;
+    default:
+      return 1;
+    }
+  }
+  auto args = get_all_args_vector(loptend);
+  if (args.empty())
+    return EX_BADUSAGE;
+  const std::string varname = args.front();
+  args.erase(args.begin());
+
+  std::set<std::string> packages{};
+  if (dpkg_find_file_owners(cache_path, args, packages) != 0) {
+    get_logger()->error("Unable to read the dpkg database");
+    return 10;
+  }
+  auto *packages_a =
+      array_cell(make_new_array_variable(const_cast<char *>(varname.c_str())));
+  for (const auto &package : packages)
+    bash_array_push(packages_a, const_cast<char *>(package.c_str()));
+  return 0;
+}
+
+/**
+ * Detect how many jobs may run in parallel, honouring the CPU affinity and
+ * the cgroup CPU and memory limits:
+ * @param list arguments of the following form:
+ *      [-m <MiB of memory per job>] <variable name>
+ * The number of jobs is saved to the variable. The CPUs in the affinity
+ * mask, the cgroup CPU quota (0 if unlimited) and the memory limit (in
+ * MiB) are saved to <variable>_CPUS, <variable>_QUOTA and <variable>_MEMORY.
+ * @return command status code:
+ *       0  - success
+ *       1  - invalid flags
+ *       2  - bad usage, incorrect number of arguments applied
+ */
+static int abconcurrency_probe(WORD_LIST *list) {
+  uint64_t memory_per_job = 0;
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(list, const_cast<char *>("m:"))) != -1) {
+    switch (opt) {
+    case 'm':
+      memory_per_job = std::strtoull(list_optarg, nullptr, 10) << 20;
+      break;
+    default:
+      return 1;
+    }
+  }
+  const auto *varname = get_argv1(loptend);
+  if (!varname)
+    return EX_BADUSAGE;
+
+  const auto limits = concurrency_probe(memory_per_job);
+  const std::string prefix{varname};
+  const std::pair<std::string, std::string> values[] = {
+      {prefix, std::to_string(limits.jobs)},
+      {prefix + "_CPUS", std::to_string(limits.affinity_cpus)},
+      {prefix + "_QUOTA", fmt::format("{0:.2f}", limits.cpu_quota)},
+      {prefix + "_MEMORY", std::to_string(limits.memory_limit >> 20)},
+  };
+  for (const auto &[name, value] : values) {
+    if (!bind_variable(name.c_str(), const_cast<char *>(value.c_str()),
+                       ASS_FORCE))
+      return EX_BADASSIGN;
+  }
+  return 0;
+}
+
+/**
+ * Start a GNU make jobserver shared by the build and the native workers:
+ * @param list arguments of the following form:
+ *      <number of jobs>
+ * The value for --jobserver-auth= is saved to __AB_JOBSERVER_AUTH.
+ * @return command status code:
+ *       0  - success
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred during processing
+ */
+static int abjobserver_start(WORD_LIST *list) {
+  const auto *jobs_arg = get_argv1(list);
+  if (!jobs_arg)
+    return EX_BADUSAGE;
+  const int jobs = std::atoi(jobs_arg);
+  if (jobs < 1)
+    return EX_BADUSAGE;
+  std::string auth{};
+  if (!jobserver_create(jobs, auth)) {
+    get_logger()->error("Unable to create the jobserver");
+    return 10;
+  }
+  if (!bind_variable("__AB_JOBSERVER_AUTH", const_cast<char *>(auth.c_str()),
+                     ASS_FORCE))
+    return EX_BADASSIGN;
+  return 0;
+}
+
+/**
+ * Open a span of the build profile (see abtrace.hpp), spans may nest:
+ * @param list arguments of the following form:
+ *      [-u] <category> <name>
+ * With -u, the resources used until the span is closed are measured (see
+ * abrusage.hpp), logged and saved to $ABUSAGEFILE.
+ * @return command status code:
+ *       0  - success
+ *       1  - invalid flags
+ *       2  - bad usage, incorrect number of arguments applied
+ */
+static int abtrace_begin(WORD_LIST *list) {
+  bool measure = false;
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(list, const_cast<char *>("u"))) != -1) {
+    switch (opt) {
+    case 'u':
+      measure = true;
+      break;
+    default:
+      return 1;
+    }
+  }
+  list = loptend;
+  const char *category = get_argv1(list);
+  const char *name = list ? get_argv1(list->next) : nullptr;
+  if (!category || !name)
+    return EX_BADUSAGE;
+  trace_begin(category, name, measure);
+  return 0;
+}
+
+/**
+ * Close the span opened last by abtrace_begin:
+ * @return command status code:
+ *       0  - success
+ *       1  - no span is open
+ */
+static int abtrace_end(WORD_LIST *) { return trace_end() ? 0 : 1; }
+
+/**
+ * Build a binary package from a directory (like dpkg-deb -Zzstd -b):
+ * @param list arguments of the following form:
+ *      [-z <zstd level>] [-j <threads>] <package directory> <output file>
+ * @return command status code:
+ *       0  - success
+ *       1  - invalid flags
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred during processing
+ *     127  - autobuild is built without the native .deb writer
+ */
+static int abpm_deb_build(WORD_LIST *list) {
+  DebBuildOptions options{3, 0};
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(list, const_cast<char *>("z:j:"))) != -1) {
+    switch (opt) {
+    case 'z':
+      options.level = std::atoi(list_optarg);
+      break;
+    case 'j':
+      options.threads = std::max(std::atoi(list_optarg), 0);
+      break;
+    default:
+      return 1;
+    }
+  }
+  const auto args = get_all_args_vector(loptend);
+  if (args.size() != 2)
+    return EX_BADUSAGE;
+
+  const int ret = deb_build(args[0], args[1], options);
+  if (ret == AB_DEB_UNSUPPORTED)
+    return AB_DEB_UNSUPPORTED;
+  if (ret != 0) {
+    get_logger()->error(
+        fmt::format("Unable to build {0} from {1}", args[1], args[0]));
+    return 10;
+  }
+  return 0;
+}
+
+/**
+ * Compress man or info pages in place, and point the symlinks to them to
+ * the compressed pages (see abcompress.hpp):
+ * @param list arguments of the following form:
+ *      [-f <xz|zstd>] <package directory> <pages...>
+ * @return command status code:
+ *       0  - success
+ *       1  - invalid flags or compressor
+ *       2  - bad usage, incorrect number of arguments applied
+ *      10  - error occurred during processing
+ *     127  - autobuild is built without the compressor
+ */
+static int abfilter_compress_pages(WORD_LIST *list) {
+  PageCompressor compressor = PageCompressor::Xz;
+  reset_internal_getopt();
+  int opt = 0;
+  while ((opt = internal_getopt(list, const_cast<char *>("f:"))) != -1) {
+    switch (opt) {
+    case 'f':
+      if (!page_compressor_from_string(list_optarg, compressor)) {
+        get_logger()->error(
+            fmt::format("Unknown page compressor: {0}", list_optarg));
+        return 1;
+      }
+      break;
+    default:
+      return 1;
+    }
+  }
+  auto args = get_all_args_vector(loptend);
+  if (args.empty())
+    return EX_BADUSAGE;
+  const auto root = std::string{args.front()};
+  args.erase(args.begin());
+
+  const int ret = compress_pages(root, args, compressor);
+  if (ret == AB_COMPRESS_UNSUPPORTED)
+    return AB_COMPRESS_UNSUPPORTED;
+  return ret == 0 ? 0 : 10;
+}
+
 extern "C" {
 void register_all_native_functions() {
   if (set_registered_flag())
@@ -1392,8 +2406,12 @@ void register_all_native_functions() {
       {"abelf_copy_dbg_parallel", abelf_copy_dbg_parallel},
       {"abpm_aosc_archive", abpm_aosc_archive_new},
       {"abpm_debver", abpm_genver},
+      {"abpm_dpkg_getver", abpm_dpkg_getver},
+      {"abpm_dpkg_owners", abpm_dpkg_owners},
       {"abpm_dump_builddep_req", abpm_dump_builddep_req},
       {"abpp_parallelize", abpp_parallelize},
+      {"abpp_schedule", abpp_schedule},
+      {"abfilter_compress_pages", abfilter_compress_pages},
       {"abpp_gil", abpp_gil},
       {"abfp_lambda", abfp_lambda},
       {"abfp_lambda_restore", abfp_lambda_restore},
@@ -1401,7 +2419,14 @@ void register_all_native_functions() {
       {"abmm_array_mine_remove", abmm_array_mine_remove},
       {"ab_get_item_by_key", ab_get_item_by_key},
       {"abjson_get_item", abjson_get_item},
-      {"abspiral_from_sonames", abspiral_from_sonames}};
+      {"abspiral_from_sonames", abspiral_from_sonames},
+      {"abmanifest", abmanifest},
+      {"abqa_post_build", abqa_post_build},
+      {"abpm_deb_build", abpm_deb_build},
+      {"abjobserver_start", abjobserver_start},
+      {"abconcurrency_probe", abconcurrency_probe},
+      {"abtrace_begin", abtrace_begin},
+      {"abtrace_end", abtrace_end}};
 
   // Initialize logger
   if (!logger)
@@ -1428,8 +2453,31 @@ int register_builtin_variables() {
   return 0;
 }
 
+// The process which writes the build profile, forked shells do not
+static pid_t trace_owner = 0;
+
+static void write_build_trace() {
+  if (getpid() != trace_owner)
+    return;
+  const char *path = get_string_value("ABTRACEFILE");
+  if (path && *path && !trace_write(path))
+    get_logger()->warning(fmt::format(
+        "Unable to write the build profile to {0}: {1}", path, strerror(errno)));
+  const char *usage_path = get_string_value("ABUSAGEFILE");
+  if (usage_path && *usage_path &&
+      !usage_write_summary(usage_path, trace_spans()))
+    get_logger()->warning(
+        fmt::format("Unable to write the resource usage to {0}: {1}",
+                    usage_path, strerror(errno)));
+}
+
 int start_proc_00() {
   autobuild_switch_strict_mode(true);
+  // the build may end anywhere (e.g. abdie), so the trace is written at exit
+  if (!trace_owner) {
+    trace_owner = getpid();
+    atexit(write_build_trace);
+  }
   const std::string self_path = get_self_path() + "/proc";
   return autobuild_load_all_from_directory(self_path.c_str());
 }
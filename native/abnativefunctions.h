@@ -15,8 +15,13 @@ int dump_defines();
 #ifdef __cplusplus
 } // extern "C"
 
+#include "aboutput.hpp"
 #include "logger.hpp"
 static inline BaseLogger *get_logger() {
+  // the output of parallel tasks is captured, see aboutput.hpp
+  auto *task_output = current_task_output();
+  if (task_output)
+    return task_output;
   return reinterpret_cast<BaseLogger *>(logger);
 }
 #endif
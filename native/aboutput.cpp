@@ -0,0 +1,213 @@
+#include "aboutput.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// the output of a task is moved to a temporary file beyond this size
+constexpr size_t task_output_memory_limit = 256 * 1024;
+// record types besides the log levels
+constexpr uint8_t record_raw = 0xff;
+constexpr size_t record_header_size = 5;
+
+static thread_local TaskOutput *tl_task_output = nullptr;
+
+static bool write_all(const int fd, const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+static bool read_full(const int fd, char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t bytes = read(fd, data, size);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes <= 0)
+      return false;
+    data += bytes;
+    size -= bytes;
+  }
+  return true;
+}
+
+OutputOrder output_order_from_string(const char *value) {
+  if (!value)
+    return OutputOrder::Submission;
+  if (strcmp(value, "completion") == 0)
+    return OutputOrder::Completion;
+  if (strcmp(value, "direct") == 0)
+    return OutputOrder::Direct;
+  return OutputOrder::Submission;
+}
+
+int open_spill_file() {
+  const char *tmpdir = getenv("TMPDIR");
+  if (!tmpdir || !*tmpdir)
+    tmpdir = "/tmp";
+  const int fd = open(tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd >= 0)
+    return fd;
+  // the file system does not support O_TMPFILE
+  std::string path{tmpdir};
+  path += "/aboutput.XXXXXX";
+  const int temp_fd = mkostemp(path.data(), O_CLOEXEC);
+  if (temp_fd >= 0)
+    unlink(path.c_str());
+  return temp_fd;
+}
+
+TaskOutput::~TaskOutput() {
+  if (m_spill_fd >= 0)
+    close(m_spill_fd);
+}
+
+void TaskOutput::append_record(const uint8_t type, const char *data,
+                               const size_t size) {
+  char header[record_header_size];
+  const uint32_t length = size;
+  header[0] = static_cast<char>(type);
+  memcpy(header + 1, &length, sizeof(length));
+  if (m_spill_fd < 0 &&
+      m_buffer.size() + sizeof(header) + size > task_output_memory_limit) {
+    m_spill_fd = open_spill_file();
+    if (m_spill_fd >= 0 &&
+        !write_all(m_spill_fd, m_buffer.data(), m_buffer.size())) {
+      close(m_spill_fd);
+      m_spill_fd = -1;
+    }
+    if (m_spill_fd >= 0)
+      m_buffer.clear();
+  }
+  if (m_spill_fd >= 0 && write_all(m_spill_fd, header, sizeof(header)) &&
+      write_all(m_spill_fd, data, size))
+    return;
+  // keep everything in memory if the file can not be written
+  m_buffer.append(header, sizeof(header));
+  m_buffer.append(data, size);
+}
+
+void TaskOutput::log(const LogLevel lvl, const std::string message) {
+  append_record(static_cast<uint8_t>(lvl), message.data(), message.size());
+}
+
+void TaskOutput::logOutput(const std::string output) {
+  append_raw(output.data(), output.size());
+}
+
+void TaskOutput::logDiagnostic(Diagnostic diagnostic) {
+  std::string message = "Command exited with " +
+                        std::to_string(diagnostic.code) + ".";
+  for (const auto &frame : diagnostic.frames) {
+    message += "\n  at " + frame.function + " (" + frame.file + ":" +
+               std::to_string(frame.line) + ")";
+  }
+  log(LogLevel::Error, message);
+}
+
+void TaskOutput::logException(const std::string message) {
+  log(LogLevel::Critical, message);
+}
+
+void TaskOutput::append_raw(const char *data, const size_t size) {
+  if (size > 0)
+    append_record(record_raw, data, size);
+}
+
+void TaskOutput::append_file(const int fd) {
+  char buffer[65536];
+  if (lseek(fd, 0, SEEK_SET) < 0)
+    return;
+  while (true) {
+    const ssize_t bytes = read(fd, buffer, sizeof(buffer));
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes <= 0)
+      break;
+    append_raw(buffer, bytes);
+  }
+}
+
+static void replay_record(BaseLogger &logger, const uint8_t type,
+                          std::string payload) {
+  if (type == record_raw)
+    logger.logOutput(std::move(payload));
+  else
+    logger.log(static_cast<LogLevel>(type), std::move(payload));
+}
+
+void TaskOutput::replay(BaseLogger &logger) const {
+  if (m_spill_fd >= 0 && lseek(m_spill_fd, 0, SEEK_SET) == 0) {
+    char header[record_header_size];
+    while (read_full(m_spill_fd, header, sizeof(header))) {
+      uint32_t length = 0;
+      memcpy(&length, header + 1, sizeof(length));
+      std::string payload(length, '\0');
+      if (!read_full(m_spill_fd, payload.data(), length))
+        break;
+      replay_record(logger, header[0], std::move(payload));
+    }
+  }
+  size_t pos = 0;
+  while (pos + record_header_size <= m_buffer.size()) {
+    uint32_t length = 0;
+    memcpy(&length, m_buffer.data() + pos + 1, sizeof(length));
+    replay_record(logger, m_buffer[pos],
+                  m_buffer.substr(pos + record_header_size, length));
+    pos += record_header_size + length;
+  }
+}
+
+TaskOutput *current_task_output() { return tl_task_output; }
+
+TaskOutputScope::TaskOutputScope(TaskOutput *output)
+    : m_previous(tl_task_output) {
+  tl_task_output = output;
+}
+
+TaskOutputScope::~TaskOutputScope() { tl_task_output = m_previous; }
+
+OutputCollector::OutputCollector(BaseLogger *logger, const size_t task_count,
+                                 const OutputOrder order)
+    : m_logger(logger), m_order(order), m_done(task_count),
+      m_completed(task_count, false), m_next(0) {}
+
+void OutputCollector::complete(const size_t index,
+                               std::unique_ptr<TaskOutput> output) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index >= m_done.size())
+    return;
+  m_completed[index] = true;
+  if (m_order != OutputOrder::Submission) {
+    if (output)
+      output->replay(*m_logger);
+    return;
+  }
+  m_done[index] = std::move(output);
+  // flush the finished tasks at the front
+  while (m_next < m_done.size() && m_completed[m_next]) {
+    if (m_done[m_next])
+      m_done[m_next]->replay(*m_logger);
+    m_done[m_next].reset();
+    m_next++;
+  }
+}
+
+void OutputCollector::flush() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (; m_next < m_done.size(); m_next++) {
+    if (m_done[m_next])
+      m_done[m_next]->replay(*m_logger);
+    m_done[m_next].reset();
+  }
+}
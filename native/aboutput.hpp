@@ -0,0 +1,106 @@
+#pragma once
+
+#include "logger.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class OutputOrder : uint8_t {
+  // nothing is captured, tasks write straight to the terminal
+  Direct,
+  // the output of each task is flushed in the order the tasks were submitted
+  Submission,
+  // the output of each task is flushed as soon as the task is finished
+  Completion,
+};
+
+/**
+ * Parses $ABOUTPUTORDER ("submission", "completion" or "direct").
+ * Submission order is used if the value is empty or unknown.
+ */
+OutputOrder output_order_from_string(const char *value);
+
+/**
+ * Opens an anonymous temporary file in $TMPDIR.
+ * @return the file descriptor, or -1 on failure
+ */
+int open_spill_file();
+
+/**
+ * The captured output of one task: log messages and raw output (e.g. from
+ * child processes), in the order they were produced. The output is kept in
+ * memory, and moved to a temporary file once it grows too large.
+ * While a TaskOutputScope is active, get_logger() returns the TaskOutput of
+ * the current thread.
+ */
+class TaskOutput final : public BaseLogger {
+public:
+  TaskOutput() = default;
+  ~TaskOutput() override;
+  TaskOutput(const TaskOutput &) = delete;
+  TaskOutput &operator=(const TaskOutput &) = delete;
+
+  void log(LogLevel lvl, std::string message) override;
+  void logOutput(std::string output) override;
+  void logDiagnostic(Diagnostic diagnostic) override;
+  void logException(std::string message) override;
+  const char *loggerName() override { return "TaskOutput"; }
+
+  void append_raw(const char *data, size_t size);
+  // appends everything written to a file (from the beginning)
+  void append_file(int fd);
+  // sends the captured output to another logger
+  void replay(BaseLogger &logger) const;
+  inline bool empty() const { return m_buffer.empty() && m_spill_fd < 0; }
+
+private:
+  void append_record(uint8_t type, const char *data, size_t size);
+
+  std::string m_buffer{};
+  int m_spill_fd = -1;
+};
+
+// Returns the TaskOutput of the current thread, if any
+TaskOutput *current_task_output();
+
+/**
+ * Captures the output of the current thread for its lifetime.
+ */
+class TaskOutputScope {
+public:
+  explicit TaskOutputScope(TaskOutput *output);
+  ~TaskOutputScope();
+  TaskOutputScope(const TaskOutputScope &) = delete;
+  TaskOutputScope &operator=(const TaskOutputScope &) = delete;
+
+private:
+  TaskOutput *m_previous;
+};
+
+/**
+ * Collects the output of finished tasks and flushes each task as a whole,
+ * either in submission order (holding back the tasks that finish early) or
+ * in completion order. Thread-safe.
+ */
+class OutputCollector {
+public:
+  OutputCollector(BaseLogger *logger, size_t task_count, OutputOrder order);
+  ~OutputCollector() { flush(); }
+  OutputCollector(const OutputCollector &) = delete;
+  OutputCollector &operator=(const OutputCollector &) = delete;
+
+  void complete(size_t index, std::unique_ptr<TaskOutput> output);
+  // flushes the tasks held back by tasks that never completed
+  void flush();
+
+private:
+  BaseLogger *m_logger;
+  const OutputOrder m_order;
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<TaskOutput>> m_done;
+  std::vector<bool> m_completed;
+  size_t m_next;
+};
@@ -0,0 +1,154 @@
+#include "abprobe.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAS_LIBURING
+#include <liburing.h>
+#endif
+
+namespace {
+
+// {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'}
+constexpr std::array<uint8_t, 8> ar_magic = {0x21, 0x3C, 0x61, 0x72,
+                                             0x63, 0x68, 0x3E, 0x0A};
+
+// {'!', '<', 't', 'h', 'i', 'n', '>', '\n'}
+constexpr std::array<uint8_t, 8> ar_thin_magic = {0x21, 0x3C, 0x74, 0x68,
+                                                  0x69, 0x6E, 0x3E, 0x0A};
+
+// {'B', 'C', '\xC0', '\xDE'}
+constexpr std::array<uint8_t, 4> llvm_bc_magic = {0x42, 0x43, 0xC0, 0xDE};
+
+// the number of files which are open at the same time
+constexpr size_t batch_size = 256;
+
+struct Probe {
+  int fd;
+  ssize_t length;
+  char data[probe_size];
+};
+
+template <size_t N>
+inline bool starts_with(const char *data, const size_t size,
+                        const std::array<uint8_t, N> &magic) {
+  return size >= N && memcmp(data, magic.data(), N) == 0;
+}
+
+ssize_t pread_probe(const int fd, char *buffer) {
+  while (true) {
+    const ssize_t length = pread(fd, buffer, probe_size, 0);
+    if (length >= 0 || errno != EINTR)
+      return length;
+  }
+}
+
+#ifdef HAS_LIBURING
+class ProbeRing {
+public:
+  ProbeRing() : m_ring(), m_ready(false) {
+    m_ready = io_uring_queue_init(batch_size, &m_ring, 0) == 0;
+  }
+  ~ProbeRing() {
+    if (m_ready)
+      io_uring_queue_exit(&m_ring);
+  }
+  ProbeRing(const ProbeRing &) = delete;
+  ProbeRing &operator=(const ProbeRing &) = delete;
+  // io_uring may be missing in the kernel, or forbidden by seccomp
+  inline bool ready() const { return m_ready; }
+
+  // Reads the probes of the batch, @return false if io_uring failed
+  bool read(Probe *probes, const size_t count) {
+    unsigned int submitted = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (probes[i].fd < 0)
+        continue;
+      io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+      if (sqe == nullptr)
+        return false;
+      io_uring_prep_read(sqe, probes[i].fd, probes[i].data, probe_size, 0);
+      io_uring_sqe_set_data(sqe, &probes[i]);
+      submitted++;
+    }
+    if (submitted == 0)
+      return true;
+    if (io_uring_submit_and_wait(&m_ring, submitted) < 0)
+      return false;
+    for (unsigned int done = 0; done < submitted; done++) {
+      io_uring_cqe *cqe = nullptr;
+      if (io_uring_wait_cqe(&m_ring, &cqe) < 0)
+        return false;
+      auto *probe = static_cast<Probe *>(io_uring_cqe_get_data(cqe));
+      probe->length = cqe->res;
+      io_uring_cqe_seen(&m_ring, cqe);
+      // a failed read is retried with pread, which sets errno
+      if (probe->length < 0)
+        probe->length = pread_probe(probe->fd, probe->data);
+    }
+    return true;
+  }
+
+private:
+  io_uring m_ring;
+  bool m_ready;
+};
+#endif
+
+} // namespace
+
+FileMagic classify_magic(const char *data, const size_t size) {
+  if (size >= EI_NIDENT && memcmp(data, ELFMAG, SELFMAG) == 0) {
+    const bool valid_class =
+        data[EI_CLASS] == ELFCLASS32 || data[EI_CLASS] == ELFCLASS64;
+    const bool valid_order =
+        data[EI_DATA] == ELFDATA2LSB || data[EI_DATA] == ELFDATA2MSB;
+    return (valid_class && valid_order) ? FileMagic::Elf : FileMagic::Unknown;
+  }
+  if (starts_with(data, size, ar_magic) ||
+      starts_with(data, size, ar_thin_magic))
+    return FileMagic::Archive;
+  if (starts_with(data, size, llvm_bc_magic))
+    return FileMagic::LLVMBitcode;
+  return FileMagic::Unknown;
+}
+
+std::vector<FileMagic> probe_files(const std::vector<std::string> &paths) {
+  std::vector<FileMagic> results(paths.size(), FileMagic::Unreadable);
+  std::vector<Probe> probes(std::min(paths.size(), batch_size));
+#ifdef HAS_LIBURING
+  ProbeRing ring{};
+  bool use_ring = ring.ready();
+#endif
+  for (size_t first = 0; first < paths.size(); first += batch_size) {
+    const size_t count = std::min(batch_size, paths.size() - first);
+    for (size_t i = 0; i < count; i++) {
+      probes[i].fd = open(paths[first + i].c_str(), O_RDONLY | O_CLOEXEC);
+      probes[i].length = -1;
+    }
+#ifdef HAS_LIBURING
+    if (use_ring)
+      use_ring = ring.read(probes.data(), count);
+    if (!use_ring)
+#endif
+    {
+      for (size_t i = 0; i < count; i++) {
+        if (probes[i].fd >= 0 && probes[i].length < 0)
+          probes[i].length = pread_probe(probes[i].fd, probes[i].data);
+      }
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (probes[i].fd < 0)
+        continue;
+      if (probes[i].length >= 0)
+        results[first + i] = classify_magic(probes[i].data, probes[i].length);
+      close(probes[i].fd);
+    }
+  }
+  return results;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The kind of payload a file starts with
+enum class FileMagic : uint8_t {
+  // none of the formats below, including empty files
+  Unknown = 0,
+  // the file could not be opened or read
+  Unreadable,
+  Elf,
+  // ar archives, including thin archives
+  Archive,
+  LLVMBitcode,
+};
+
+// the number of bytes read from each file, enough for an ELF header
+constexpr size_t probe_size = 64;
+
+/**
+ * Classifies the first bytes of a file.
+ * ELF files must also have a valid class and byte order.
+ */
+FileMagic classify_magic(const char *data, size_t size);
+
+/**
+ * Reads the first probe_size bytes of each file, without mapping them, and
+ * classifies them. If io_uring is available, the reads of many files are
+ * submitted at once, otherwise pread is used.
+ * @return the kind of each file, in the order of paths
+ */
+std::vector<FileMagic> probe_files(const std::vector<std::string> &paths);
@@ -0,0 +1,178 @@
+#include "abqa.hpp"
+#include "abmanifest.hpp"
+#include "abnativeelf.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+namespace {
+
+// paths which should never exist, symlinks are followed
+constexpr const char *qa_bad_paths[] = {
+    "/bin",     "/sbin",    "/lib",     "/lib64",  "/usr/sbin", "/usr/lib64",
+    "/usr/local", "/usr/man", "/usr/doc", "/usr/etc", "/usr/var",
+};
+
+// pseudo file systems, templates and temporary directories
+constexpr const char *qa_pseudo_paths[] = {"/dev", "/home", "/proc", "/sys",
+                                           "/tmp"};
+
+// allowed directories in /, /usr and /usr/local
+constexpr const char *qa_acceptable_root[] = {
+    "boot", "dev",  "efi",  "etc",   "home", "media", "mnt", "opt", "proc",
+    "root", "run",  "snap", "snapd", "srv",  "sys",   "tmp", "usr", "var",
+};
+constexpr const char *qa_acceptable_usr[] = {
+    "bin", "include", "gnemul", "lib", "libexec", "local", "share", "src",
+};
+constexpr const char *qa_acceptable_usr_local[] = {
+    "bin", "include", "lib", "libexec", "share", "src",
+};
+
+enum QACheck : size_t {
+  LingeringFiles = 0,
+  BadPaths,
+  UnexpectedPaths,
+  PseudoPaths,
+  NonExecutableBinaries,
+  NonExecutableSharedObjects,
+  ExecutableStaticObjects,
+  ExecutableObjects,
+  ZeroByteFiles,
+  QACheckCount,
+};
+
+const QAIssue qa_checks[QACheckCount] = {
+    {"E321", QASeverity::Error,
+     "Lingering file(s) found (incorrect install location?)", {}},
+    {"E321", QASeverity::Error, "Found known bad path(s) in package", {}},
+    {"E321", QASeverity::Error, "found unexpected path(s) in package", {}},
+    {"E321", QASeverity::Error,
+     "found pseudo filesystem, template, or temporary directory(s) in "
+     "package (building aosc-aaa?)",
+     {}},
+    {"E324", QASeverity::Error, "non-executable file(s) found in /usr/bin", {}},
+    {"E324", QASeverity::Error,
+     "non-executable shared object(s) found in /usr/lib", {}},
+    {"E324", QASeverity::Error,
+     "executable static object(s) found in /usr/lib", {}},
+    {"E324", QASeverity::Error,
+     "executable binary object(s) found in /usr/lib", {}},
+    {"W322", QASeverity::Warning, "Zero-byte files found", {}},
+};
+
+template <size_t N>
+bool is_one_of(const char *name, const char *const (&names)[N]) {
+  for (const auto *candidate : names) {
+    if (strcmp(name, candidate) == 0)
+      return true;
+  }
+  return false;
+}
+
+inline bool has_prefix(const std::string &path, const char *prefix) {
+  return path.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// returns the parent directory (without the trailing slash) and the name
+inline std::pair<std::string, const char *> split_path(const std::string &path) {
+  const size_t pos = path.rfind('/');
+  return {path.substr(0, pos), path.c_str() + pos + 1};
+}
+
+inline bool is_executable(const ManifestEntry &entry) {
+  return entry.mode & (S_IXUSR | S_IXGRP | S_IXOTH);
+}
+
+class SharedObjectChecker : public ThreadPool<std::string, int> {
+public:
+  explicit SharedObjectChecker(std::vector<std::string> &results)
+      : ThreadPool<std::string, int>([&](const std::string &path) {
+          if (elf_identify_file(path.c_str()) == BinaryType::Dynamic) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_results.emplace_back(path);
+          }
+          return 0;
+        }),
+        m_results(results) {}
+
+private:
+  std::mutex m_mutex;
+  std::vector<std::string> &m_results;
+};
+
+} // namespace
+
+int qa_post_build_check(const std::string &pkgdir,
+                        std::vector<QAIssue> &issues) {
+  Manifest manifest{};
+  if (manifest_scan(pkgdir, manifest) != 0)
+    return -1;
+
+  std::vector<QAIssue> results{std::begin(qa_checks), std::end(qa_checks)};
+  std::vector<std::string> shared_object_candidates{};
+  for (const auto &entry : manifest.entries) {
+    const auto &path = entry.path;
+    const auto full_path = pkgdir + path;
+    const auto parent_and_name = split_path(path);
+    const auto &parent = parent_and_name.first;
+    const char *name = parent_and_name.second;
+
+    if (S_ISDIR(entry.mode)) {
+      if ((parent.empty() && !is_one_of(name, qa_acceptable_root)) ||
+          (parent == "/usr" && !is_one_of(name, qa_acceptable_usr)) ||
+          (parent == "/usr/local" && !is_one_of(name, qa_acceptable_usr_local)))
+        results[UnexpectedPaths].paths.emplace_back(full_path);
+      continue;
+    }
+    if (!S_ISREG(entry.mode))
+      continue;
+
+    if (parent.empty() || parent == "/usr" || parent == "/usr/share")
+      results[LingeringFiles].paths.emplace_back(full_path);
+    if (entry.size == 0)
+      results[ZeroByteFiles].paths.emplace_back(full_path);
+    if (has_prefix(path, "/usr/bin/") && !is_executable(entry))
+      results[NonExecutableBinaries].paths.emplace_back(full_path);
+    if (!has_prefix(path, "/usr/lib/"))
+      continue;
+    if (!is_executable(entry) && fnmatch("*.so.*", name, 0) == 0) {
+      // only a handful of files, identified in parallel below
+      shared_object_candidates.emplace_back(full_path);
+    } else if (is_executable(entry) && fnmatch("*.a", name, 0) == 0) {
+      results[ExecutableStaticObjects].paths.emplace_back(full_path);
+    } else if (is_executable(entry) && fnmatch("*.o", name, 0) == 0) {
+      results[ExecutableObjects].paths.emplace_back(full_path);
+    }
+  }
+
+  // these checks follow symlinks
+  struct stat st {};
+  for (const auto *path : qa_bad_paths) {
+    if (stat((pkgdir + path).c_str(), &st) == 0)
+      results[BadPaths].paths.emplace_back(pkgdir + path);
+  }
+  for (const auto *path : qa_pseudo_paths) {
+    if (stat((pkgdir + path).c_str(), &st) == 0)
+      results[PseudoPaths].paths.emplace_back(pkgdir + path);
+  }
+
+  if (!shared_object_candidates.empty()) {
+    auto &shared_objects = results[NonExecutableSharedObjects].paths;
+    {
+      SharedObjectChecker checker{shared_objects};
+      checker.enqueue_batch(std::move(shared_object_candidates));
+      checker.wait_for_completion();
+    }
+    std::sort(shared_objects.begin(), shared_objects.end());
+  }
+
+  for (auto &result : results) {
+    if (!result.paths.empty())
+      issues.emplace_back(std::move(result));
+  }
+  return 0;
+}
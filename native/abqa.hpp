@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+enum class QASeverity : bool {
+  Warning,
+  Error,
+};
+
+struct QAIssue {
+  // QA code, e.g. E321
+  const char *code;
+  QASeverity severity;
+  const char *message;
+  // offending paths, prefixed with the package directory
+  std::vector<std::string> paths;
+};
+
+/**
+ * Runs all the post-build QA checks (E321, E324 and W322) on the package
+ * directory in a single walk.
+ * @return 0 on success, -1 if the directory could not be scanned
+ */
+int qa_post_build_check(const std::string &pkgdir, std::vector<QAIssue> &issues);
@@ -0,0 +1,290 @@
+#include "abrusage.hpp"
+#include "stdwrapper.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+struct CgroupState {
+  std::mutex mutex;
+  bool probed = false;
+  // the cgroup of this process, empty if it may not be written to
+  std::string directory;
+  // whether a meter has moved this process to a leaf
+  bool in_use = false;
+  unsigned int counter = 0;
+};
+
+CgroupState &cgroup_state() {
+  static CgroupState state{};
+  return state;
+}
+
+// Returns the root and the mount point of the cgroup v2 hierarchy
+bool find_cgroup2_mount(std::string &root, std::string &mount_point) {
+  std::ifstream mountinfo{"/proc/self/mountinfo"};
+  std::string line{};
+  while (std::getline(mountinfo, line)) {
+    const auto separator = line.find(" - ");
+    if (separator == std::string::npos ||
+        line.compare(separator + 3, 8, "cgroup2 ") != 0)
+      continue;
+    // mount ID, parent ID, major:minor, root, mount point, ...
+    std::istringstream fields{line.substr(0, separator)};
+    std::string ignored{};
+    fields >> ignored >> ignored >> ignored >> root >> mount_point;
+    return !mount_point.empty();
+  }
+  return false;
+}
+
+std::string find_own_cgroup() {
+  std::string root{};
+  std::string mount_point{};
+  if (!find_cgroup2_mount(root, mount_point))
+    return {};
+  std::ifstream cgroup{"/proc/self/cgroup"};
+  std::string line{};
+  std::string path{};
+  while (std::getline(cgroup, line)) {
+    if (line.compare(0, 3, "0::") == 0) {
+      path = line.substr(3);
+      break;
+    }
+  }
+  if (path.empty())
+    return {};
+  // the hierarchy may be mounted from a cgroup other than its root
+  if (root != "/") {
+    if (path.compare(0, root.size(), root) != 0)
+      return {};
+    path = path.substr(root.size());
+  }
+  const auto directory = mount_point + (path == "/" ? "" : path);
+  const auto procs = directory + "/cgroup.procs";
+  if (access(directory.c_str(), W_OK) != 0 ||
+      access(procs.c_str(), W_OK) != 0)
+    return {};
+  return directory;
+}
+
+bool write_value(const std::string &path, const char *value) {
+  FILE *file = fopen(path.c_str(), "we");
+  if (!file)
+    return false;
+  const bool written = fputs(value, file) >= 0;
+  return fclose(file) == 0 && written;
+}
+
+// Moves this process (all of its threads) to the cgroup
+bool move_to_cgroup(const std::string &directory) {
+  // 0 stands for the writing process
+  return write_value(directory + "/cgroup.procs", "0\n");
+}
+
+// Reads "key value" lines, as in cpu.stat
+uint64_t read_keyed_value(const std::string &path, const std::string &key,
+                          bool &found) {
+  std::ifstream file{path};
+  std::string name{};
+  uint64_t value = 0;
+  while (file >> name >> value) {
+    if (name == key) {
+      found = true;
+      return value;
+    }
+  }
+  found = false;
+  return 0;
+}
+
+// Sums the rbytes= and wbytes= of every device in io.stat
+bool read_io_stat(const std::string &path, uint64_t &read_bytes,
+                  uint64_t &write_bytes) {
+  std::ifstream file{path};
+  if (!file.is_open())
+    return false;
+  read_bytes = 0;
+  write_bytes = 0;
+  std::string field{};
+  while (file >> field) {
+    if (field.compare(0, 7, "rbytes=") == 0)
+      read_bytes += std::stoull(field.substr(7));
+    else if (field.compare(0, 7, "wbytes=") == 0)
+      write_bytes += std::stoull(field.substr(7));
+  }
+  return true;
+}
+
+uint64_t timeval_us(const struct timeval &time) {
+  return static_cast<uint64_t>(time.tv_sec) * 1000000 + time.tv_usec;
+}
+
+uint64_t delta(const uint64_t after, const uint64_t before) {
+  return after > before ? after - before : 0;
+}
+
+} // namespace
+
+ResourceMeter::ResourceMeter()
+    : m_cgroup(), m_self(), m_children(), m_stopped(false) {
+  auto &state = cgroup_state();
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (!state.probed) {
+      state.directory = find_own_cgroup();
+      state.probed = true;
+    }
+    if (!state.directory.empty() && !state.in_use) {
+      const auto leaf = fmt::format("{0}/autobuild-{1}-{2}", state.directory,
+                                    getpid(), state.counter++);
+      if (mkdir(leaf.c_str(), 0755) == 0) {
+        if (move_to_cgroup(leaf)) {
+          m_cgroup = leaf;
+          state.in_use = true;
+        } else {
+          rmdir(leaf.c_str());
+        }
+      }
+    }
+  }
+  getrusage(RUSAGE_SELF, &m_self);
+  getrusage(RUSAGE_CHILDREN, &m_children);
+}
+
+ResourceMeter::~ResourceMeter() {
+  if (!m_stopped)
+    stop();
+}
+
+ResourceUsage ResourceMeter::stop() {
+  m_stopped = true;
+  struct rusage self {};
+  struct rusage children {};
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  ResourceUsage usage{
+      UsageSource::Rusage,
+      delta(timeval_us(self.ru_utime) + timeval_us(children.ru_utime),
+            timeval_us(m_self.ru_utime) + timeval_us(m_children.ru_utime)),
+      delta(timeval_us(self.ru_stime) + timeval_us(children.ru_stime),
+            timeval_us(m_self.ru_stime) + timeval_us(m_children.ru_stime)),
+      // the kernel keeps no peak RSS per interval
+      0,
+      delta(self.ru_inblock + children.ru_inblock,
+            m_self.ru_inblock + m_children.ru_inblock) *
+          512,
+      delta(self.ru_oublock + children.ru_oublock,
+            m_self.ru_oublock + m_children.ru_oublock) *
+          512,
+  };
+  if (m_cgroup.empty())
+    return usage;
+  usage.source = UsageSource::Cgroup;
+  bool found = false;
+  const auto cpu_stat = m_cgroup + "/cpu.stat";
+  const uint64_t user_us = read_keyed_value(cpu_stat, "user_usec", found);
+  if (found)
+    usage.user_us = user_us;
+  const uint64_t system_us = read_keyed_value(cpu_stat, "system_usec", found);
+  if (found)
+    usage.system_us = system_us;
+  // the memory controller is needed for these
+  std::ifstream peak_file{m_cgroup + "/memory.peak"};
+  uint64_t peak = 0;
+  if (peak_file >> peak)
+    usage.max_rss_kib = peak >> 10;
+  uint64_t read_bytes = 0;
+  uint64_t write_bytes = 0;
+  if (read_io_stat(m_cgroup + "/io.stat", read_bytes, write_bytes)) {
+    usage.read_bytes = read_bytes;
+    usage.write_bytes = write_bytes;
+  }
+  auto &state = cgroup_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  move_to_cgroup(state.directory);
+  // children left running keep the leaf busy, which is harmless
+  rmdir(m_cgroup.c_str());
+  state.in_use = false;
+  return usage;
+}
+
+const char *usage_source_name(const UsageSource source) {
+  switch (source) {
+  case UsageSource::None:
+    return "none";
+  case UsageSource::Cgroup:
+    return "cgroup";
+  case UsageSource::Rusage:
+    return "rusage";
+  case UsageSource::Child:
+    return "child";
+  }
+  return "none";
+}
+
+ResourceUsage usage_from_rusage(const struct rusage &usage) {
+  return ResourceUsage{
+      UsageSource::Child,
+      timeval_us(usage.ru_utime),
+      timeval_us(usage.ru_stime),
+      static_cast<uint64_t>(usage.ru_maxrss),
+      static_cast<uint64_t>(usage.ru_inblock) * 512,
+      static_cast<uint64_t>(usage.ru_oublock) * 512,
+  };
+}
+
+std::string format_usage(const ResourceUsage &usage) {
+  auto text = fmt::format("{0:.1f}s user, {1:.1f}s system", usage.user_us / 1e6,
+                          usage.system_us / 1e6);
+  if (usage.max_rss_kib)
+    text += fmt::format(", {0} MiB peak RSS", usage.max_rss_kib >> 10);
+  text += fmt::format(", {0} MiB read, {1} MiB written",
+                      usage.read_bytes >> 20, usage.write_bytes >> 20);
+  return text;
+}
+
+bool usage_write_summary(const std::string &path,
+                         const std::vector<TraceSpan> &spans) {
+  json stages = json::array();
+  for (const auto &span : spans) {
+    if (span.usage.source != UsageSource::Cgroup &&
+        span.usage.source != UsageSource::Rusage)
+      continue;
+    json stage = {
+        {"name", span.name},
+        {"category", span.category},
+        {"start", span.start},
+        {"duration", span.duration},
+        {"pid", span.pid},
+        {"source", usage_source_name(span.usage.source)},
+        {"user_us", span.usage.user_us},
+        {"system_us", span.usage.system_us},
+        {"read_bytes", span.usage.read_bytes},
+        {"write_bytes", span.usage.write_bytes},
+    };
+    if (span.usage.max_rss_kib)
+      stage["max_rss_kib"] = span.usage.max_rss_kib;
+    stages.push_back(std::move(stage));
+  }
+  const json summary = {{"stages", std::move(stages)}};
+  const auto temp_path = path + ".tmp";
+  {
+    std::ofstream file{temp_path, std::ios::out | std::ios::trunc};
+    if (!file.is_open())
+      return false;
+    file << summary.dump(2, ' ', false, json::error_handler_t::replace);
+    if (!file.good())
+      return false;
+  }
+  return rename(temp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+/**
+ * Measures the resources used by this process and its children from its
+ * construction until stop().
+ *
+ * If the process may write to its cgroup (cgroup v2, e.g. a delegated
+ * systemd scope), it moves to a new leaf cgroup until stop(), and the CPU
+ * time, peak memory and block I/O of everything started in between are
+ * read from the leaf. Peak memory and block I/O need the memory and io
+ * controllers, getrusage is used for the CPU time and block I/O if the
+ * cgroup lacks them.
+ *
+ * Otherwise, the numbers are the difference in getrusage of the process
+ * and its waited-for children. The kernel keeps no peak RSS per interval,
+ * so no peak RSS is reported then.
+ *
+ * Only one meter per process uses a cgroup, nested meters use getrusage.
+ */
+class ResourceMeter {
+public:
+  ResourceMeter();
+  ~ResourceMeter();
+  ResourceMeter(const ResourceMeter &) = delete;
+  ResourceMeter &operator=(const ResourceMeter &) = delete;
+  ResourceUsage stop();
+
+private:
+  // the leaf cgroup, empty if not in use
+  std::string m_cgroup;
+  struct rusage m_self;
+  struct rusage m_children;
+  bool m_stopped;
+};
+
+// "cgroup", "rusage", etc.
+const char *usage_source_name(UsageSource source);
+
+// The resources used by a child process, as reported by wait4
+ResourceUsage usage_from_rusage(const struct rusage &usage);
+
+// e.g. "12.3s user, 1.2s system, 512 MiB peak RSS, 10 MiB read, 2 MiB written"
+std::string format_usage(const ResourceUsage &usage);
+
+/**
+ * Writes the spans with measured resources (by a ResourceMeter) as a JSON
+ * summary of the build.
+ * @return false if the file could not be written
+ */
+bool usage_write_summary(const std::string &path,
+                         const std::vector<TraceSpan> &spans);
@@ -0,0 +1,174 @@
+#include "abschedule.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+using PathComponents = std::vector<std::string>;
+
+struct TaskScope {
+  // no path was declared: the task conflicts with every other task
+  bool everything;
+  std::vector<PathComponents> reads;
+  std::vector<PathComponents> writes;
+};
+
+std::string get_current_directory() {
+  char buffer[PATH_MAX];
+  if (!getcwd(buffer, sizeof(buffer)))
+    return {};
+  return buffer;
+}
+
+void split_path(const std::string &path, PathComponents &components) {
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos)
+      end = path.size();
+    if (end > start) {
+      const auto component = path.substr(start, end - start);
+      if (component != ".")
+        components.emplace_back(component);
+    }
+    start = end + 1;
+  }
+}
+
+PathComponents normalize_path(const std::string &path, const std::string &cwd) {
+  PathComponents components{};
+  if (path.empty() || path[0] != '/')
+    split_path(cwd, components);
+  split_path(path, components);
+  return components;
+}
+
+// whether one of the paths is the other one, or contains it
+bool paths_overlap(const PathComponents &a, const PathComponents &b) {
+  const size_t length = std::min(a.size(), b.size());
+  return std::equal(a.begin(), a.begin() + length, b.begin());
+}
+
+bool any_overlap(const std::vector<PathComponents> &a,
+                 const std::vector<PathComponents> &b) {
+  for (const auto &x : a) {
+    for (const auto &y : b) {
+      if (paths_overlap(x, y))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool scopes_conflict(const TaskScope &a, const TaskScope &b) {
+  if (a.everything || b.everything)
+    return true;
+  return any_overlap(a.writes, b.writes) || any_overlap(a.writes, b.reads) ||
+         any_overlap(a.reads, b.writes);
+}
+
+} // namespace
+
+bool TaskSchedule::build(const std::vector<ScheduledTask> &tasks) {
+  const size_t count = tasks.size();
+  std::unordered_map<std::string, size_t> indices{};
+  for (size_t i = 0; i < count; i++)
+    indices.emplace(tasks[i].name, i);
+  std::vector<std::vector<size_t>> predecessors(count);
+  for (size_t i = 0; i < count; i++) {
+    for (const auto &name : tasks[i].after) {
+      const auto it = indices.find(name);
+      if (it != indices.end() && it->second != i)
+        predecessors[i].push_back(it->second);
+    }
+    std::sort(predecessors[i].begin(), predecessors[i].end());
+  }
+
+  // the tasks keep their order, except that the tasks a task has to run
+  // after are moved in front of it
+  enum class VisitState : uint8_t { None, Visiting, Done };
+  std::vector<VisitState> states(count, VisitState::None);
+  std::vector<size_t> order{};
+  std::function<bool(size_t)> visit = [&](const size_t index) {
+    if (states[index] == VisitState::Visiting)
+      return false;
+    if (states[index] == VisitState::Done)
+      return true;
+    states[index] = VisitState::Visiting;
+    for (const auto predecessor : predecessors[index]) {
+      if (!visit(predecessor))
+        return false;
+    }
+    states[index] = VisitState::Done;
+    order.push_back(index);
+    return true;
+  };
+  for (size_t i = 0; i < count; i++) {
+    if (!visit(i))
+      return false;
+  }
+
+  const auto cwd = get_current_directory();
+  std::vector<TaskScope> scopes(count);
+  for (size_t i = 0; i < count; i++) {
+    auto &scope = scopes[i];
+    scope.everything = tasks[i].reads.empty() && tasks[i].writes.empty();
+    for (const auto &path : tasks[i].reads)
+      scope.reads.emplace_back(normalize_path(path, cwd));
+    for (const auto &path : tasks[i].writes)
+      scope.writes.emplace_back(normalize_path(path, cwd));
+  }
+
+  m_rank.assign(count, 0);
+  for (size_t i = 0; i < count; i++)
+    m_rank[order[i]] = i;
+  m_successors.assign(count, {});
+  m_pending.assign(count, 0);
+  m_ready.clear();
+  m_taken = 0;
+  for (size_t i = 0; i < count; i++) {
+    const size_t later = order[i];
+    const auto &later_predecessors = predecessors[later];
+    for (size_t j = 0; j < i; j++) {
+      const size_t earlier = order[j];
+      if (std::binary_search(later_predecessors.begin(),
+                             later_predecessors.end(), earlier) ||
+          scopes_conflict(scopes[earlier], scopes[later])) {
+        m_successors[earlier].push_back(later);
+        m_pending[later]++;
+      }
+    }
+    if (m_pending[later] == 0)
+      m_ready.push_back(later);
+  }
+  return true;
+}
+
+std::vector<size_t> TaskSchedule::take_ready() {
+  std::vector<size_t> ready{};
+  ready.swap(m_ready);
+  std::sort(ready.begin(), ready.end(), [&](const size_t a, const size_t b) {
+    return m_rank[a] < m_rank[b];
+  });
+  m_taken += ready.size();
+  return ready;
+}
+
+void TaskSchedule::complete(const size_t index) {
+  for (const auto successor : m_successors[index]) {
+    if (--m_pending[successor] == 0)
+      m_ready.push_back(successor);
+  }
+}
+
+std::vector<size_t> TaskSchedule::serial_order() const {
+  std::vector<size_t> order(m_rank.size());
+  for (size_t i = 0; i < m_rank.size(); i++)
+    order[m_rank[i]] = i;
+  return order;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct ScheduledTask {
+  std::string name;
+  // paths (files or directories) the task reads and writes, relative paths
+  // are relative to the current directory. A task which declares no path at
+  // all may touch anything, and never runs alongside another task.
+  std::vector<std::string> reads;
+  std::vector<std::string> writes;
+  // names of the tasks which have to finish before this one starts
+  std::vector<std::string> after;
+};
+
+/**
+ * Orders a set of tasks into a dependency graph.
+ * A task runs after the tasks it is declared to run after (unknown names
+ * are ignored), otherwise tasks keep the order they were given in. Two
+ * tasks conflict if one of them writes a path the other one reads or
+ * writes (or a parent/child of that path); conflicting tasks run one after
+ * the other, in that order, while the others may run concurrently.
+ */
+class TaskSchedule {
+public:
+  /**
+   * @return false if the ordering constraints contain a cycle
+   */
+  bool build(const std::vector<ScheduledTask> &tasks);
+  /**
+   * Returns the tasks whose dependencies are all complete, in the order
+   * they should be started in. Each task is returned once.
+   */
+  std::vector<size_t> take_ready();
+  void complete(size_t index);
+  // whether every task has been returned by take_ready()
+  bool all_taken() const { return m_taken == m_rank.size(); }
+  // the order to run the tasks in one at a time
+  std::vector<size_t> serial_order() const;
+
+private:
+  std::vector<size_t> m_rank;
+  std::vector<std::vector<size_t>> m_successors;
+  std::vector<size_t> m_pending;
+  std::vector<size_t> m_ready;
+  size_t m_taken = 0;
+};
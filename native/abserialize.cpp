@@ -120,3 +120,29 @@ autobuild_serialized_variables(const std::vector<std::string> &variables) {
   }
   return j.dump();
 }
+
+int autobuild_restore_variables(const std::string &content) {
+  json data = json::parse(content, nullptr, false);
+  if (!data.is_object())
+    return 1;
+  for (auto it = data.begin(); it != data.end(); ++it) {
+    auto &value = it.value();
+    // the variable was not set
+    if (value.is_null())
+      continue;
+    if (value.is_array()) {
+      auto *var = make_new_array_variable(const_cast<char *>(it.key().c_str()));
+      auto *var_a = array_cell(var);
+      arrayind_t index = 0;
+      for (const auto &element : value) {
+        if (!element.is_string())
+          continue;
+        const auto str = element.template get<std::string>();
+        array_insert(var_a, index++, const_cast<char *>(str.c_str()));
+      }
+    } else if (!shell_var_from_json(value, it.key().c_str())) {
+      return 2;
+    }
+  }
+  return 0;
+}
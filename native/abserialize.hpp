@@ -6,3 +6,6 @@
 std::string
 autobuild_serialized_variables(const std::vector<std::string> &variables);
 int autobuild_deserialize_variable(const std::string &content, const std::string &query, const std::string &var_name, const bool allow_failure = false);
+// Restores the variables serialized by autobuild_serialized_variables
+// (strings, integers and indexed arrays)
+int autobuild_restore_variables(const std::string &content);
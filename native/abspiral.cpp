@@ -1,9 +1,11 @@
 #include "abspiral.hpp"
+#include "ablutindex.hpp"
 #include "stdwrapper.hpp"
 
 #include <memory>
 #include <vector>
 #include <fstream>
+#include <string_view>
 #include <unordered_map>
 
 using lut_t = std::unordered_map<std::string, std::unordered_set<std::string>>;
@@ -18,37 +20,51 @@ lut_read(const fs::path &file, lut_t &lut) {
   while (std::getline(f, line)) {
     const size_t delim_pos = line.find(',');
     if (delim_pos == std::string::npos) return -1;
-    const auto key = line.substr(0, delim_pos);
-    if (const auto search = lut.find(key); search == lut.end()) {
-      lut.emplace(key, std::unordered_set<std::string>());
-    }
-    std::unordered_set<std::string> &target = lut.find(key)->second;
+    std::unordered_set<std::string> &target = lut[line.substr(0, delim_pos)];
 
-    auto value = line.substr(delim_pos + 1, line.size());
+    size_t start = delim_pos + 1;
     size_t pos;
-    std::string token;
-    while ((pos = value.find(',')) != std::string::npos) {
-      target.emplace(value.substr(0, pos));
-      value.erase(0, pos + 1);
+    while ((pos = line.find(',', start)) != std::string::npos) {
+      target.emplace(line, start, pos - start);
+      start = pos + 1;
     }
-    target.emplace(value.substr(0, value.size()));
+    target.emplace(line, start);
   }
   return 0;
 }
 
-void
-insert_from_lut(const lut_t &lut,
-                const std::string &key,
-                const std::string &suffix,
+template <typename Lookup>
+static void
+insert_from_lut(const Lookup &lookup,
+                const std::string_view key,
+                const std::string_view suffix,
                 std::unordered_set<std::string> &out) {
-  const auto search = lut.find(key);
-  if (search != lut.end()) {
-    for (const auto &prov : search->second) {
-      out.emplace(fmt::format("{0}{1}", prov, suffix));
-      if (prov.substr(prov.size() - 4, prov.size() - 1) == "t64") {
-        out.emplace(fmt::format("{0}{1}", prov.substr(0, prov.size() - 3), suffix));
-      }
+  lookup(key, [&](const std::string_view prov) {
+    out.emplace(fmt::format("{0}{1}", prov, suffix));
+    if (prov.substr(prov.size() - 4, prov.size() - 1) == "t64") {
+      out.emplace(fmt::format("{0}{1}", prov.substr(0, prov.size() - 3), suffix));
+    }
+  });
+}
+
+template <typename Lookup>
+static void
+spiral_lookup_sonames(const Lookup &lookup,
+                      const std::vector<std::string> &sonames,
+                      std::unordered_set<std::string> &spiral_provides) {
+  for (const auto &soname_and_arch: sonames) {
+    std::string_view soname{soname_and_arch};
+    std::string_view arch_suffix{};
+    const size_t delim_pos = soname.find(':');
+    if (delim_pos != std::string_view::npos) {
+      arch_suffix = soname.substr(delim_pos);
+      soname = soname.substr(0, delim_pos);
     }
+    insert_from_lut(lookup, soname, arch_suffix, spiral_provides);
+    const size_t suffix_pos = soname.find(".so");
+    if (suffix_pos == std::string_view::npos)
+      continue;
+    insert_from_lut(lookup, soname.substr(0, suffix_pos + 3), arch_suffix, spiral_provides);
   }
 }
 
@@ -56,25 +72,29 @@ int
 spiral_from_sonames(const std::string &lut_file,
                     const std::vector<std::string> &sonames,
                     std::unordered_set<std::string> &spiral_provides) {
+  // prefer the precompiled index (generated by build_spiral_index.py)
+  const auto index_file = fs::path{lut_file}.replace_extension(".idx");
+  LutIndex index{};
+  if (index.open(index_file.c_str(), lut_file.c_str())) {
+    const auto lookup = [&](const std::string_view key, const auto &callback) {
+      index.lookup(key, callback);
+    };
+    spiral_lookup_sonames(lookup, sonames, spiral_provides);
+    return 0;
+  }
+
   lut_t lut;
   if (lut_read(lut_file, lut) != 0) {
     return 1;
   }
-  for (const auto &soname_and_arch: sonames) {
-    std::string soname{};
-    std::string arch_suffix;
-    const size_t delim_pos = soname_and_arch.find(':');
-    if (delim_pos != std::string::npos) {
-      soname = soname_and_arch.substr(0, delim_pos);
-      arch_suffix = soname_and_arch.substr(delim_pos, soname_and_arch.length());
-    } else {
-      soname = soname_and_arch;
+  const auto lookup = [&](const std::string_view key, const auto &callback) {
+    const auto search = lut.find(std::string{key});
+    if (search == lut.end())
+      return;
+    for (const auto &prov : search->second) {
+      callback(prov);
     }
-    insert_from_lut(lut, soname, arch_suffix, spiral_provides);
-    const size_t suffix_pos = soname.find(".so");
-    if (suffix_pos == std::string::npos)
-      continue;
-    insert_from_lut(lut, soname.substr(0, suffix_pos + 3), arch_suffix, spiral_provides);
-  }
+  };
+  spiral_lookup_sonames(lookup, sonames, spiral_provides);
   return 0;
 }
@@ -0,0 +1,260 @@
+#include "abtrace.hpp"
+#include "abnativefunctions.h"
+#include "abrusage.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+struct OpenSpan {
+  TraceSpan span;
+  // measures the resources used by the span, if requested
+  std::unique_ptr<ResourceMeter> meter;
+};
+
+struct TraceState {
+  std::mutex mutex;
+  std::vector<TraceSpan> spans;
+  // spans opened by trace_begin
+  std::vector<OpenSpan> open_spans;
+  // whether this process is a worker sending its spans to the parent
+  bool capturing = false;
+  std::vector<TraceSpan> captured;
+};
+
+TraceState &trace_state() {
+  static TraceState state{};
+  return state;
+}
+
+int current_thread_id() { return static_cast<int>(syscall(SYS_gettid)); }
+
+json usage_to_json(const ResourceUsage &usage) {
+  json object = {{"source", usage_source_name(usage.source)},
+                 {"user_us", usage.user_us},
+                 {"system_us", usage.system_us},
+                 {"read_bytes", usage.read_bytes},
+                 {"write_bytes", usage.write_bytes}};
+  if (usage.max_rss_kib)
+    object["max_rss_kib"] = usage.max_rss_kib;
+  return object;
+}
+
+json span_to_json(const TraceSpan &span) {
+  return {{"name", span.name},
+          {"category", span.category},
+          {"start", span.start},
+          {"duration", span.duration},
+          {"pid", span.pid},
+          {"tid", span.tid},
+          {"child_pid", span.child_pid},
+          {"usage", usage_to_json(span.usage)}};
+}
+
+ResourceUsage usage_from_json(const json &object) {
+  ResourceUsage usage{};
+  if (!object.is_object())
+    return usage;
+  const auto source = object.value("source", "none");
+  for (const auto candidate : {UsageSource::Cgroup, UsageSource::Rusage,
+                               UsageSource::Child}) {
+    if (source == usage_source_name(candidate))
+      usage.source = candidate;
+  }
+  usage.user_us = object.value<uint64_t>("user_us", 0);
+  usage.system_us = object.value<uint64_t>("system_us", 0);
+  usage.max_rss_kib = object.value<uint64_t>("max_rss_kib", 0);
+  usage.read_bytes = object.value<uint64_t>("read_bytes", 0);
+  usage.write_bytes = object.value<uint64_t>("write_bytes", 0);
+  return usage;
+}
+
+TraceSpan span_from_json(const json &object) {
+  const auto usage = object.find("usage");
+  return TraceSpan{object.value("name", ""),
+                   object.value("category", ""),
+                   object.value<uint64_t>("start", 0),
+                   object.value<uint64_t>("duration", 0),
+                   object.value("pid", 0),
+                   object.value("tid", 0),
+                   object.value("child_pid", 0),
+                   usage == object.end() ? ResourceUsage{}
+                                         : usage_from_json(*usage)};
+}
+
+// whether the span measured a stage of the build with a ResourceMeter
+bool is_measured(const TraceSpan &span) {
+  return span.usage.source == UsageSource::Cgroup ||
+         span.usage.source == UsageSource::Rusage;
+}
+
+// the trace-event format, see "Trace Event Format" (complete events)
+json span_to_event(const TraceSpan &span) {
+  json event = {{"name", span.name}, {"cat", span.category},
+                {"ph", "X"},         {"ts", span.start},
+                {"dur", span.duration}, {"pid", span.pid},
+                {"tid", span.tid}};
+  if (span.child_pid)
+    event["args"]["child_pid"] = span.child_pid;
+  if (span.usage.source != UsageSource::None)
+    event["args"]["usage"] = usage_to_json(span.usage);
+  return event;
+}
+
+void report_span(const TraceSpan &span) {
+  auto *base_logger = reinterpret_cast<BaseLogger *>(logger);
+  if (base_logger)
+    base_logger->logSpan(span);
+}
+
+} // namespace
+
+uint64_t trace_clock() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void trace_record(TraceSpan span) {
+  auto &state = trace_state();
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.capturing) {
+      state.captured.emplace_back(std::move(span));
+      return;
+    }
+    state.spans.push_back(span);
+  }
+  report_span(span);
+  if (is_measured(span))
+    get_logger()->info(fmt::format("Resources used by {0} {1}: {2}",
+                                   span.category, span.name,
+                                   format_usage(span.usage)));
+}
+
+TraceScope::TraceScope(std::string category, std::string name)
+    : m_span{std::move(name),
+             std::move(category),
+             trace_clock(),
+             0,
+             getpid(),
+             current_thread_id(),
+             0,
+             {}} {}
+
+TraceScope::~TraceScope() {
+  m_span.duration = trace_clock() - m_span.start;
+  trace_record(std::move(m_span));
+}
+
+void trace_begin(std::string category, std::string name, const bool measure) {
+  auto &state = trace_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  OpenSpan open_span{TraceSpan{std::move(name), std::move(category), 0, 0,
+                               getpid(), current_thread_id(), 0, {}},
+                     nullptr};
+  if (measure)
+    open_span.meter = std::make_unique<ResourceMeter>();
+  open_span.span.start = trace_clock();
+  state.open_spans.emplace_back(std::move(open_span));
+}
+
+bool trace_end() {
+  auto &state = trace_state();
+  OpenSpan open_span{};
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.open_spans.empty())
+      return false;
+    open_span = std::move(state.open_spans.back());
+    state.open_spans.pop_back();
+  }
+  auto &span = open_span.span;
+  span.duration = trace_clock() - span.start;
+  if (open_span.meter)
+    span.usage = open_span.meter->stop();
+  trace_record(std::move(span));
+  return true;
+}
+
+void trace_capture_begin() {
+  auto &state = trace_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.capturing = true;
+  // the spans of the parent are written by the parent, and the meters of
+  // the parent are left alone (this process runs in their cgroup)
+  state.spans.clear();
+  for (auto &open_span : state.open_spans)
+    (void)open_span.meter.release();
+  state.open_spans.clear();
+  state.captured.clear();
+}
+
+std::string trace_capture_take() {
+  auto &state = trace_state();
+  json spans = json::array();
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (const auto &span : state.captured)
+      spans.push_back(span_to_json(span));
+    state.captured.clear();
+  }
+  return spans.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+void trace_import(const std::string &spans) {
+  const json data = json::parse(spans, nullptr, false);
+  if (!data.is_array())
+    return;
+  for (const auto &object : data) {
+    if (object.is_object())
+      trace_record(span_from_json(object));
+  }
+}
+
+std::vector<TraceSpan> trace_spans() {
+  auto &state = trace_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.spans;
+}
+
+bool trace_write(const std::string &path) {
+  auto &state = trace_state();
+  const uint64_t now = trace_clock();
+  json events = json::array();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  for (const auto &span : state.spans)
+    events.push_back(span_to_event(span));
+  for (const auto &open_span : state.open_spans) {
+    auto span = open_span.span;
+    span.duration = now - span.start;
+    events.push_back(span_to_event(span));
+  }
+  events.push_back({{"name", "process_name"},
+                    {"ph", "M"},
+                    {"pid", getpid()},
+                    {"args", {{"name", "autobuild"}}}});
+  const json trace = {{"traceEvents", std::move(events)},
+                      {"displayTimeUnit", "ms"}};
+  // write to a temporary file, so that a partial trace is never left behind
+  const auto temp_path = path + ".tmp";
+  {
+    std::ofstream file{temp_path, std::ios::out | std::ios::trunc};
+    if (!file.is_open())
+      return false;
+    file << trace.dump(-1, ' ', false, json::error_handler_t::replace);
+    if (!file.good())
+      return false;
+  }
+  return rename(temp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <string>
+#include <vector>
+
+// microseconds since the Unix epoch
+uint64_t trace_clock();
+
+/**
+ * Records a finished span. The span is kept for the trace file and
+ * reported to the logger (JsonLogger emits it as an event). In a forked
+ * worker which captures its spans, it is kept for the parent instead.
+ */
+void trace_record(TraceSpan span);
+
+/**
+ * Records the lifetime of the scope as a span on the calling thread.
+ */
+class TraceScope {
+public:
+  TraceScope(std::string category, std::string name);
+  ~TraceScope();
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+  void set_child_pid(const int pid) { m_span.child_pid = pid; }
+  void set_usage(const ResourceUsage &usage) { m_span.usage = usage; }
+
+private:
+  TraceSpan m_span;
+};
+
+/**
+ * Opens and closes a span on a stack, for the spans of the shell (which
+ * may exit anywhere, e.g. in abdie). Spans still open when the trace is
+ * written end at that time. With measure, the resources used by the span
+ * are measured (see abrusage.hpp) and logged when it ends.
+ */
+void trace_begin(std::string category, std::string name,
+                 bool measure = false);
+// @return false if no span is open
+bool trace_end();
+
+/**
+ * In a forked worker: from now on, the spans are kept to be sent to the
+ * parent (see trace_capture_take and trace_import) instead of being logged.
+ */
+void trace_capture_begin();
+// Returns the spans captured since the last call, serialized
+std::string trace_capture_take();
+// Records the spans captured by a worker
+void trace_import(const std::string &spans);
+
+// Returns the finished spans recorded by this process
+std::vector<TraceSpan> trace_spans();
+
+/**
+ * Writes the spans recorded by this process to a Chrome trace-event file,
+ * which can be loaded into chrome://tracing or Perfetto.
+ * @return false if the file could not be written
+ */
+bool trace_write(const std::string &path);
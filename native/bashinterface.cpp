@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "abtrace.hpp"
 #include "bashinterface.hpp"
 #include "common.hpp"
 #include "stdwrapper.hpp"
@@ -253,7 +254,12 @@ int autobuild_load_all_from_directory(const char *directory) {
   // instead of the file system order
   std::sort(files.begin(), files.end());
   for (const auto &file : files) {
-    if (autobuild_load_file(file.c_str(), false)) {
+    // the span is left open if the script exits, and ends when the trace
+    // is written
+    trace_begin("stage", fs::path(file).filename().string());
+    const int ret = autobuild_load_file(file.c_str(), false);
+    trace_end();
+    if (ret) {
       return 1;
     }
   }
@@ -39,3 +39,41 @@ struct Diagnostic {
   int code;
   std::vector<DiagnosticFrame> frames;
 };
+
+// How the resources used by a span were measured, see abrusage.hpp
+enum class UsageSource {
+  // not measured
+  None,
+  // the cgroup the span ran in
+  Cgroup,
+  // getrusage of the process and its children
+  Rusage,
+  // wait4 on a single child process
+  Child,
+};
+
+struct ResourceUsage {
+  UsageSource source;
+  // CPU time, in microseconds
+  uint64_t user_us;
+  uint64_t system_us;
+  // peak resident set size, in KiB, 0 if not measured
+  uint64_t max_rss_kib;
+  // block I/O, in bytes
+  uint64_t read_bytes;
+  uint64_t write_bytes;
+};
+
+// A timed section of the build, see abtrace.hpp
+struct TraceSpan {
+  std::string name;
+  std::string category;
+  // start time (since the Unix epoch) and duration, in microseconds
+  uint64_t start;
+  uint64_t duration;
+  int pid;
+  int tid;
+  // the child process the span waited for, 0 if none
+  int child_pid;
+  ResourceUsage usage;
+};
@@ -1,13 +1,15 @@
 #include "logger.hpp"
 #include "abconfig.h"
+#include "abrusage.hpp"
 #include "stdwrapper.hpp"
 
+#include <charconv>
+#include <cstring>
 #include <fstream>
-#include <iostream>
+#include <strings.h>
+#include <type_traits>
 
-#include <nlohmann/json.hpp>
-
-typedef std::lock_guard<std::mutex> io_lock_guard;
+namespace {
 
 inline const char *level_to_string(const LogLevel level) {
   switch (level) {
@@ -25,113 +27,398 @@ inline const char *level_to_string(const LogLevel level) {
   return "UNK";
 }
 
+// The line being formatted on this thread, the capacity is kept between
+// lines so that formatting does not allocate
+std::string &line_buffer() {
+  thread_local std::string buffer{};
+  buffer.clear();
+  return buffer;
+}
+
+inline void write_line(FILE *stream, const std::string &line) {
+  LogWriter::instance().write(stream, line.data(), line.size());
+}
+
+// whether the line at pos is a record written by a JsonLogger
+inline bool is_json_record(const std::string &output, const size_t pos) {
+  constexpr char prefix[] = "{\"event\":\"";
+  return output.compare(pos, sizeof(prefix) - 1, prefix) == 0;
+}
+
+// the length of the valid UTF-8 sequence at data, 0 if invalid
+size_t utf8_sequence_length(const unsigned char *data, const size_t size) {
+  const unsigned char lead = data[0];
+  size_t length = 0;
+  unsigned char min = 0x80;
+  unsigned char max = 0xbf;
+  if (lead < 0x80)
+    return 1;
+  if (lead >= 0xc2 && lead <= 0xdf) {
+    length = 2;
+  } else if (lead >= 0xe0 && lead <= 0xef) {
+    length = 3;
+    if (lead == 0xe0)
+      min = 0xa0;
+    else if (lead == 0xed)
+      max = 0x9f;
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    length = 4;
+    if (lead == 0xf0)
+      min = 0x90;
+    else if (lead == 0xf4)
+      max = 0x8f;
+  } else {
+    return 0;
+  }
+  if (length > size || data[1] < min || data[1] > max)
+    return 0;
+  for (size_t i = 2; i < length; i++) {
+    if (data[i] < 0x80 || data[i] > 0xbf)
+      return 0;
+  }
+  return length;
+}
+
+/**
+ * Appends a JSON document to a string, without building a tree first.
+ * The output is the same as nlohmann::json::dump() with the replace error
+ * handler, as long as the keys are given in alphabetical order.
+ */
+class JsonEncoder {
+public:
+  explicit JsonEncoder(std::string &out) : m_out(out), m_need_comma(false) {}
+  void begin_object() {
+    separate();
+    m_out += '{';
+    m_need_comma = false;
+  }
+  void end_object() {
+    m_out += '}';
+    m_need_comma = true;
+  }
+  void begin_array() {
+    separate();
+    m_out += '[';
+    m_need_comma = false;
+  }
+  void end_array() {
+    m_out += ']';
+    m_need_comma = true;
+  }
+  void key(const char *name) {
+    separate();
+    append_string(name, strlen(name));
+    m_out += ':';
+    m_need_comma = false;
+  }
+  void value(const std::string &value) {
+    separate();
+    append_string(value.data(), value.size());
+    m_need_comma = true;
+  }
+  void value(const char *value) {
+    separate();
+    append_string(value, strlen(value));
+    m_need_comma = true;
+  }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value>::type value(T value) {
+    separate();
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    m_out.append(digits, result.ptr);
+    m_need_comma = true;
+  }
+  template <typename T> void field(const char *name, const T &value) {
+    key(name);
+    this->value(value);
+  }
+
+private:
+  void separate() {
+    if (m_need_comma)
+      m_out += ',';
+  }
+  void append_string(const char *data, const size_t size) {
+    static constexpr char hex_digits[] = "0123456789abcdef";
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+    m_out += '"';
+    size_t i = 0;
+    while (i < size) {
+      const unsigned char byte = bytes[i];
+      switch (byte) {
+      case '"':
+        m_out += "\\\"";
+        break;
+      case '\\':
+        m_out += "\\\\";
+        break;
+      case '\b':
+        m_out += "\\b";
+        break;
+      case '\f':
+        m_out += "\\f";
+        break;
+      case '\n':
+        m_out += "\\n";
+        break;
+      case '\r':
+        m_out += "\\r";
+        break;
+      case '\t':
+        m_out += "\\t";
+        break;
+      default:
+        if (byte < 0x20) {
+          const char escape[] = {'\\',
+                                 'u',
+                                 '0',
+                                 '0',
+                                 hex_digits[byte >> 4],
+                                 hex_digits[byte & 0xf]};
+          m_out.append(escape, sizeof(escape));
+          break;
+        }
+        const size_t length = utf8_sequence_length(bytes + i, size - i);
+        if (length == 0) {
+          // U+FFFD REPLACEMENT CHARACTER
+          m_out += "\xef\xbf\xbd";
+        } else {
+          m_out.append(data + i, length);
+          i += length;
+          continue;
+        }
+      }
+      i++;
+    }
+    m_out += '"';
+  }
+
+  std::string &m_out;
+  bool m_need_comma;
+};
+
+} // namespace
+
+// everything is logged unless configured otherwise
+std::atomic<LogLevel> BaseLogger::s_level{LogLevel::Debug};
+
+bool log_level_from_string(const char *value, LogLevel &level) {
+  if (!value)
+    return false;
+  const std::pair<const char *, LogLevel> names[] = {
+      {"debug", LogLevel::Debug},       {"info", LogLevel::Info},
+      {"warn", LogLevel::Warning},      {"warning", LogLevel::Warning},
+      {"error", LogLevel::Error},       {"crit", LogLevel::Critical},
+      {"critical", LogLevel::Critical},
+  };
+  for (const auto &name : names) {
+    if (strcasecmp(value, name.first) == 0) {
+      level = name.second;
+      return true;
+    }
+  }
+  return false;
+}
+
 void PlainLogger::log(const LogLevel lvl, const std::string message) {
-  io_lock_guard guard(this->m_io_mutex);
+  auto &line = line_buffer();
   switch (lvl) {
   case LogLevel::Info:
-    std::cout << "[INFO]:  ";
+    line += "[INFO]:  ";
     break;
   case LogLevel::Warning:
-    std::cout << "[WARN]:  ";
+    line += "[WARN]:  ";
     break;
   case LogLevel::Error:
-    std::cout << "[ERROR]: ";
+    line += "[ERROR]: ";
     break;
   case LogLevel::Critical:
-    std::cout << "[CRIT]:  ";
+    line += "[CRIT]:  ";
     break;
   case LogLevel::Debug:
-    std::cout << "[DEBUG]: ";
+    line += "[DEBUG]: ";
     break;
   }
 
-  std::cout << message << std::endl;
-  std::cout.flush();
+  line += message;
+  line += '\n';
+  write_line(stdout, line);
+}
+
+void PlainLogger::logOutput(const std::string output) {
+  write_line(stdout, output);
 }
 
 void PlainLogger::logDiagnostic(Diagnostic diagnostic) {
   this->error("Build error detected ^o^");
+  auto &lines = line_buffer();
   for (const auto &diag : diagnostic.frames) {
     const auto filename = diag.file.empty() ? "<unknown>" : diag.file;
     const auto function = (diag.function.empty() || diag.function == "source")
                               ? "<unknown>"
                               : diag.function;
-    io_lock_guard guard(this->m_io_mutex);
-    printf("%s(%zu): In function `%s':\n", filename.c_str(), diag.line,
-           function.c_str());
+    lines += fmt::format("{0}({1}): In function `{2}':\n", filename, diag.line,
+                         function);
   }
-  std::cerr << fmt::format("Command exited with {0}.", diagnostic.code)
-            << std::endl;
+  write_line(stdout, lines);
+  write_line(stderr,
+             fmt::format("Command exited with {0}.\n", diagnostic.code));
 }
 
 void PlainLogger::logException(std::string message) {
-  io_lock_guard guard(this->m_io_mutex);
-  std::cerr << "autobuild encountered an error and couldn't continue."
-            << std::endl;
+  auto &lines = line_buffer();
+  lines += "autobuild encountered an error and couldn't continue.\n";
   if (!message.empty()) {
-    std::cerr << message << std::endl;
+    lines += message;
+    lines += '\n';
   } else {
-    std::cerr << "Look at the stacktrace to see what happened." << std::endl;
+    lines += "Look at the stacktrace to see what happened.\n";
   }
-  fprintf(stderr,
-          "------------------------------autobuild "
-          "%s------------------------------\n",
-          ab_version);
-  fprintf(stderr, "Go to %s for more information on this error.\n", ab_url);
+  lines += fmt::format("------------------------------autobuild "
+                       "{0}------------------------------\n",
+                       ab_version);
+  lines += fmt::format("Go to {0} for more information on this error.\n",
+                       ab_url);
+  write_line(stderr, lines);
 }
 
-using json = nlohmann::json;
-
 void JsonLogger::log(LogLevel lvl, std::string message) {
-  const json line = {
-      {"event", "log"}, {"level", level_to_string(lvl)}, {"message", message}};
-  io_lock_guard guard(this->m_io_mutex);
-  std::cout << line.dump() << std::endl;
+  auto &line = line_buffer();
+  JsonEncoder json{line};
+  json.begin_object();
+  json.field("event", "log");
+  json.field("level", level_to_string(lvl));
+  json.field("message", message);
+  json.end_object();
+  line += '\n';
+  write_line(stdout, line);
+}
+
+void JsonLogger::logOutput(const std::string output) {
+  auto &lines = line_buffer();
+  // the output of a forked worker contains the records it has logged, which
+  // are passed through, only the text around them is wrapped
+  size_t text_start = 0;
+  const auto wrap_text = [&](const size_t end) {
+    if (end == text_start)
+      return;
+    JsonEncoder json{lines};
+    json.begin_object();
+    json.field("event", "output");
+    json.field("message", output.substr(text_start, end - text_start));
+    json.end_object();
+    lines += '\n';
+  };
+  size_t pos = 0;
+  while (pos < output.size()) {
+    const size_t newline = output.find('\n', pos);
+    const size_t end =
+        newline == std::string::npos ? output.size() : newline + 1;
+    if (is_json_record(output, pos)) {
+      wrap_text(pos);
+      lines.append(output, pos, end - pos);
+      if (lines.back() != '\n')
+        lines += '\n';
+      text_start = end;
+    }
+    pos = end;
+  }
+  wrap_text(output.size());
+  write_line(stdout, lines);
 }
 
 void JsonLogger::logDiagnostic(Diagnostic diagnostic) {
-  json line = {{"event", "diagnostic"},
-               {"level", level_to_string(diagnostic.level)},
-               {"exit_code", diagnostic.code}};
-  line["frames"] = json::array();
+  auto &line = line_buffer();
+  JsonEncoder json{line};
+  json.begin_object();
+  json.field("event", "diagnostic");
+  json.field("exit_code", diagnostic.code);
+  json.key("frames");
+  json.begin_array();
   for (const auto &frame : diagnostic.frames) {
-    line["frames"].push_back({{"file", frame.file},
-                              {"line", frame.line},
-                              {"function", frame.function}});
+    json.begin_object();
+    json.field("file", frame.file);
+    json.field("function", frame.function);
+    json.field("line", frame.line);
+    json.end_object();
   }
-  io_lock_guard guard(this->m_io_mutex);
-  std::cout << line.dump() << std::endl;
+  json.end_array();
+  json.field("level", level_to_string(diagnostic.level));
+  json.end_object();
+  line += '\n';
+  write_line(stdout, line);
 }
 
 void JsonLogger::logException(std::string message) {
-  const json line = {
-      {"event", "exception"}, {"level", "CRIT"}, {"message", message}};
-  io_lock_guard guard(this->m_io_mutex);
-  std::cout << line.dump() << std::endl;
+  auto &line = line_buffer();
+  JsonEncoder json{line};
+  json.begin_object();
+  json.field("event", "exception");
+  json.field("level", "CRIT");
+  json.field("message", message);
+  json.end_object();
+  line += '\n';
+  write_line(stdout, line);
+}
+
+void JsonLogger::logSpan(const TraceSpan &span) {
+  auto &line = line_buffer();
+  JsonEncoder json{line};
+  json.begin_object();
+  json.field("category", span.category);
+  json.field("child_pid", span.child_pid);
+  json.field("duration", span.duration);
+  json.field("event", "span");
+  json.field("name", span.name);
+  json.field("pid", span.pid);
+  json.field("start", span.start);
+  json.field("tid", span.tid);
+  if (span.usage.source != UsageSource::None) {
+    json.key("usage");
+    json.begin_object();
+    if (span.usage.max_rss_kib)
+      json.field("max_rss_kib", span.usage.max_rss_kib);
+    json.field("read_bytes", span.usage.read_bytes);
+    json.field("source", usage_source_name(span.usage.source));
+    json.field("system_us", span.usage.system_us);
+    json.field("user_us", span.usage.user_us);
+    json.field("write_bytes", span.usage.write_bytes);
+    json.end_object();
+  }
+  json.end_object();
+  line += '\n';
+  write_line(stdout, line);
 }
 
 void ColorfulLogger::log(LogLevel lvl, std::string message) {
-  io_lock_guard guard(this->m_io_mutex);
+  auto &line = line_buffer();
   switch (lvl) {
   case LogLevel::Info:
-    std::cout << "[\x1b[96mINFO\x1b[0m]:  ";
+    line += "[\x1b[96mINFO\x1b[0m]:  ";
     break;
   case LogLevel::Warning:
-    std::cout << "[\x1b[33mWARN\x1b[0m]:  ";
+    line += "[\x1b[33mWARN\x1b[0m]:  ";
     break;
   case LogLevel::Error:
-    std::cout << "[\x1b[31mERROR\x1b[0m]: ";
+    line += "[\x1b[31mERROR\x1b[0m]: ";
     break;
   case LogLevel::Critical:
-    std::cout << "[\x1b[93mCRIT\x1b[0m]:  ";
+    line += "[\x1b[93mCRIT\x1b[0m]:  ";
     break;
   case LogLevel::Debug:
-    std::cout << "[\x1b[32mDEBUG\x1b[0m]: ";
+    line += "[\x1b[32mDEBUG\x1b[0m]: ";
     break;
   }
 
-  std::cout << "\x1b[1m" << message << "\x1b[0m" << std::endl;
-  std::cout.flush();
+  line += "\x1b[1m";
+  line += message;
+  line += "\x1b[0m\n";
+  write_line(stdout, line);
+}
+
+void ColorfulLogger::logOutput(const std::string output) {
+  write_line(stdout, output);
 }
 
 static std::string get_snippet(const std::string &filename, const size_t line) {
@@ -156,7 +443,7 @@ static std::string get_snippet(const std::string &filename, const size_t line) {
 }
 
 void ColorfulLogger::logDiagnostic(Diagnostic diagnostic) {
-  std::string buffer{};
+  auto &buffer = line_buffer();
   // reverse order, most recent call last
   for (auto it = diagnostic.frames.rbegin(); it != diagnostic.frames.rend();
        ++it) {
@@ -181,27 +468,26 @@ void ColorfulLogger::logDiagnostic(Diagnostic diagnostic) {
                           frame.file, frame.line);
   }
 
-  io_lock_guard guard(this->m_io_mutex);
-  std::cerr << buffer << std::endl;
+  buffer += '\n';
+  write_line(stderr, buffer);
 }
 
 void ColorfulLogger::logException(std::string message) {
-  io_lock_guard guard(this->m_io_mutex);
-  std::cerr << "\x1b[1;31m"
-            << "autobuild encountered an error and couldn't continue."
-            << "\x1b[0m" << std::endl;
+  auto &lines = line_buffer();
+  lines += "\x1b[1;31m"
+           "autobuild encountered an error and couldn't continue."
+           "\x1b[0m\n";
   if (!message.empty()) {
-    std::cerr << message << std::endl;
+    lines += message;
+    lines += '\n';
   } else {
-    std::cerr << "Look at the stacktrace to see what happened." << std::endl;
-  }
-  fprintf(stderr,
-          "------------------------------autobuild "
-          "%s------------------------------\n",
-          ab_version);
-  std::string colored_url{"‘\e[1m"};
-  colored_url += ab_url;
-  colored_url += "\x1b[0m’";
-  fprintf(stderr, "Go to %s for more information on this error.\n",
-          colored_url.c_str());
+    lines += "Look at the stacktrace to see what happened.\n";
+  }
+  lines += fmt::format("------------------------------autobuild "
+                       "{0}------------------------------\n",
+                       ab_version);
+  lines += fmt::format("Go to ‘\e[1m{0}\x1b[0m’ for more information on this "
+                       "error.\n",
+                       ab_url);
+  write_line(stderr, lines);
 }
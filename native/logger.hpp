@@ -1,42 +1,74 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
-#include <mutex>
 #include <vector>
 
 #include "common.hpp"
+#include "logwriter.hpp"
 
 class BaseLogger {
 public:
-  BaseLogger() : m_io_mutex(), m_level(LogLevel::Info){};
+  // the writer belongs to the thread which creates the first logger
+  BaseLogger() { LogWriter::instance(); }
   virtual ~BaseLogger() = default;
   virtual void log(LogLevel lvl, std::string message) = 0;
+  // raw output (e.g. of a child process), written as is
+  virtual void logOutput(std::string output) = 0;
   virtual void logDiagnostic(Diagnostic diagnostic) = 0;
   virtual void logException(std::string message) = 0;
+  // only machine-readable loggers report the spans of the build profile
+  virtual void logSpan(const TraceSpan &) {}
   virtual const char *loggerName() = 0;
-  inline void setLogLevel(const LogLevel lvl) { m_level = lvl; }
-  inline void info(const std::string &message) { log(LogLevel::Info, message); }
+  // the level applies to every logger, including the ones capturing the
+  // output of tasks
+  static inline void setLogLevel(const LogLevel lvl) {
+    s_level.store(lvl, std::memory_order_relaxed);
+  }
+  // check this before building an expensive message
+  static inline bool isEnabled(const LogLevel lvl) {
+    return lvl >= s_level.load(std::memory_order_relaxed);
+  }
+  // calls message() for the message only if the level is enabled
+  template <typename F> inline void logLazy(const LogLevel lvl, F &&message) {
+    if (isEnabled(lvl))
+      log(lvl, message());
+  }
+  // writes out the lines logged by other threads so far
+  inline void flush() { LogWriter::instance().flush(); }
+  inline void info(const std::string &message) {
+    if (isEnabled(LogLevel::Info))
+      log(LogLevel::Info, message);
+  }
   inline void debug(const std::string &message) {
-    log(LogLevel::Debug, message);
+    if (isEnabled(LogLevel::Debug))
+      log(LogLevel::Debug, message);
   }
   inline void warning(const std::string &message) {
-    log(LogLevel::Warning, message);
+    if (isEnabled(LogLevel::Warning))
+      log(LogLevel::Warning, message);
   }
   inline void error(const std::string &message) {
-    log(LogLevel::Error, message);
+    if (isEnabled(LogLevel::Error))
+      log(LogLevel::Error, message);
   }
 
-protected:
-  std::mutex m_io_mutex;
-
 private:
-  LogLevel m_level;
+  static std::atomic<LogLevel> s_level;
 };
 
+/**
+ * Parses a log level: "debug", "info", "warn" (or "warning"), "error" or
+ * "crit" (or "critical").
+ * @return false if the value is unknown
+ */
+bool log_level_from_string(const char *value, LogLevel &level);
+
 class PlainLogger final : public BaseLogger {
 public:
   PlainLogger() {}
   void log(LogLevel lvl, std::string message) override;
+  void logOutput(std::string output) override;
   void logDiagnostic(Diagnostic diagnostic) override;
   void logException(std::string message) override;
   const char *loggerName() override { return "PlainLogger"; }
@@ -46,8 +78,10 @@ class JsonLogger final : public BaseLogger {
 public:
   JsonLogger() {}
   void log(LogLevel lvl, std::string message) override;
+  void logOutput(std::string output) override;
   void logDiagnostic(Diagnostic diagnostic) override;
   void logException(std::string message) override;
+  void logSpan(const TraceSpan &span) override;
   const char *loggerName() override { return "JsonLogger"; }
 };
 
@@ -55,6 +89,7 @@ class ColorfulLogger final : public BaseLogger {
 public:
   ColorfulLogger() {}
   void log(LogLevel lvl, std::string message) override;
+  void logOutput(std::string output) override;
   void logDiagnostic(Diagnostic diagnostic) override;
   void logException(std::string message) override;
   const char *loggerName() override { return "ColorfulLogger"; }
@@ -0,0 +1,176 @@
+#include "logwriter.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+namespace {
+// the background thread wakes up at least this often, in case a wakeup
+// got lost
+constexpr auto idle_timeout = std::chrono::milliseconds(100);
+} // namespace
+
+LogWriter &LogWriter::instance() {
+  // never destroyed: the background thread may outlive the static objects
+  static LogWriter *writer = new LogWriter();
+  return *writer;
+}
+
+LogWriter::LogWriter()
+    : m_slots(new Slot[slot_count]), m_enqueue_pos(0), m_dequeue_pos(0),
+      m_consumer_mutex(), m_wake_mutex(), m_wake(), m_sleeping(false),
+      m_thread_started(false), m_start_mutex(),
+      m_owner(std::this_thread::get_id()) {
+  for (size_t i = 0; i < slot_count; i++) {
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    m_slots[i].heap_data = nullptr;
+  }
+  pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+  atexit([] { instance().flush(); });
+}
+
+void LogWriter::write(FILE *stream, const char *data, const size_t size) {
+  if (std::this_thread::get_id() != m_owner) {
+    enqueue(stream, data, size);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_consumer_mutex);
+  drain_locked();
+  fwrite(data, 1, size, stream);
+  fflush(stream);
+}
+
+void LogWriter::flush() {
+  std::lock_guard<std::mutex> lock(m_consumer_mutex);
+  // wait for the lines which are being queued
+  while (!drain_locked())
+    std::this_thread::yield();
+}
+
+void LogWriter::enqueue(FILE *stream, const char *data, const size_t size) {
+  if (!m_thread_started.load(std::memory_order_acquire))
+    start_thread();
+  // a bounded MPMC queue (Dmitry Vyukov's), with a single consumer
+  size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  Slot *slot = nullptr;
+  while (true) {
+    slot = &m_slots[pos % slot_count];
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const auto diff =
+        static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      // the ring is full, wait for the background thread
+      m_wake.notify_one();
+      std::this_thread::yield();
+      pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    } else {
+      pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  slot->stream = stream;
+  slot->size = size;
+  if (size <= slot_size) {
+    memcpy(slot->data, data, size);
+    slot->heap_data = nullptr;
+  } else {
+    slot->heap_data = new char[size];
+    memcpy(slot->heap_data, data, size);
+  }
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  // pairs with the fence in run()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(m_wake_mutex);
+    m_wake.notify_one();
+  }
+}
+
+bool LogWriter::drain_locked() {
+  bool wrote_out = false;
+  bool wrote_err = false;
+  size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  while (true) {
+    auto &slot = m_slots[pos % slot_count];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+      break;
+    fwrite(slot.heap_data ? slot.heap_data : slot.data, 1, slot.size,
+           slot.stream);
+    (slot.stream == stderr ? wrote_err : wrote_out) = true;
+    delete[] slot.heap_data;
+    slot.heap_data = nullptr;
+    slot.sequence.store(pos + slot_count, std::memory_order_release);
+    pos++;
+  }
+  m_dequeue_pos.store(pos, std::memory_order_relaxed);
+  if (wrote_out)
+    fflush(stdout);
+  if (wrote_err)
+    fflush(stderr);
+  return pos == m_enqueue_pos.load(std::memory_order_acquire);
+}
+
+bool LogWriter::has_pending() const {
+  const size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  return m_slots[pos % slot_count].sequence.load(std::memory_order_acquire) ==
+         pos + 1;
+}
+
+void LogWriter::start_thread() {
+  std::lock_guard<std::mutex> lock(m_start_mutex);
+  if (m_thread_started.load(std::memory_order_relaxed))
+    return;
+  std::thread(&LogWriter::run, this).detach();
+  m_thread_started.store(true, std::memory_order_release);
+}
+
+void LogWriter::run() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(m_consumer_mutex);
+      drain_locked();
+    }
+    std::unique_lock<std::mutex> lock(m_wake_mutex);
+    m_sleeping.store(true, std::memory_order_relaxed);
+    // pairs with the fence in enqueue()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    m_wake.wait_for(lock, idle_timeout, [this] { return has_pending(); });
+    m_sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+void LogWriter::before_fork() {
+  auto &writer = instance();
+  writer.m_start_mutex.lock();
+  writer.m_consumer_mutex.lock();
+  writer.drain_locked();
+  writer.m_wake_mutex.lock();
+}
+
+void LogWriter::after_fork_parent() {
+  auto &writer = instance();
+  writer.m_wake_mutex.unlock();
+  writer.m_consumer_mutex.unlock();
+  writer.m_start_mutex.unlock();
+}
+
+void LogWriter::after_fork_child() {
+  auto &writer = instance();
+  // the lines queued since before_fork are written by the parent, and the
+  // threads which were queueing lines do not exist in the child
+  for (size_t i = 0; i < slot_count; i++) {
+    writer.m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    writer.m_slots[i].heap_data = nullptr;
+  }
+  writer.m_enqueue_pos.store(0, std::memory_order_relaxed);
+  writer.m_dequeue_pos.store(0, std::memory_order_relaxed);
+  writer.m_sleeping.store(false, std::memory_order_relaxed);
+  writer.m_thread_started.store(false, std::memory_order_relaxed);
+  writer.m_wake_mutex.unlock();
+  writer.m_consumer_mutex.unlock();
+  writer.m_start_mutex.unlock();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * Writes the lines of the loggers to stdout and stderr.
+ *
+ * Lines logged by the thread which created the writer (the shell) are
+ * written right away, after everything queued before them, so that they
+ * stay in order with the output of the shell and its children. Other
+ * threads (e.g. the ELF workers) append their lines to a lock-free ring
+ * buffer, which a background thread writes out in batches; they only wait
+ * if the ring is full.
+ *
+ * The ring is written out before fork (a forked child starts with an empty
+ * ring, and its own background thread) and at exit.
+ */
+class LogWriter {
+public:
+  // Returns the writer of this process
+  static LogWriter &instance();
+
+  void write(FILE *stream, const char *data, size_t size);
+  // Writes out everything queued so far
+  void flush();
+
+  LogWriter(const LogWriter &) = delete;
+  LogWriter &operator=(const LogWriter &) = delete;
+
+private:
+  // lines up to this size are copied into the ring, longer lines are
+  // allocated on the heap
+  static constexpr size_t slot_size = 256;
+  static constexpr size_t slot_count = 4096;
+
+  struct Slot {
+    std::atomic<size_t> sequence;
+    FILE *stream;
+    size_t size;
+    char *heap_data;
+    char data[slot_size];
+  };
+
+  LogWriter();
+  void enqueue(FILE *stream, const char *data, size_t size);
+  // Writes out the lines published so far, m_consumer_mutex must be held
+  // @return false if some lines are still being queued
+  bool drain_locked();
+  bool has_pending() const;
+  void start_thread();
+  void run();
+
+  static void before_fork();
+  static void after_fork_parent();
+  static void after_fork_child();
+
+  std::unique_ptr<Slot[]> m_slots;
+  alignas(64) std::atomic<size_t> m_enqueue_pos;
+  alignas(64) std::atomic<size_t> m_dequeue_pos;
+  // only one thread writes out the ring at a time
+  std::mutex m_consumer_mutex;
+  // wakes up the background thread
+  std::mutex m_wake_mutex;
+  std::condition_variable m_wake;
+  std::atomic<bool> m_sleeping;
+  std::atomic<bool> m_thread_started;
+  std::mutex m_start_mutex;
+  std::thread::id m_owner;
+};
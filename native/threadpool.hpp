@@ -1,18 +1,40 @@
 #pragma once
 
+#include "abconcurrency.hpp"
+#include "abjobserver.hpp"
+#include "logwriter.hpp"
+
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <functional>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 
-#if __cplusplus >= 201703L && !defined(IFCONSTEXPR)
-#define IFCONSTEXPR constexpr
-#else
-#define IFCONSTEXPR
-#endif
+enum class TaskOrder : bool {
+  // newest task first, best for cache locality
+  Lifo,
+  // tasks are started in the order they are submitted
+  Fifo,
+};
 
+/**
+ * A work-stealing thread pool.
+ * Each worker owns a task deque: the owner takes the newest task from the
+ * back, idle workers steal the oldest tasks from the front of the others.
+ * Sleeping workers are only woken up when there is work for them.
+ * Tasks may enqueue more tasks, the pool only stops once all of them
+ * are finished.
+ * With TaskOrder::Fifo the owners also take their tasks from the front, so
+ * that a batch sorted by cost is started (roughly) in that order.
+ * If there is a GNU make jobserver, every worker but the first one takes a
+ * job slot from it for each task, so the pool shares the ABTHREADS budget
+ * with the build (the first worker uses the implicit slot of the process).
+ */
 template <typename T, typename R> class ThreadPool {
   using processor_func_t = std::function<R(T &)>;
 
@@ -26,37 +48,76 @@ template <typename T, typename R> class ThreadPool {
     return func(data);
   }
 
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<T> tasks;
+  };
+
 public:
   explicit ThreadPool(processor_func_t processor,
-                      const unsigned int thread_num = std::thread::hardware_concurrency())
-      : m_waker(), m_queue({}), m_stop(false), m_has_error(false),
+                      const unsigned int thread_num = available_concurrency(),
+                      const TaskOrder order = TaskOrder::Lifo)
+      : m_queues(std::max(thread_num, 1U)), m_queued(0), m_pending(0), m_idle(0),
+        m_next_queue(0), m_order(order), m_stop(false), m_has_error(false),
         m_processor(std::move(processor)) {
-    for (int i = 0; i < thread_num; ++i) {
-      m_workers.emplace_back(std::thread{[&] {
-        while (true) {
-          std::unique_lock<std::mutex> lock(m_mutex);
-          m_waker.wait(lock, [&] { return !m_queue.empty() || m_stop; });
-          if (m_queue.empty() && m_stop) {
-            lock.unlock();
-            break;
-          }
-          auto task = std::move(m_queue.back());
-          m_queue.pop_back();
-          lock.unlock();
-          if (process_for_result(m_processor, task) != 0)
-            m_has_error = true;
-        }
-      }});
+    for (size_t i = 0; i < m_queues.size(); ++i) {
+      m_queues[i] = std::make_unique<WorkerQueue>();
+    }
+    for (size_t i = 0; i < m_queues.size(); ++i) {
+      m_workers.emplace_back(std::thread{[this, i] { worker_loop(i); }});
     }
   }
   ~ThreadPool() { wait_for_completion(); }
   void enqueue(T &&task) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_queue.emplace_back(std::move(task));
-    m_waker.notify_all();
+    auto &queue = *m_queues[pick_queue()];
+    // count the task before it is published, a thief may finish it before
+    // the deque is unlocked here
+    m_pending.fetch_add(1);
+    m_queued.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.emplace_back(std::move(task));
+    }
+    wake_workers(1);
+  }
+  /**
+   * Submits all the tasks at once, each deque is only locked once.
+   * The tasks are split into contiguous chunks, one per worker, or dealt
+   * out round-robin with TaskOrder::Fifo to keep the submission order.
+   */
+  template <typename Container> void enqueue_batch(Container &&tasks) {
+    const size_t count = tasks.size();
+    if (count == 0)
+      return;
+    const size_t queue_count = m_queues.size();
+    const size_t first_queue = m_next_queue.fetch_add(queue_count);
+    // count the tasks before they are published, like enqueue()
+    m_pending.fetch_add(count);
+    m_queued.fetch_add(count);
+    if (m_order == TaskOrder::Fifo) {
+      for (size_t i = 0; i < queue_count && i < count; ++i) {
+        auto &queue = *m_queues[(first_queue + i) % queue_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (size_t j = i; j < count; j += queue_count) {
+          queue.tasks.emplace_back(std::move(tasks[j]));
+        }
+      }
+    } else {
+      const size_t chunk_size = (count + queue_count - 1) / queue_count;
+      auto it = std::make_move_iterator(std::begin(tasks));
+      const auto end = std::make_move_iterator(std::end(tasks));
+      for (size_t i = 0; i < queue_count && it != end; ++i) {
+        auto &queue = *m_queues[(first_queue + i) % queue_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (size_t j = 0; j < chunk_size && it != end; ++j, ++it) {
+          queue.tasks.emplace_back(*it);
+        }
+      }
+    }
+    wake_workers(count);
   }
   void stop() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<std::mutex> lock(m_sleep_mutex);
     m_stop = true;
     m_waker.notify_all();
   }
@@ -66,15 +127,116 @@ public:
       if (worker.joinable())
         worker.join();
     }
+    // write out what the workers logged before the caller goes on
+    LogWriter::instance().flush();
   }
-  bool has_error() const { return m_has_error; }
+  bool has_error() const { return m_has_error.load(); }
+  size_t thread_count() const { return m_workers.size(); }
 
 private:
+  // tasks submitted from a worker go to its own deque, others round-robin
+  size_t pick_queue() {
+    if (tl_current_pool == this)
+      return tl_worker_index;
+    return m_next_queue.fetch_add(1) % m_queues.size();
+  }
+
+  void wake_workers(const size_t count) {
+    // m_idle is incremented before a worker re-checks m_queued under the
+    // sleep mutex, so a zero here means that the worker will see the task
+    const size_t idle = m_idle.load();
+    if (idle == 0)
+      return;
+    std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    if (count >= idle) {
+      m_waker.notify_all();
+      return;
+    }
+    for (size_t i = 0; i < count; ++i)
+      m_waker.notify_one();
+  }
+
+  bool pop_own(const size_t index, T &task) {
+    auto &queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+      return false;
+    if (m_order == TaskOrder::Fifo) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    } else {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+    return true;
+  }
+
+  bool steal(const size_t index, T &task) {
+    const size_t queue_count = m_queues.size();
+    for (size_t i = 1; i < queue_count; ++i) {
+      auto &queue = *m_queues[(index + i) % queue_count];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty())
+        continue;
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+    return false;
+  }
+
+  void worker_loop(const size_t index) {
+    tl_current_pool = this;
+    tl_worker_index = index;
+    while (true) {
+      T task{};
+      if (pop_own(index, task) || steal(index, task)) {
+        m_queued.fetch_sub(1);
+        {
+          const JobToken token{index != 0};
+          if (process_for_result(m_processor, task) != 0)
+            m_has_error = true;
+        }
+        if (m_pending.fetch_sub(1) == 1) {
+          // the last task is done, let the others check whether to stop
+          std::lock_guard<std::mutex> lock(m_sleep_mutex);
+          m_waker.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_sleep_mutex);
+      m_idle.fetch_add(1);
+      m_waker.wait(lock, [&] {
+        return m_queued.load() > 0 || (m_stop && m_pending.load() == 0);
+      });
+      m_idle.fetch_sub(1);
+      if (m_pending.load() == 0 && m_stop)
+        break;
+    }
+    tl_current_pool = nullptr;
+  }
+
+  static thread_local const ThreadPool *tl_current_pool;
+  static thread_local size_t tl_worker_index;
+
+  std::vector<std::unique_ptr<WorkerQueue>> m_queues;
   std::vector<std::thread> m_workers;
   std::condition_variable m_waker;
-  std::mutex m_mutex;
-  std::deque<T> m_queue;
+  std::mutex m_sleep_mutex;
+  // number of tasks sitting in the deques
+  std::atomic<size_t> m_queued;
+  // number of tasks either queued or running
+  std::atomic<size_t> m_pending;
+  std::atomic<size_t> m_idle;
+  std::atomic<size_t> m_next_queue;
+  const TaskOrder m_order;
   bool m_stop;
-  bool m_has_error;
+  std::atomic<bool> m_has_error;
   processor_func_t m_processor;
 };
+
+template <typename T, typename R>
+thread_local const ThreadPool<T, R> *ThreadPool<T, R>::tl_current_pool =
+    nullptr;
+template <typename T, typename R>
+thread_local size_t ThreadPool<T, R>::tl_worker_index = 0;
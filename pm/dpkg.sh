@@ -7,7 +7,36 @@ DPKGDEBCOMP=()
 # Use Zstd at the default level: 3 - see zstd(1).
 DPKGDEBCOMP+=(-Zzstd -z3)
 
+# Prints the zstd level set in DPKGDEBCOMP for the native .deb writer, fails
+# if DPKGDEBCOMP asks for another compressor, which only dpkg-deb supports.
+dpkg_deb_zstd_level() {
+	local _format= _level=3 _i
+	for ((_i = 0; _i < ${#DPKGDEBCOMP[@]}; _i++)); do
+		case "${DPKGDEBCOMP[_i]}" in
+			-Z) _format="${DPKGDEBCOMP[++_i]}" ;;
+			-Z*) _format="${DPKGDEBCOMP[_i]#-Z}" ;;
+			-z) _level="${DPKGDEBCOMP[++_i]}" ;;
+			-z*) _level="${DPKGDEBCOMP[_i]#-z}" ;;
+		esac
+	done
+	[ "$_format" = zstd ] || return 1
+	echo "$_level"
+}
+
 dpkg_deb_build() {
+	local _level
+	if bool "$ABNATIVEDEB"; then
+		if _level="$(dpkg_deb_zstd_level)"; then
+			abpm_deb_build -z "$_level" -j "$ABTHREADS" "$1" "$2"
+			case $? in
+				0) return 0 ;;
+				127) abdbg "Native .deb writer is unavailable, using dpkg-deb" ;;
+				*) return 1 ;;
+			esac
+		else
+			abdbg "DPKGDEBCOMP does not use zstd, using dpkg-deb"
+		fi
+	fi
 	dpkg-deb "${DPKGDEBCOMP[@]}" -b "$1" "$2"
 }
 
@@ -39,12 +68,17 @@ dpkgfield() {
 			if ! ((${#__AB_SO_DEPS})); then
 				abdie "Auto dependency discovery requested, but no ELF dependency was found!" >&2
 			fi
-			local _data
-			_data="$(dpkg_get_provides "${__AB_SO_DEPS[@]}")"
-			abdbg "Auto dependency discovery found: ${_data}" >&2
-			while read -r LINE; do
-				_string_v+=("$LINE")
-			done <<< "${_data}"
+			if abpm_dpkg_owners -c "$ABCACHEDIR"/dpkg-files.idx __AB_DPKG_OWNERS "${__AB_SO_DEPS[@]}"; then
+				abdbg "Auto dependency discovery found: ${__AB_DPKG_OWNERS[*]}" >&2
+				_string_v+=("${__AB_DPKG_OWNERS[@]}")
+			else
+				local _data
+				_data="$(dpkg_get_provides "${__AB_SO_DEPS[@]}")"
+				abdbg "Auto dependency discovery found: ${_data}" >&2
+				while read -r LINE; do
+					_string_v+=("$LINE")
+				done <<< "${_data}"
+			fi
 		fi
 		if [ "${_v}" = "@AB_SPIRAL_PROVIDES@" ]; then
 			for SPIRAL_PROV in "${__ABSPIRAL_PROVIDES[@]}"; do
@@ -52,9 +86,16 @@ dpkgfield() {
 			done
 		fi
 	done
+	# look up the installed versions of all dependencies at once
+	unset __AB_DPKG_VERSIONS
+	if ! ((VER_NONE_ALL || VER_NONE)); then
+		abpm_dpkg_getver __AB_DPKG_VERSIONS "${_string_v[@]}" || unset __AB_DPKG_VERSIONS
+	fi
 	# second-pass: actually fill in the blanks
 	local _buffer=()
-	for _v in "${_string_v[@]}"; do
+	local _i
+	for _i in "${!_string_v[@]}"; do
+		_v="${_string_v[_i]}"
 		if [[ "${_v}" = '@'* ]]; then
 			continue
 		elif [[ "${_v}" = "$PKGNAME" ]]; then
@@ -72,7 +113,7 @@ dpkgfield() {
 		elif ((VER_NONE)) || [[ "$_v" =~ _$ ]]; then
 			_buffer+=("${_v%_}");
 		else
-			_buffer+=("$(abpm_debver "${_v}>=$(dpkg_getver "${_v}")")")
+			_buffer+=("$(abpm_debver "${_v}>=${__AB_DPKG_VERSIONS[_i]-$(dpkg_getver "${_v}")}")")
 		fi
 	done
 	local _content="$(ab_join_elements _buffer $', ')"
@@ -87,7 +128,7 @@ dpkgctrl() {
 	echo "Architecture: $arch"
 	[ "$PKGSEC" ] && echo "Section: $PKGSEC"
 	echo "Maintainer: $MTER"
-	echo "Installed-Size: $(du -s "$PKGDIR" | cut -f 1)"
+	echo "Installed-Size: ${__AB_MANIFEST_INSTALLED_SIZE:-$(du -s "$PKGDIR" | cut -f 1)}"
 	echo "Description: $PKGDES"
 	if ((PKGESS)); then
 		echo "Essential: yes"
@@ -134,7 +175,9 @@ dpkgctrl_dbg() {
 	echo "Architecture: $arch"
 	echo "Section: debug"
 	echo "Maintainer: $MTER"
-	echo "Installed-Size: $(du -s "$SYMDIR" | cut -f 1)"
+	abmanifest -v __AB_DBG_MANIFEST "$SYMDIR" \
+		|| abdie "Failed to walk through $SYMDIR: $?."
+	echo "Installed-Size: ${__AB_DBG_MANIFEST_INSTALLED_SIZE}"
 	echo "Description: Debug symbols for $PKGNAME"
 	echo "Depends: ${PKGNAME} (=$(dpkgpkgver))"
 	# Record last packager in control, we will switch to another variable
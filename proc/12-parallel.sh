@@ -8,4 +8,13 @@ if bool "$NOPARALLEL"; then
 else
 	abinfo "Parallel build ENABLED"
 	export MAKEFLAGS="-j$ABTHREADS"
+	# Share $ABTHREADS between make, ninja, cargo, LTO and our own workers.
+	# Older versions of make do not understand the named pipe jobserver.
+	if bool "$ABJOBSERVER" && \
+		[[ "$(make --version 2>/dev/null)" =~ ^GNU\ Make\ ([0-9]+)\.([0-9]+) ]] && \
+		(( BASH_REMATCH[1] > 4 || (BASH_REMATCH[1] == 4 && BASH_REMATCH[2] >= 4) )) && \
+		abjobserver_start "$ABTHREADS"; then
+		abinfo "Jobserver started with $ABTHREADS job slots"
+		MAKEFLAGS+=" --jobserver-auth=$__AB_JOBSERVER_AUTH"
+	fi
 fi
@@ -4,9 +4,28 @@
 
 AB_TEMPLATES=()
 AB_FILTERS=()
+# Per filter (function name): the paths it reads and writes (relative to
+# $PKGDIR), the filters it runs after and the variables it sets, one per line
+declare -gA AB_FILTER_READS=() AB_FILTER_WRITES=() AB_FILTER_AFTER=() AB_FILTER_EXPORTS=()
 
+# Usage: ab_register_filter [-r path] [-w path] [-a filter] [-b filter] [-o variable] name
+# Filters which declare neither -r nor -w may touch anything, and never run
+# alongside another filter.
 # shellcheck disable=SC2317
 ab_register_filter() {
+	local OPTIND=1 opt
+	local _reads=() _writes=() _after=() _before=() _exports=() _filter
+	while getopts "r:w:a:b:o:" opt; do
+		case "$opt" in
+			r) _reads+=("$OPTARG") ;;
+			w) _writes+=("$OPTARG") ;;
+			a) _after+=("filter_$OPTARG") ;;
+			b) _before+=("filter_$OPTARG") ;;
+			o) _exports+=("$OPTARG") ;;
+			*) abdie "Internal error: Invalid filter option" ;;
+		esac
+	done
+	shift $((OPTIND - 1))
 	local name="$1"
 	if [ -z "$1" ]; then
 		abdie "Internal error: No template specified"
@@ -15,6 +34,14 @@ ab_register_filter() {
 	if ! ab_typecheck -f "${_filter_name}"; then
 		aberr "Internal error: Filter ${name} does not have required function '${_filter_name}'."
 	fi
+	local IFS=$'\n'
+	AB_FILTER_READS["${_filter_name}"]="${_reads[*]}"
+	AB_FILTER_WRITES["${_filter_name}"]="${_writes[*]}"
+	AB_FILTER_AFTER["${_filter_name}"]+=$'\n'"${_after[*]}"
+	AB_FILTER_EXPORTS["${_filter_name}"]="${_exports[*]}"
+	for _filter in "${_before[@]}"; do
+		AB_FILTER_AFTER["${_filter}"]+=$'\n'"${_filter_name}"
+	done
 	abdbg "Registered filter: ${name}"
 	AB_FILTERS+=("${_filter_name}")
 }
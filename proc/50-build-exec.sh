@@ -17,20 +17,30 @@ cd "$SRCDIR"
 
 if ab_typecheck -f "build_${ABTYPE}_check"; then
     abinfo "${ABTYPE} > Running check step ..."
+    abtrace_begin -u step check
     "build_${ABTYPE}_check"
+    abtrace_end
 fi
 
 if ab_typecheck -f "build_${ABTYPE}_audit"; then
     abinfo "${ABTYPE} > Running audit step ..."
+    abtrace_begin -u step audit
     "build_${ABTYPE}_audit" || abdie "Audit failed: $?."
+    abtrace_end
 fi
 
 abinfo "${ABTYPE} > Running configure step ..."
+abtrace_begin -u step configure
 "build_${ABTYPE}_configure" || abdie "Configure failed: $?."
+abtrace_end
 abinfo "${ABTYPE} > Running build step ..."
+abtrace_begin -u step build
 "build_${ABTYPE}_build" || abdie "Build failed: $?."
+abtrace_end
 abinfo "${ABTYPE} > Running install step ..."
+abtrace_begin -u step install
 "build_${ABTYPE}_install" || abdie "Install failed: $?."
+abtrace_end
 
 cd "$SRCDIR" || abdie "Unable to cd $SRCDIR: $?."
 
@@ -4,9 +4,21 @@
 
 pushd "$PKGDIR" > /dev/null || exit 127
 
-for ii in "${AB_FILTERS[@]}"; do
-	abinfo "Running post-build filter: $ii ..."
-	"$ii"
-done
+if bool "$ABPARALLELFILTERS"; then
+	abinfo "Running post-build filters: ${AB_FILTERS[*]} ..."
+	abpp_schedule -t filter -u -r AB_FILTER_READS -w AB_FILTER_WRITES \
+		-a AB_FILTER_AFTER -o AB_FILTER_EXPORTS "${AB_FILTERS[@]}" || \
+		abdie "Post-build filters failed: $?."
+else
+	# run the filters one at a time, in the order abpp_schedule would
+	abpp_schedule -l AB_FILTER_ORDER -a AB_FILTER_AFTER "${AB_FILTERS[@]}" || \
+		abdie "Unable to order the post-build filters: $?."
+	for ii in "${AB_FILTER_ORDER[@]}"; do
+		abinfo "Running post-build filter: $ii ..."
+		abtrace_begin -u filter "$ii"
+		"$ii"
+		abtrace_end
+	done
+fi
 
 popd > /dev/null || exit 128
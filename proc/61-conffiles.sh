@@ -2,20 +2,24 @@
 ##proc/conffiles.sh: Generate conffiles if not already written
 ##@copyright GPL-2.0+
 
+# Walk through $PKGDIR once to record the file manifest (__AB_MANIFEST_*)
+# and the Installed-Size (__AB_MANIFEST_INSTALLED_SIZE) for later stages.
 # Do not process conffiles in stage2 mode.
 if bool "$ABSTAGE2"; then
-    return 0
+	abmanifest "$PKGDIR" \
+		|| abdie "Failed to walk through $PKGDIR: $?."
+	return 0
 fi
 # Generate a cached conffiles.
-find "$PKGDIR"/etc -type f -printf '/etc/%P\n' 2>/dev/null \
-	| sort > "$SRCDIR"/conffiles.ab
+abmanifest -c "$SRCDIR"/conffiles.ab "$PKGDIR" \
+	|| abdie "Failed to walk through $PKGDIR: $?."
 
 if [[ -d "$PKGDIR"/etc && ! -e "$SRCDIR"/autobuild/conffiles ]]; then
 	abwarn 'Detected /etc in $PKGDIR, but autobuild/conffiles is not found - attempting generation ...'
 	abinfo 'Appending the following to autobuild/conffiles ...'
 	cat "$SRCDIR"/conffiles.ab 2>&1 | tee "$SRCDIR"/autobuild/conffiles
 elif [[ -e "$SRCDIR"/autobuild/conffiles ]]; then
-	if ! diff "$SRCDIR"/conffiles.ab <(sort "$SRCDIR"/autobuild/conffiles) >/dev/null 2>&1; then
+	if ! diff "$SRCDIR"/conffiles.ab <(LC_ALL=C sort "$SRCDIR"/autobuild/conffiles) >/dev/null 2>&1; then
 		abinfo 'Found autobuild/conffiles - good job! Content as follows ...'
 		sort "$SRCDIR"/autobuild/conffiles
 		abwarn 'However, there seems to be more/less files found in $PKGDIR/etc ...'
@@ -3,9 +3,9 @@
 ##@copyright GPL-2.0+
 if bool "$ABQA"; then
 	abinfo "Running post-build QA tests ..."
-	for i in "$AB"/qa/post/*; do
-		. "$i"
-	done
+	# E321 (paths), E324 (permissions) and W322 (zero-byte files)
+	abqa_post_build "$PKGDIR" "$SRCDIR"/abqaerr.log "$SRCDIR"/abqawarn.log \
+		|| abdie "Failed to run post-build QA tests: $?."
 fi
 
 if [ -s "$SRCDIR"/abqawarn.log ]; then
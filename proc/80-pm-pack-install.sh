@@ -4,6 +4,7 @@
 
 AB_PACKAGES=()
 
+abtrace_begin -u step package
 for i in "${ABMPM[@]}"; do
     abinfo "Packing $i package(s) ..."
     source "$AB"/pm/"$i".sh || aberr "$i packing returned $?."
@@ -20,3 +21,4 @@ for i in "${ABMPM[@]}"; do
     fi
     pm_install_all "${AB_PACKAGES[@]}"
 done
+abtrace_end
@@ -1,8 +0,0 @@
-#!/bin/bash
-##zero_byte: Check for zero-byte files.
-##@copyright GPL-2.0+
-FILES="$(find "$PKGDIR" -type f -size 0 -print)"
-if [ -n "$FILES" ]; then
-	abwarn "QA (W322): Zero-byte files found:\n\n$FILES\n" | \
-		tee -a "$SRCDIR"/abqawarn.log
-fi
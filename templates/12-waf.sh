@@ -18,7 +18,7 @@ build_waf_build() {
 	BUILD_READY
 	abinfo "Building binaries ..."
     ab_tostringarray MAKE_AFTER
-	"$PYTHON" waf build ${ABMK} "${MAKE_AFTER[@]}" "${MAKEFLAGS[@]}" \
+	"$PYTHON" waf build ${ABMK} "${MAKE_AFTER[@]}" "${MAKEFLAGS%% *}" \
 		|| abdie "Failed to build binaries: $?."
 }
 
@@ -0,0 +1,95 @@
+#!/bin/bash
+##tests/deb-build.sh: Compare the native .deb writer against dpkg-deb.
+##@copyright GPL-2.0+
+# Usage: deb-build.sh <libautobuild.so> <source directory>
+# Exits with 77 if the native writer is unavailable.
+
+set -u
+
+AB="$2"
+export AB
+enable -f "$1" autobuild || exit 1
+
+TMPDIR="$(mktemp -d)"
+trap 'rm -rf "$TMPDIR"' EXIT
+cd "$TMPDIR" || exit 1
+
+fail=0
+
+control_file() {
+	printf 'Package: %s\nVersion: %s\nArchitecture: amd64\nMaintainer: Test <test@example.com>\nDescription: test package\n long description\n' "$1" "$2"
+}
+
+make_tree() {
+	rm -rf pkg
+	mkdir -p pkg/DEBIAN pkg/etc pkg/usr/bin pkg/usr/share/doc/test
+	control_file test 1:1.0~rc1-2 > pkg/DEBIAN/control
+	printf '#!/bin/sh\nexit 0\n' > pkg/DEBIAN/postinst
+	chmod 0755 pkg/DEBIAN pkg/DEBIAN/postinst
+	echo '/etc/test.conf' > pkg/DEBIAN/conffiles
+	echo 'key=value' > pkg/etc/test.conf
+	head -c 200000 /dev/urandom > pkg/usr/bin/test
+	chmod 0755 pkg/usr/bin/test
+	ln pkg/usr/bin/test pkg/usr/bin/test-hardlink
+	ln -s test pkg/usr/bin/test-symlink
+	local long="pkg/usr/share/doc/test/$(printf 'long%.0s' {1..30})"
+	mkdir -p "$long"
+	echo 'long name' > "$long/file"
+	echo 'readme' > pkg/usr/share/doc/test/README
+}
+
+# Builds the tree with both writers, and compares the decompressed members
+compare() {
+	local name="$1" member
+	rm -rf native.deb dpkg.deb native dpkg
+	abpm_deb_build -z 3 pkg native.deb
+	case $? in
+		0) ;;
+		127) echo "Native .deb writer is unavailable"; exit 77 ;;
+		*) echo "FAIL: $name: abpm_deb_build failed"; fail=1; return ;;
+	esac
+	dpkg-deb -Zzstd -b pkg dpkg.deb > /dev/null || { echo "FAIL: $name: dpkg-deb failed"; fail=1; return; }
+	mkdir native dpkg
+	(cd native && ar x ../native.deb) && (cd dpkg && ar x ../dpkg.deb)
+	if [ "$(ar t native.deb)" != "$(ar t dpkg.deb)" ]; then
+		echo "FAIL: $name: the ar members differ"
+		fail=1
+		return
+	fi
+	cmp -s native/debian-binary dpkg/debian-binary || { echo "FAIL: $name: debian-binary differs"; fail=1; }
+	for member in control.tar data.tar; do
+		if ! cmp -s <(zstd -dqc "native/$member.zst") <(zstd -dqc "dpkg/$member.zst"); then
+			echo "FAIL: $name: $member differs"
+			fail=1
+		fi
+	done
+	dpkg-deb --info native.deb > /dev/null || { echo "FAIL: $name: dpkg-deb cannot read the package"; fail=1; }
+}
+
+# Both writers must refuse to build the tree
+reject() {
+	local name="$1"
+	if abpm_deb_build pkg native.deb 2> /dev/null; then
+		echo "FAIL: $name: accepted by abpm_deb_build"
+		fail=1
+	fi
+	if dpkg-deb -b pkg dpkg.deb > /dev/null 2>&1; then
+		echo "FAIL: $name: accepted by dpkg-deb"
+		fail=1
+	fi
+}
+
+make_tree
+compare "sample tree"
+
+make_tree; control_file test a1.0 > pkg/DEBIAN/control; reject "version without a leading digit"
+make_tree; control_file test 1.0- > pkg/DEBIAN/control; reject "empty revision"
+make_tree; control_file te_st 1.0 > pkg/DEBIAN/control; reject "invalid package name"
+make_tree; sed -i '/^Version/d' pkg/DEBIAN/control; reject "missing version"
+make_tree; sed -i '/^Architecture/d' pkg/DEBIAN/control; reject "missing architecture"
+make_tree; chmod 0644 pkg/DEBIAN/postinst; reject "maintainer script not executable"
+make_tree; chmod 0777 pkg/DEBIAN/postinst; reject "maintainer script writable by others"
+make_tree; chmod 0700 pkg/DEBIAN; reject "control directory permissions"
+make_tree; echo '/etc/missing.conf' >> pkg/DEBIAN/conffiles; reject "missing conffile"
+
+exit $fail